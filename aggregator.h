@@ -0,0 +1,218 @@
+/**
+ * @file aggregator.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief On-target min/max/mean/stddev aggregation, summaries are sent through the UART-DMA logger
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+Instead of logging every sample of a control loop, feed the samples to an Aggregator and only a summary line per window
+is sent. add() is O(1) and never formats anything, so it's cheap enough for ISRs. A window is closed every
+[window_samples] samples and/or every [window_ms] milliseconds, and the summary is sent by process() in the main loop.
+
+Aggregator<int32_t> keeps exact integer sums (shifted by the first sample of the window) and never touches floats, not
+even when the summary is formatted. Aggregator<float> uses Welford's algorithm on the FPU.
+
+Usage:
+Aggregator<int32_t> current("current", 1000, 0);  // a summary every 1000 samples
+Aggregator<float>   speed("speed", 0, 500);       // a summary every 500ms
+current.add(adc_value);                           // in the control loop ISR
+current.process();                                // in the main loop, next to logger.process()
+
+Output:
+Stats current: n=1000 min=1987 max=2113 mean=2049 std=21
+
+Each aggregator must have a single producer, add() is not reentrant.
+*/
+
+#include <math.h>
+#include "logger.h"
+
+/**
+ * @brief Accumulators of one window, specialized for the supported sample types
+ */
+template <typename T>
+struct AggregatorWindow;
+
+/**
+ * @brief Integer window, the sums are exact and shifted by the first sample to keep them small
+ * @note Deviations from the first sample should stay below 2^24 for windows up to 2^14 samples
+ */
+template <>
+struct AggregatorWindow<int32_t> {
+    uint32_t count;
+    int32_t  min;
+    int32_t  max;
+    int32_t  shift;   // the first sample of the window
+    int64_t  sum;     // sum of (x - shift)
+    uint64_t sum_sq;  // sum of (x - shift)^2
+
+    inline void reset() {
+        count = 0U;
+    }
+
+    inline void add(int32_t value) {
+        if (count == 0U) {
+            min = max = shift = value;
+            sum = 0;
+            sum_sq = 0U;
+        }
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+        int64_t  diff = (int64_t)value - shift;
+        uint64_t magnitude = (uint64_t)(diff < 0 ? -diff : diff);  // below 2^32, its square fits 64 bits unsigned
+        sum += diff;
+        sum_sq += magnitude * magnitude;
+        ++count;
+    }
+
+    void emit(const char* name) const {
+        // variance = (sum_sq - sum^2 / count) / count, with sum^2 / count split by sum = q * count + r to avoid
+        // overflowing 64 bits
+        int64_t  q = sum / (int64_t)count, r = sum % (int64_t)count;
+        uint64_t sum_sq_mean = (uint64_t)(q * q) * count + (uint64_t)(2 * q * r) + (uint64_t)(r * r) / count;
+        uint64_t variance = sum_sq > sum_sq_mean ? (sum_sq - sum_sq_mean) / count : 0U;
+        int64_t  mean = shift + roundedDiv(sum, count);
+        uint32_t std = isqrt(variance);
+        logger.logln("Stats ", name, ": n=", count, " min=", min, " max=", max, " mean=", (int32_t)mean, " std=", std);
+    }
+
+    /**
+     * @brief Division rounded to the nearest integer
+     */
+    static inline int64_t roundedDiv(int64_t num, uint32_t den) {
+        return num >= 0 ? (num + den / 2) / (int64_t)den : -((-num + den / 2) / (int64_t)den);
+    }
+
+    /**
+     * @brief Integer square root, rounded down
+     */
+    static uint32_t isqrt(uint64_t value) {
+        uint64_t root = 0U, bit = 1ULL << 62;
+        while (bit > value) {
+            bit >>= 2;
+        }
+        while (bit) {
+            if (value >= root + bit) {
+                value -= root + bit;
+                root = (root >> 1) + bit;
+            } else {
+                root >>= 1;
+            }
+            bit >>= 2;
+        }
+        return (uint32_t)root;
+    }
+};
+
+/**
+ * @brief Float window using Welford's algorithm
+ */
+template <>
+struct AggregatorWindow<float> {
+    uint32_t count;
+    float    min;
+    float    max;
+    float    mean;
+    float    m2;  // sum of squared differences from the current mean
+
+    inline void reset() {
+        count = 0U;
+    }
+
+    inline void add(float value) {
+        if (count == 0U) {
+            min = max = value;
+            mean = m2 = 0.0f;
+        }
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+        ++count;
+        float delta = value - mean;
+        mean += delta / count;
+        m2 += delta * (value - mean);
+    }
+
+    void emit(const char* name) const {
+        logger.logln("Stats ", name, ": n=", count, " min=", min, " max=", max, " mean=", mean, " std=",
+                     sqrtf(m2 / count));
+    }
+};
+
+template <typename T>
+class Aggregator {
+
+   public:
+    /**
+     * @brief Construct an aggregator
+     *
+     * @param name name printed in the summary, must be a string literal or outlive the aggregator
+     * @param window_samples close the window after this many samples, 0 to disable
+     * @param window_ms close the window after this many milliseconds, 0 to disable
+     */
+    Aggregator(const char* name, uint32_t window_samples, uint32_t window_ms)
+        : m_name(name), m_window_samples(window_samples), m_window_ms(window_ms) {
+        m_windows[0].reset();
+        m_windows[1].reset();
+    }
+
+    /**
+     * @brief Add a sample to the current window, O(1)
+     * @note Can be called in ISRs, but only from a single context
+     */
+    void add(T value) {
+        AggregatorWindow<T>& window = m_windows[m_active];
+        window.add(value);
+
+        // A closed window is only handed over when the previous summary has been taken by process(). Otherwise the
+        // current window keeps growing until the main loop catches up.
+        if (!m_pending && ((m_window_samples && window.count >= m_window_samples) || m_close_requested)) {
+            m_close_requested = false;
+            m_active ^= 1U;
+            m_windows[m_active].reset();
+            m_pending = true;
+        }
+    }
+
+    /**
+     * @brief Send the summary of a closed window, and close the window on timeout
+     * @note Need to poll it frequently, so put it into the main loop
+     */
+    void process() {
+        if (m_pending) {
+            m_windows[m_active ^ 1U].emit(m_name);
+            m_pending = false;
+            m_window_start = HAL_GetTick();
+        } else if (m_window_ms && HAL_GetTick() - m_window_start >= m_window_ms) {
+            m_close_requested = true;  // the producer closes the window at its next sample
+        }
+    }
+
+   private:
+    AggregatorWindow<T> m_windows[2];  // the active window and the closed one waiting for process()
+
+    const char* m_name;
+    uint32_t    m_window_samples;
+    uint32_t    m_window_ms;
+    uint32_t    m_window_start = 0U;     // tick when the last summary was sent
+
+    volatile uint8_t m_active = 0U;            // index of the window add() updates, only modified by add()
+    volatile bool    m_pending = false;        // a closed window is waiting for process()
+    volatile bool    m_close_requested = false;  // process() asks add() to close the window on timeout
+};
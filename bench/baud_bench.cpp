@@ -0,0 +1,131 @@
+/**
+ * @file baud_bench.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Throughput of the logger across UART baud rates, in a model of the DMA pipeline
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -I. -o baud_bench bench/baud_bench.cpp log_format.cpp logger_sinks.cpp
+        (logger.cpp is included, for the logger of the simulated UART)
+Usage:  baud_bench [pclk Hz] [seconds]
+
+For each rate, the divisor of uartBaud() (uart_baud.h) for the APB clock [pclk] (42 MHz, APB1 of the example) gives
+the actual rate and its error. Then the real logger runs against a UART-DMA simulated on a virtual clock at that actual
+rate: a region of n bytes takes SETUP_CYCLES plus n * 10 bits, and its completion interrupt CYCLES_PER_IRQ of CPU. The
+application logs records as fast as the CPU allows, waiting for space instead of missing them, so the throughput is
+bounded either by the link or by the CPU spent formatting.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "logger.cpp"
+#include "uart_baud.h"
+
+static constexpr double CPU_HZ = 168e6;
+static constexpr double CYCLES_PER_RECORD = 1500.0;  // format and enqueue a short record
+static constexpr double CYCLES_PER_IRQ = 250.0;      // DMA completion, HAL handler and the next region
+static constexpr double SETUP_CYCLES = 300.0;        // from the start of a region to its first bit on the line
+
+static double now = 0.0;  // the virtual clock, in seconds
+
+/**
+ * @brief A UART-DMA on the virtual clock, the completion is delivered by the simulation loop
+ */
+struct SimUartSink {
+    void init(double baud) {
+        m_baud = baud;
+    }
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+    bool transmit(const volatile char*, uint16_t length) {
+        m_done = now + SETUP_CYCLES / CPU_HZ + length * 10.0 / m_baud;
+        m_busy = true;
+        m_bytes += length;
+        m_regions++;
+        return false;
+    }
+    void poll() {}
+
+    void complete() {
+        m_busy = false;
+        m_completed(m_context);
+    }
+
+    double   m_baud;
+    double   m_done = 0.0;
+    bool     m_busy = false;
+    double   m_bytes = 0.0;
+    uint32_t m_regions = 0U;
+    void (*m_completed)(void*);
+    void* m_context;
+};
+
+template class BasicLogger<SimUartSink>;
+
+int main(int argc, char** argv) {
+    uint32_t pclk = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : 42000000U;
+    double   seconds = argc > 2 ? atof(argv[2]) : 2.0;
+
+    const uint32_t rates[] = {115200U,  460800U,  921600U,  1000000U, 2000000U,
+                              2625000U, 3000000U, 4000000U, 5000000U, 6000000U};
+
+    printf("APB clock %u Hz, %.0f cycles per record, %.0f per interrupt, CPU %.0f MHz\n", pclk, CYCLES_PER_RECORD,
+           CYCLES_PER_IRQ, CPU_HZ / 1e6);
+    printf("requested  over  BRR     actual   error %%   KB/s  link %%  records/s  bytes/region  CPU %%\n");
+    for (uint32_t rate : rates) {
+        UartBaud setting = uartBaud(pclk, rate);
+        if (!setting.valid) {
+            printf("%9u  above PCLK / 8\n", rate);
+            continue;
+        }
+
+        BasicLogger<SimUartSink> sim_logger;
+        sim_logger.init((double)setting.actual);
+        SimUartSink& uart = sim_logger.getSink();
+
+        now = 0.0;
+        double   cpu = 0.0;
+        uint32_t records = 0U;
+        while (now < seconds) {
+            if (uart.m_busy && uart.m_done <= now) {
+                now += CYCLES_PER_IRQ / CPU_HZ;
+                cpu += CYCLES_PER_IRQ / CPU_HZ;
+                uart.complete();
+            } else if (sim_logger.getAvailableSpace() >= 48U) {
+                sim_logger.logln("sensor ", (uint8_t)(records & 7U), ": raw=", (int32_t)(records * 7U - 5000U),
+                                 " value=", (float)records * 0.125f);
+                records++;
+                now += CYCLES_PER_RECORD / CPU_HZ;
+                cpu += CYCLES_PER_RECORD / CPU_HZ;
+            } else {
+                now = uart.m_done;  // the buffer is full, wait for the DMA
+            }
+        }
+
+        double bytes_per_s = uart.m_bytes / now;
+        printf("%9u  %4s  0x%04x  %8u  %+7.2f  %6.1f  %6.1f  %9.0f  %12.1f  %5.1f\n", rate, setting.over8 ? "8x" : "16x",
+               setting.brr, setting.actual, setting.error_ppm / 10000.0, bytes_per_s / 1024.0,
+               100.0 * bytes_per_s * 10.0 / setting.actual, records / now, uart.m_bytes / uart.m_regions,
+               100.0 * cpu / now);
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file clock_bench.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Changes of the APB clock under heavy logging, with and without Logger::changeClock(), in a model of the UART
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -I. -o clock_bench bench/clock_bench.cpp log_format.cpp logger_sinks.cpp
+        (logger.cpp is included, for the logger of the simulated UART)
+Usage:  clock_bench [records] [baud]
+
+The real logger runs against a UART-DMA simulated on a virtual clock, byte by byte: a byte takes 10 bits at PCLK / div,
+div being the divisor of uartBaud() (uart_baud.h) set by the sink for the PCLK of that time, like
+UartDmaSink::clockChanged(). The receiver runs at [baud] (115200 by default), a byte is received broken when the
+actual rate is more than 2% off, or when the rate changed while it was on the line. The application logs records as
+fast as the CPU allows, waiting for space instead of missing them, and changes PCLK between 8 and 42 MHz every CHANGE_EVERY
+records, among the clocks giving [baud] within 2%:
+  changeClock   logger.changeClock(), the new clock between two regions then the new divisor
+  no hook       PCLK changed under the logger, the divisor is left as it is
+  no wait       PCLK and the divisor changed right away, in the middle of the region in flight
+Every mode checks that the bytes received are the records logged, in order, and changeClock must be exact: the exit
+status is 1 otherwise.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "logger.cpp"
+#include "uart_baud.h"
+
+#if LOGGER_TIMESTAMPS
+#error "the records logged are rebuilt without their timestamp, build with LOGGER_TIMESTAMPS 0"
+#endif
+
+static constexpr double   CPU_HZ = 168e6;
+static constexpr double   CYCLES_PER_RECORD = 1500.0;  // format and enqueue a short record
+static constexpr double   CYCLES_PER_POLL = 100.0;     // a pass of the wait loop of suspend()
+static constexpr uint32_t CHANGE_EVERY = 997U;         // records between two clock changes
+static constexpr double   TOLERANCE = 0.02;            // of the receiver, on the rate
+
+static const uint32_t CLOCKS[] = {42000000U, 24000000U, 8000000U, 16000000U, 36000000U};
+
+static uint32_t clocks[sizeof(CLOCKS) / sizeof(CLOCKS[0])];  // the ones reaching the baud rate
+static uint32_t clock_count = 0U;
+static double   now = 0.0;  // the virtual clock, in seconds
+static uint32_t pclk;       // the APB clock of the UART
+
+/**
+ * @brief A UART-DMA on the virtual clock sending a byte at a time, the line is run by advance()
+ */
+struct SimUartSink {
+    void init(uint32_t baud) {
+        m_baud = baud;
+        clockChanged();
+    }
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+    bool transmit(const volatile char* data, uint16_t length) {
+        m_data = data;
+        m_length = length;
+        m_sent = 0U;
+        m_busy = true;
+        return false;
+    }
+
+    /**
+     * @brief The completion interrupt comes while the logger waits in suspend()
+     */
+    void poll() {
+        advance(CYCLES_PER_POLL / CPU_HZ);
+    }
+
+    /**
+     * @brief The divisor for the current PCLK, as UartDmaSink::clockChanged()
+     */
+    void clockChanged() {
+        UartBaud setting = uartBaud(pclk, m_baud);
+        m_div = setting.over8 ? ((setting.brr & 0xFFF0U) >> 1) | (setting.brr & 7U) : setting.brr;
+    }
+
+    /**
+     * @brief Run the line for [seconds], the completion of the region is reported when its last byte is out
+     */
+    void advance(double seconds) {
+        double until = now + seconds;
+        while (m_busy) {
+            if (m_byte_done == 0.0) {
+                m_byte_pclk = pclk;
+                m_byte_div = m_div;
+                m_byte_done = now + 10.0 * m_div / pclk;
+            }
+            if (m_byte_done > until) {
+                break;
+            }
+            now = m_byte_done;
+            m_byte_done = 0.0;
+            receive((char)m_data[m_sent++]);
+            if (m_sent == m_length) {
+                m_busy = false;
+                m_completed(m_context);
+            }
+        }
+        now = until;
+    }
+
+    void receive(char byte) {
+        double rate = (double)pclk / m_div;
+        bool   broken = pclk != m_byte_pclk || m_div != m_byte_div || rate < m_baud * (1.0 - TOLERANCE) ||
+                      rate > m_baud * (1.0 + TOLERANCE);
+        m_broken += broken;
+        m_received += broken ? (char)(byte ^ 0x55) : byte;  // the receiver samples other bits
+    }
+
+    uint32_t             m_baud;
+    uint32_t             m_div;
+    const volatile char* m_data;
+    uint16_t             m_length;
+    uint16_t             m_sent;
+    bool                 m_busy = false;
+    double               m_byte_done = 0.0;  // the end of the byte on the line, 0 between two bytes
+    uint32_t             m_byte_pclk;        // the clock and the divisor when the byte started
+    uint32_t             m_byte_div;
+    uint32_t             m_broken = 0U;
+    std::string          m_received;
+    void (*m_completed)(void*);
+    void* m_context;
+};
+
+template class BasicLogger<SimUartSink>;
+
+enum class Mode { CHANGE_CLOCK, NO_HOOK, NO_WAIT };
+
+/**
+ * @brief Log [records] records with the clock changes of [mode], true if the bytes received are the records logged
+ */
+static bool simulate(Mode mode, const char* name, uint32_t records, uint32_t baud) {
+    BasicLogger<SimUartSink> sim_logger;
+    pclk = clocks[0];
+    now = 0.0;
+    sim_logger.init(baud);
+    SimUartSink& uart = sim_logger.getSink();
+
+    std::string logged;
+    uint32_t    random = 0x9E3779B9U, changes = 0U, timeouts = 0U;
+    for (uint32_t i = 0; i < records; i++) {
+        while (sim_logger.getAvailableSpace() < 48U) {
+            // the buffer is full, wait for the byte on the line
+            uart.advance(uart.m_byte_done > now ? uart.m_byte_done - now : CYCLES_PER_POLL / CPU_HZ);
+            sim_logger.process();
+        }
+        uint32_t missed = sim_logger.getMissedCount();
+        sim_logger.logln("record ", i, " value ", random);
+        if (sim_logger.getMissedCount() == missed) {
+            char     record[Logger::SINGLE_MSG_SIZE];
+            uint16_t length = LogFormatter::formatMulti(record, "record ", i, " value ", random);
+            logged.append(record, length);
+            logged += '\n';
+        }
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        uart.advance(CYCLES_PER_RECORD / CPU_HZ);
+        sim_logger.process();
+
+        if (i % CHANGE_EVERY == CHANGE_EVERY - 1U) {
+            uint32_t clock = clocks[random % clock_count];
+            if (mode == Mode::CHANGE_CLOCK) {
+                // a real second of timeout, the virtual clock runs far faster
+                if (!sim_logger.changeClock([clock] { pclk = clock; }, 1000000000U)) {
+                    timeouts++;
+                    continue;
+                }
+            } else {
+                pclk = clock;
+                if (mode == Mode::NO_WAIT) {
+                    uart.clockChanged();
+                }
+            }
+            changes++;
+        }
+    }
+    while (!sim_logger.isIdle()) {
+        uart.advance(CYCLES_PER_POLL / CPU_HZ);
+        sim_logger.process();
+    }
+
+    bool identical = uart.m_received == logged;
+    printf("%-12s  %7u  %8u  %8u  %10zu  %10zu  %9u  %s\n", name, changes, timeouts, sim_logger.getMissedCount(),
+           logged.size(), uart.m_received.size(), uart.m_broken, identical ? "identical" : "DIFFERENT");
+    return identical;
+}
+
+int main(int argc, char** argv) {
+    uint32_t records = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : 200000U;
+    uint32_t baud = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 115200U;
+
+    for (uint32_t clock : CLOCKS) {
+        UartBaud setting = uartBaud(clock, baud);
+        if (setting.valid && setting.error_ppm <= TOLERANCE * 1e6 && setting.error_ppm >= -TOLERANCE * 1e6) {
+            clocks[clock_count++] = clock;
+        } else {
+            printf("PCLK %u Hz can't give %u baud within %.0f%%, not used\n", clock, baud, TOLERANCE * 100.0);
+        }
+    }
+    if (clock_count == 0U) {
+        return 1;
+    }
+
+    printf("%u records at %u baud, PCLK changed every %u records\n", records, baud, CHANGE_EVERY);
+    printf("mode          changes  timeouts    missed  bytes sent   received     broken  stream\n");
+    bool exact = simulate(Mode::CHANGE_CLOCK, "changeClock", records, baud);
+    simulate(Mode::NO_HOOK, "no hook", records, baud);
+    simulate(Mode::NO_WAIT, "no wait", records, baud);
+    return exact ? 0 : 1;
+}
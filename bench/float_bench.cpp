@@ -0,0 +1,143 @@
+/**
+ * @file float_bench.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief The cycles and the bytes of a float with 3 decimals and with the shortest digits, see LOGGER_FLOAT_SHORTEST
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -DLOGGER_FLOAT_SHORTEST=1 -I. -o float_bench bench/float_bench.cpp
+        log_format.cpp
+Target: build the firmware with LOGGER_FLOAT_SHORTEST 1, add this file and call floatBenchRun() after logger.init(),
+        the results are logged
+
+For values like the ones logged (sensor readings with a few decimals, noise around 1e-5, integers, and any bit
+pattern), the mean cycles per value and the mean bytes of formatDouble(), the 3 decimals (a float given as a double),
+and of formatFloatShortest(). The cycles are the TSC on the host and the DWT cycle counter on the target, over
+VALUES values formatted in a loop. A Cortex-M4 has no double FPU, so formatDouble() runs in software there while
+the shortest digits only take 32x32-bit multiplications and divisions by 10.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#if defined(LOGGER_HOST) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+#include "logger.h"
+
+#if !LOGGER_FLOAT_SHORTEST
+#error "build with -DLOGGER_FLOAT_SHORTEST=1"
+#endif
+
+#ifndef FLOAT_BENCH_VALUES
+#ifdef LOGGER_HOST
+#define FLOAT_BENCH_VALUES 1000000U
+#else
+#define FLOAT_BENCH_VALUES 1000U  // in RAM on the target
+#endif
+#endif
+
+static constexpr uint32_t VALUES = FLOAT_BENCH_VALUES;
+
+static inline uint32_t benchCycles() {
+#if defined(LOGGER_HOST) && (defined(__x86_64__) || defined(__i386__))
+    return (uint32_t)__rdtsc();
+#else
+    return logPortCycles();
+#endif
+}
+
+static float values[VALUES];
+
+/**
+ * @brief Mean cycles and bytes of formatting all the values, as doubles (3 decimals) or as floats (shortest)
+ */
+template <typename T>
+static void measure(uint32_t& cycles, uint32_t& bytes) {
+    char     buffer[LogFormatter::SINGLE_MSG_SIZE];
+    uint64_t total_bytes = 0U, total_cycles = 0U;
+    for (uint32_t i = 0; i < VALUES; i += 100U) {  // in slices, the 32-bit cycle counter would wrap
+        uint32_t start = benchCycles();
+        for (uint32_t k = i; k < i + 100U && k < VALUES; k++) {
+            total_bytes += LogFormatter::formatMulti(buffer, (T)values[k]);
+            __asm__ volatile("" : : "r"(buffer) : "memory");  // the output is used
+        }
+        total_cycles += benchCycles() - start;
+    }
+    cycles = (uint32_t)(total_cycles / VALUES);
+    bytes = (uint32_t)(total_bytes * 10U / VALUES);  // tenths of bytes
+}
+
+static void report(const char* kind) {
+    uint32_t fixed_cycles, fixed_bytes, shortest_cycles, shortest_bytes;
+    measure<double>(fixed_cycles, fixed_bytes);
+    measure<float>(shortest_cycles, shortest_bytes);
+#ifdef LOGGER_HOST
+    printf("%-9s  %10u  %5u.%u  %10u  %5u.%u\n", kind, fixed_cycles, fixed_bytes / 10U, fixed_bytes % 10U,
+           shortest_cycles, shortest_bytes / 10U, shortest_bytes % 10U);
+#else
+    while (logger.getAvailableSpace() < Logger::SINGLE_MSG_SIZE) {
+        logger.process();
+    }
+    logger.logln(kind, ": 3 decimals ", fixed_cycles, " cycles ", fixed_bytes, "/10 bytes, shortest ", shortest_cycles,
+                 " cycles ", shortest_bytes, "/10 bytes");
+#endif
+}
+
+/**
+ * @brief Run the comparison, on the target after logger.init()
+ */
+void floatBenchRun() {
+    uint32_t random = 0x9E3779B9U;
+    auto     next = [&random] {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return random;
+    };
+#ifdef LOGGER_HOST
+    printf("values     3 decimals cycles  bytes    shortest cycles  bytes\n");
+#endif
+    for (uint32_t i = 0; i < VALUES; i++) {
+        values[i] = (float)((int32_t)(next() % 400000U) - 200000) * 0.01f;  // -2000.00 to 2000.00
+    }
+    report("sensor");
+    for (uint32_t i = 0; i < VALUES; i++) {
+        values[i] = (float)((int32_t)(next() % 2001U) - 1000) * 1e-8f;  // noise within +-1e-5
+    }
+    report("noise");
+    for (uint32_t i = 0; i < VALUES; i++) {
+        values[i] = (float)(next() % 100000U);
+    }
+    report("integers");
+    for (uint32_t i = 0; i < VALUES; i++) {
+        uint32_t bits = next();
+        bits = (bits & 0x7F800000U) == 0x7F800000U ? bits ^ 0x40000000U : bits;  // no NaN nor infinity
+        memcpy(&values[i], &bits, sizeof(bits));
+    }
+    report("any bits");
+}
+
+#ifdef LOGGER_HOST
+
+int main() {
+    floatBenchRun();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,363 @@
+/**
+ * @file format_bench.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief The cycles and the stack of formatMulti() plus enqueue, compared with snprintf() and a minimal printf
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -DLOGGER_SINK=RamSink -I. -o format_bench bench/format_bench.cpp logger.cpp
+        log_format.cpp logger_sinks.cpp
+Target: add this file to the firmware and call formatBenchRun() after logger.init(), the results are logged
+
+For six messages (integers, floats, strings, a mix like the examples, and Q15 and Q31 values, which printf only
+formats once converted to double), the median cycles of 255 runs and the peak stack of:
+    log()               formatMulti() and enqueue, the logger as used
+    formatMulti()       the formatting alone
+    snprintf()          into a buffer, the format string equivalent to the arguments of log()
+    snprintf+enqueue    the same, then enqueued like log() does
+    mini printf         a minimal vsnprintf() (%d %u %s %c %.Nf, no flags nor widths) of the size found in small
+                        embedded projects, into a buffer
+The outputs of the three formatters are compared first, a message formatted differently is reported.
+
+The cycles are the TSC on the host and the DWT cycle counter on the target. The stack is measured by painting the
+FORMAT_BENCH_PAINT bytes below the frame of the caller and looking for the deepest byte overwritten by the call.
+
+Flash: build with -DFORMAT_BENCH_ONLY=1 (the logger), 2 (snprintf), 3 (mini printf) or 4 (none), each keeps the
+calls to one formatter only, and compare the text of the images with size(1). On the target the library is the one
+of the toolchain, newlib-nano without -u _printf_float formats no float at all. On the host glibc links vfprintf()
+into every static image, so compare the symbols instead: nm -C -S --size-sort format_bench.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(LOGGER_HOST) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+#include "logger.h"
+
+#ifndef FORMAT_BENCH_ONLY
+#define FORMAT_BENCH_ONLY 0  // all the formatters
+#endif
+
+#ifndef FORMAT_BENCH_PAINT
+#ifdef LOGGER_HOST
+#define FORMAT_BENCH_PAINT 16384U
+#else
+#define FORMAT_BENCH_PAINT 2048U  // fits the stack of the examples, a deeper formatter is reported as at least this
+#endif
+#endif
+
+static constexpr uint16_t RUNS = 255U;
+static constexpr uint8_t  PAINT = 0xA5U;
+
+static inline uint32_t benchCycles() {
+#if defined(LOGGER_HOST) && (defined(__x86_64__) || defined(__i386__))
+    return (uint32_t)__rdtsc();
+#else
+    return logPortCycles();
+#endif
+}
+
+/**
+ * @brief A minimal vsnprintf(): %d %u %s %c %% and %f with a precision, truncated to [size]
+ */
+static int miniVsnprintf(char* buf, size_t size, const char* format, va_list args) {
+    size_t length = 0U;
+    auto   put = [&](char c) {
+        if (length + 1U < size) {
+            buf[length] = c;
+        }
+        length++;
+    };
+    auto putUnsigned = [&](uint32_t value) {
+        char digits[10];
+        int  count = 0;
+        do {
+            digits[count++] = (char)('0' + value % 10U);
+            value /= 10U;
+        } while (value);
+        while (count) {
+            put(digits[--count]);
+        }
+    };
+
+    for (; *format; format++) {
+        if (*format != '%') {
+            put(*format);
+            continue;
+        }
+        int precision = 6;
+        if (*++format == '.') {
+            precision = 0;
+            while (*++format >= '0' && *format <= '9') {
+                precision = precision * 10 + (*format - '0');
+            }
+        }
+        switch (*format) {
+            case 'd': {
+                int32_t value = va_arg(args, int32_t);
+                if (value < 0) {
+                    put('-');
+                }
+                putUnsigned(value < 0 ? 0U - (uint32_t)value : (uint32_t)value);
+                break;
+            }
+            case 'u':
+                putUnsigned(va_arg(args, uint32_t));
+                break;
+            case 's':
+                for (const char* str = va_arg(args, const char*); *str; str++) {
+                    put(*str);
+                }
+                break;
+            case 'c':
+                put((char)va_arg(args, int));
+                break;
+            case 'f': {
+                double value = va_arg(args, double);
+                if (value < 0) {
+                    put('-');
+                    value = -value;
+                }
+                double rounding = 0.5;
+                for (int i = 0; i < precision; i++) {
+                    rounding /= 10.0;
+                }
+                value += rounding;
+                uint32_t integer = (uint32_t)value;
+                putUnsigned(integer);
+                if (precision) {
+                    put('.');
+                }
+                double fraction = value - integer;
+                for (int i = 0; i < precision; i++) {
+                    fraction *= 10.0;
+                    put((char)('0' + (int)fraction));
+                    fraction -= (int)fraction;
+                }
+                break;
+            }
+            case '%':
+                put('%');
+                break;
+            default:
+                return -1;
+        }
+    }
+    if (size) {
+        buf[length < size ? length : size - 1U] = '\0';
+    }
+    return (int)length;
+}
+
+static int miniSnprintf(char* buf, size_t size, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = miniVsnprintf(buf, size, format, args);
+    va_end(args);
+    return length;
+}
+
+static inline char* stackPointer() {
+    char* sp;
+#if defined(__x86_64__)
+    __asm__ volatile("mov %%rsp, %0" : "=r"(sp));
+#elif defined(__arm__)
+    __asm__ volatile("mov %0, sp" : "=r"(sp));
+#else
+    sp = (char*)__builtin_frame_address(0);
+#endif
+    return sp;
+}
+
+/**
+ * @brief Call out of line, so the locals of the call are below the stack pointer of the caller
+ */
+template <typename F>
+__attribute__((noinline)) static void invoke(F& call) {
+    call();
+}
+
+/**
+ * @brief The bytes of stack used by the call, the deepest byte overwritten of the FORMAT_BENCH_PAINT painted below
+ * the stack pointer. Nothing is called between the painting and the call
+ */
+template <typename F>
+__attribute__((noinline)) static uint32_t stackUsage(F call) {
+    volatile char* top = stackPointer();
+    volatile char* pos = top - FORMAT_BENCH_PAINT;
+    for (; pos < top; pos++) {
+        *pos = (char)PAINT;
+    }
+    invoke(call);
+    for (pos = top - FORMAT_BENCH_PAINT; pos < top && (uint8_t)*pos == PAINT; pos++) {
+    }
+    return (uint32_t)(top - pos);
+}
+
+/**
+ * @brief The median of [RUNS] timings of the call, the logger is given room before each one
+ */
+template <typename F>
+__attribute__((noinline)) static uint32_t medianCycles(F call) {
+    static uint32_t samples[RUNS];
+    for (uint16_t run = 0; run < RUNS; run++) {
+        while (logger.getAvailableSpace() < Logger::SINGLE_MSG_SIZE) {
+            logger.process();
+        }
+        uint32_t start = benchCycles();
+        call();
+        samples[run] = benchCycles() - start;
+    }
+    for (uint16_t i = 1; i < RUNS; i++) {  // insertion sort, no library on the target
+        uint32_t value = samples[i];
+        uint16_t j = i;
+        for (; j > 0 && samples[j - 1U] > value; j--) {
+            samples[j] = samples[j - 1U];
+        }
+        samples[j] = value;
+    }
+    return samples[RUNS / 2U];
+}
+
+static void report(const char* message, const char* formatter, uint16_t bytes, uint32_t cycles, uint32_t stack) {
+#ifdef LOGGER_HOST
+    printf("%-8s  %-16s  %5u  %7u  %s%u\n", message, formatter, bytes, cycles,
+           stack >= FORMAT_BENCH_PAINT ? ">=" : "", stack);
+#else
+    while (logger.getAvailableSpace() < Logger::SINGLE_MSG_SIZE) {
+        logger.process();
+    }
+    logger.logln(message, " ", formatter, " ", bytes, " bytes ", cycles, " cycles ",
+                 stack >= FORMAT_BENCH_PAINT ? ">=" : "", stack, " stack");
+#endif
+}
+
+using Printf = int (*)(char* buf, size_t size, const char* format, ...);
+
+/**
+ * @brief Time and measure the formatters on a message, [print] formats it with a printf, [format] with formatMulti()
+ */
+template <typename P, typename F>
+static void compare(const char* message, P print, F format) {
+    static char buffer[Logger::SINGLE_MSG_SIZE];
+    uint16_t    bytes;
+    (void)print;
+    (void)format;
+
+#if !FORMAT_BENCH_ONLY
+    char reference[Logger::SINGLE_MSG_SIZE], other[Logger::SINGLE_MSG_SIZE];
+    reference[format(reference)] = '\0';
+    print(other, sizeof(other), (Printf)snprintf);
+    if (strcmp(reference, other)) {
+        report(message, "snprintf differs", (uint16_t)strlen(other), 0U, 0U);
+    }
+    print(other, sizeof(other), miniSnprintf);
+    if (strcmp(reference, other)) {
+        report(message, "mini differs", (uint16_t)strlen(other), 0U, 0U);
+    }
+#endif
+
+#if !FORMAT_BENCH_ONLY || FORMAT_BENCH_ONLY == 1
+    auto logged = [&] {  // what log() does
+        char line[Logger::SINGLE_MSG_SIZE];
+        logger.enqueue(line, format(line));
+    };
+    bytes = format(buffer);
+    report(message, "log()", bytes, medianCycles(logged), stackUsage(logged));
+    report(message, "formatMulti()", bytes, medianCycles([&] { format(buffer); }),
+           stackUsage([&] { format(buffer); }));
+#endif
+#if !FORMAT_BENCH_ONLY || FORMAT_BENCH_ONLY == 2
+    bytes = (uint16_t)print(buffer, sizeof(buffer), (Printf)snprintf);
+    report(message, "snprintf()", bytes, medianCycles([&] { print(buffer, sizeof(buffer), (Printf)snprintf); }),
+           stackUsage([&] { print(buffer, sizeof(buffer), (Printf)snprintf); }));
+    auto enqueued = [&] {
+        char line[Logger::SINGLE_MSG_SIZE];
+        logger.enqueue(line, (uint16_t)print(line, sizeof(line), (Printf)snprintf));
+    };
+    report(message, "snprintf+enqueue", bytes, medianCycles(enqueued), stackUsage(enqueued));
+#endif
+#if !FORMAT_BENCH_ONLY || FORMAT_BENCH_ONLY == 3
+    bytes = (uint16_t)print(buffer, sizeof(buffer), miniSnprintf);
+    report(message, "mini printf", bytes, medianCycles([&] { print(buffer, sizeof(buffer), miniSnprintf); }),
+           stackUsage([&] { print(buffer, sizeof(buffer), miniSnprintf); }));
+#endif
+}
+
+/**
+ * @brief Run the comparison, on the target after logger.init()
+ */
+void formatBenchRun() {
+    volatile int32_t seed = 7;  // the arguments are not known at compile time
+    int32_t          k = seed;
+    int32_t          id = -12345 * k, delta = k - 100, raw = k * 7 - 5000;
+    uint32_t         count = 4000000000U - (uint32_t)k;
+    float            t = (float)k * 1.5f, v = (float)k * -0.375f, a = (float)k * 176.25f, value = (float)k * 0.125f;
+    const char*      mode = k > 0 ? "auto" : "manual";
+    uint8_t          sensor = (uint8_t)(k & 7);
+    int16_t          gain = (int16_t)(k * 3001), phase = (int16_t)(k * -1111), error = (int16_t)(k * 5);
+    int32_t          coeff = k * 123456789, state = k * -98765432;
+#ifdef LOGGER_HOST
+    printf("message   formatter         bytes   cycles  stack\n");
+#endif
+    compare(
+        "ints", [&](char* buf, size_t size, Printf print) { return print(buf, size, "id=%d count=%u delta=%d", id, count, delta); },
+        [&](char* buf) { return Logger::formatMulti(buf, "id=", id, " count=", count, " delta=", delta); });
+    compare(
+        "floats", [&](char* buf, size_t size, Printf print) { return print(buf, size, "t=%.3f v=%.3f a=%.3f", t, v, a); },
+        [&](char* buf) { return Logger::formatMulti(buf, "t=", t, " v=", v, " a=", a); });
+    compare(
+        "strings",
+        [&](char* buf, size_t size, Printf print) {
+            return print(buf, size, "mode %s state %s: %s", mode, "running", "sensor calibration done");
+        },
+        [&](char* buf) { return Logger::formatMulti(buf, "mode ", mode, " state ", "running", ": ", "sensor calibration done"); });
+    compare(
+        "mixed",
+        [&](char* buf, size_t size, Printf print) { return print(buf, size, "sensor %u: raw=%d value=%.3f", sensor, raw, value); },
+        [&](char* buf) { return Logger::formatMulti(buf, "sensor ", sensor, ": raw=", raw, " value=", value); });
+    compare(
+        "q15",
+        [&](char* buf, size_t size, Printf print) {
+            return print(buf, size, "g=%.5f p=%.5f e=%.5f", gain / 32768.0f, phase / 32768.0f, error / 32768.0f);
+        },
+        [&](char* buf) {
+            return Logger::formatMulti(buf, "g=", Logger::q15(gain), " p=", Logger::q15(phase), " e=", Logger::q15(error));
+        });
+    compare(
+        "q31",
+        [&](char* buf, size_t size, Printf print) {
+            return print(buf, size, "c=%.10f s=%.10f", coeff / 2147483648.0, state / 2147483648.0);
+        },
+        [&](char* buf) { return Logger::formatMulti(buf, "c=", Logger::q31(coeff), " s=", Logger::q31(state)); });
+}
+
+#ifdef LOGGER_HOST
+
+static char ram_buffer[1U << 16];
+
+int main() {
+    logger.init(ram_buffer, (uint32_t)sizeof(ram_buffer));
+    formatBenchRun();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,418 @@
+/**
+ * @file format_corpus.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Differential check of the number formatters against a reference, on edge cases and millions of random values
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -I. -fsanitize=undefined -o format_corpus bench/format_corpus.cpp
+        log_format.cpp
+Usage:  format_corpus [random values per kind] [seed]      exits with 1 on a mismatch
+
+Run it before and after a change to the formatters. The values go through formatMulti(), like the ones logged, as
+int32_t (formatSignedNum), uint32_t (formatUnsignedNum), float and double (formatDouble). The corpus of each kind is
+the edge cases (INT32_MIN, UINT32_MAX, powers of ten and their neighbours, zeros, denormals, exact halfway cases of
+the third decimal and their neighbours, the 2^32 and 2^64 boundaries, infinities and NaN), then [random] values (4
+million by default) drawn from all bit patterns, from all digit counts and from typical sensor ranges.
+
+The reference is printf: %d and %u, and for the decimals the exact expansion given by %.*f rounded to 3 decimals half
+away from zero by string arithmetic, so the pinned behavior is:
+    - an integer is printed exactly, INT32_MIN included
+    - a decimal has 3 decimals, rounded half away from zero from its exact binary value, and a '-' when it is negative
+      even if it rounds to 0.000
+    - NaN is "nan" and a magnitude from 2^64 up, infinities included, is "inf" with its sign
+A double needs more than the 53 bits of the scaled fraction, so one whose exact expansion after the third decimal
+starts with 4 followed by ten 9 may also round up: it's counted as tolerated, not as a mismatch. A float never is.
+
+The fixed-point values of q15(), q31() and fixed<>() are checked the same way against the exact expansion of
+raw / 2^frac_bits, rounded half away from zero to the fewest decimals d with 10^d > 2^frac_bits: every Q15, and for
+each of the 0 to 31 fractional bits the edges, the exact halfway cases of the last decimal and random values.
+
+Built with -DLOGGER_FLOAT_SHORTEST=1, a float is checked against the fewest significant digits that printf and strtof
+find to read back as the same float, the closest of them and the even one of two as close.
+*/
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "log_format.h"
+
+static constexpr size_t REPORTED = 10U;  // mismatches printed per kind
+
+/**
+ * @brief Round an exact decimal expansion "int.frac" to [decimals] decimals, half away from zero, by string arithmetic
+ */
+static std::string roundExpansion(const std::string& digits, size_t decimals) {
+    size_t      point = digits.find('.');
+    std::string rounded = digits.substr(0, point) + digits.substr(point + 1U, decimals);
+    if (point + 1U + decimals < digits.size() && digits[point + 1U + decimals] >= '5') {
+        size_t i = rounded.size();
+        while (i > 0 && rounded[i - 1U] == '9') {
+            rounded[--i] = '0';
+        }
+        if (i == 0U) {
+            rounded.insert(0U, "1");
+        } else {
+            rounded[i - 1U]++;
+        }
+    }
+    return rounded.substr(0, rounded.size() - decimals) + "." + rounded.substr(rounded.size() - decimals);
+}
+
+/**
+ * @brief Round the exact decimal expansion of a value to 3 decimals, half away from zero, like formatDouble() does
+ */
+static std::string referenceDecimal(double value, bool& near_tie) {
+    near_tie = false;
+    if (value != value) {
+        return "nan";
+    }
+    std::string sign = value < 0 ? "-" : "";
+    if (fabs(value) >= 18446744073709551616.0) {
+        return sign + "inf";
+    }
+    if (fabs(value) < 1e-6) {
+        return sign + "0.000";  // far from the first tie at 0.0005, and the expansion would take a thousand digits
+    }
+    // a double m * 2^(exponent - 53) has 53 - exponent decimals, a few more for the near tie check
+    int exponent;
+    frexp(value, &exponent);
+    static char expansion[1500];
+    snprintf(expansion, sizeof(expansion), "%.*f", 53 - exponent > 16 ? 53 - exponent : 16, fabs(value));
+    near_tie = !strncmp(strchr(expansion, '.') + 4U, "49999999999", 11U);
+    return sign + roundExpansion(expansion, 3U);
+}
+
+/**
+ * @brief The value of a mismatch, for the report
+ */
+template <typename T>
+static double printable(T value) {
+    return (double)value;
+}
+static double printable(LogFixed value) {
+    return ldexp((double)value.raw, -value.frac_bits);
+}
+
+/**
+ * @brief The mismatches of a kind of value
+ */
+struct Check {
+    explicit Check(const char* kind) : m_kind(kind) {}
+
+    template <typename T>
+    void compare(T value, const std::string& expected, bool tolerated = false) {
+        char     actual[LogFormatter::SINGLE_MSG_SIZE];
+        uint16_t length = LogFormatter::formatMulti(actual, value);
+        actual[length] = '\0';
+        m_values++;
+        if (expected == actual) {
+            return;
+        }
+        if (tolerated) {
+            m_tolerated++;
+            return;
+        }
+        if (m_mismatches++ < REPORTED) {
+            printf("  %s %.17g: \"%s\" instead of \"%s\"\n", m_kind, printable(value), actual, expected.c_str());
+        }
+    }
+
+    void report() const {
+        printf("%-8s %9zu values, %zu mismatches, %zu tolerated\n", m_kind, m_values, m_mismatches, m_tolerated);
+    }
+
+    const char* m_kind;
+    size_t      m_values = 0U;
+    size_t      m_mismatches = 0U;
+    size_t      m_tolerated = 0U;
+};
+
+static void checkSigned(Check& check, int32_t value) {
+    char expected[16];
+    snprintf(expected, sizeof(expected), "%d", value);
+    check.compare(value, expected);
+}
+
+static void checkUnsigned(Check& check, uint32_t value) {
+    char expected[16];
+    snprintf(expected, sizeof(expected), "%u", value);
+    check.compare(value, expected);
+}
+
+/**
+ * @brief The decimals telling all the values with [frac_bits] apart, the fewest with 10^decimals > 2^frac_bits
+ */
+static size_t fixedDecimals(uint8_t frac_bits) {
+    size_t   decimals = 0U;
+    uint64_t power = 1U;
+    for (; power <= (1ULL << frac_bits) && frac_bits; power *= 10U) {
+        decimals++;
+    }
+    return decimals;
+}
+
+static void checkFixed(Check& check, LogFixed value) {
+    static char expansion[64];
+    if (value.frac_bits == 0U) {
+        snprintf(expansion, sizeof(expansion), "%d", value.raw);
+        check.compare(value, expansion);
+        return;
+    }
+    // raw / 2^frac_bits is exact in a double and has frac_bits decimals
+    snprintf(expansion, sizeof(expansion), "%.*f", value.frac_bits, fabs(ldexp((double)value.raw, -value.frac_bits)));
+    std::string expected = roundExpansion(expansion, fixedDecimals(value.frac_bits));
+    check.compare(value, (value.raw < 0 ? "-" : "") + expected);
+}
+
+#if LOGGER_FLOAT_SHORTEST
+
+/**
+ * @brief The fewest significant digits reading back as the float, the closest of them (to even), laid out like
+ * formatFloatShortest(): plain from 1e-4 to 1e9, scientific beyond
+ */
+static std::string referenceShortest(float value) {
+    if (value != value) {
+        return "nan";
+    }
+    std::string sign = signbit(value) ? "-" : "";
+    if (value == 0.0f || isinf(value)) {
+        return sign + (value == 0.0f ? "0" : "inf");
+    }
+    char     text[48];
+    uint64_t digits = 0U;
+    int      length = 0, exponent = 0;
+    for (length = 1; length <= 9; length++) {
+        // the correctly rounded digits and their neighbours, the interval of the float isn't symmetric at a power of 2
+        snprintf(text, sizeof(text), "%.*e", length - 1, fabs((double)value));
+        uint64_t nearest = 0U;
+        for (const char* pos = text; *pos != 'e'; pos++) {
+            nearest = *pos == '.' ? nearest : nearest * 10U + (uint64_t)(*pos - '0');
+        }
+        int    scale = atoi(strchr(text, 'e') + 1) - (length - 1);
+        double best = INFINITY;
+        for (uint64_t candidate = nearest - 1U; candidate <= nearest + 1U; candidate++) {
+            snprintf(text, sizeof(text), "%llue%d", (unsigned long long)candidate, scale);
+            double error = fabs(strtod(text, nullptr) - fabs((double)value));
+            bool   closer = error < best || (error == best && candidate % 2U == 0U);  // an exact tie to even
+            if (strtof(text, nullptr) == fabsf(value) && closer) {
+                best = error;
+                digits = candidate;
+                exponent = scale;
+            }
+        }
+        if (best != INFINITY) {
+            break;
+        }
+    }
+    std::string mantissa = std::to_string(digits);
+    while (mantissa.size() > 1U && mantissa.back() == '0') {
+        mantissa.pop_back();
+        exponent++;
+    }
+    int point = (int)mantissa.size() + exponent;
+    if (point > 9 || point < -3) {
+        std::string rest = mantissa.size() > 1U ? "." + mantissa.substr(1) : "";
+        return sign + mantissa[0] + rest + "e" + std::to_string(point - 1);
+    }
+    if (point <= 0) {
+        return sign + "0." + std::string((size_t)-point, '0') + mantissa;
+    }
+    if (point >= (int)mantissa.size()) {
+        return sign + mantissa + std::string((size_t)point - mantissa.size(), '0');
+    }
+    return sign + mantissa.substr(0, (size_t)point) + "." + mantissa.substr((size_t)point);
+}
+
+static void checkFloat(Check& check, float value) {
+    check.compare(value, referenceShortest(value));
+}
+
+#else
+
+static void checkFloat(Check& check, float value) {
+    bool near_tie;
+    check.compare(value, referenceDecimal(value, near_tie));
+}
+
+#endif
+
+static void checkDouble(Check& check, double value) {
+    bool        near_tie;
+    std::string expected = referenceDecimal(value, near_tie);
+    check.compare(value, expected, near_tie);
+}
+
+/**
+ * @brief Values exactly halfway between two third decimals and their neighbours. x * 1000 = n + 0.5 needs x = odd / 2000,
+ * representable in binary when it's an odd multiple of 1/16 = 125/2000
+ */
+template <typename T>
+static std::vector<T> halfwayCases(std::mt19937_64& random, size_t count, uint64_t range) {
+    std::vector<T> values;
+    while (values.size() < count) {
+        T tie = (T)((double)(2U * (random() % range) + 1U) / 16.0);
+        T sign = random() & 1U ? (T)-1 : (T)1;
+        values.push_back(sign * tie);
+        values.push_back(sign * nextafter(tie, (T)0));
+        values.push_back(sign * nextafter(tie, (T)INFINITY));
+    }
+    return values;
+}
+
+int main(int argc, char** argv) {
+    size_t          count = argc > 1 ? strtoul(argv[1], nullptr, 0) : 4000000U;
+    std::mt19937_64 random(argc > 2 ? strtoull(argv[2], nullptr, 0) : 1U);
+
+    Check signed_check("int32"), unsigned_check("uint32"), float_check("float"), double_check("double");
+    Check q15_check("q15"), q31_check("q31"), fixed_check("fixed");
+
+    // edge cases
+    const int32_t signed_edges[] = {INT32_MIN, INT32_MIN + 1, -1000000000, -999999999, -10, -9, -1, 0, 1, 9, 10,
+                                    999999999, 1000000000, INT32_MAX - 1, INT32_MAX};
+    for (int32_t value : signed_edges) {
+        checkSigned(signed_check, value);
+    }
+    for (uint32_t power = 1U; power <= 1000000000U; power *= 10U) {
+        for (uint32_t value : {power - 1U, power, power + 1U}) {
+            checkUnsigned(unsigned_check, value);
+            checkSigned(signed_check, (int32_t)value);
+            checkSigned(signed_check, -(int32_t)value);
+        }
+        if (power == 1000000000U) {
+            break;
+        }
+    }
+    for (uint32_t value : {0U, 4294967294U, UINT32_MAX}) {
+        checkUnsigned(unsigned_check, value);
+    }
+    const double decimal_edges[] = {0.0,
+                                    -0.0,
+                                    0.0005,
+                                    -0.0005,
+                                    0.0004999,
+                                    0.9995,
+                                    0.9994999,
+                                    1.0005,
+                                    2.675,
+                                    999.9995,
+                                    4294967295.0,
+                                    4294967295.9994,
+                                    4294967295.9996,
+                                    4294967296.0,
+                                    9007199254740993.0,
+                                    18446744073709549568.0,
+                                    18446744073709551616.0,
+                                    1e300,
+                                    -1e300,
+                                    DBL_MIN,
+                                    DBL_MIN / 4.0,
+                                    std::numeric_limits<double>::denorm_min(),
+                                    -std::numeric_limits<double>::denorm_min(),
+                                    DBL_MAX,
+                                    (double)FLT_MIN,
+                                    (double)FLT_MIN / 8.0,
+                                    (double)std::numeric_limits<float>::denorm_min(),
+                                    (double)FLT_MAX,
+                                    INFINITY,
+                                    -INFINITY,
+                                    NAN};
+    for (double value : decimal_edges) {
+        checkDouble(double_check, value);
+        checkFloat(float_check, (float)value);
+    }
+    for (float value : halfwayCases<float>(random, 30000U, 1U << 20)) {
+        checkFloat(float_check, value);
+    }
+    for (double value : halfwayCases<double>(random, 30000U, 1ULL << 48)) {
+        checkDouble(double_check, value);
+    }
+
+    // every Q15, and for every fixed-point format its edges and the exact halfway cases of its last decimal, an odd
+    // multiple of 2^(frac_bits - decimals - 1), and their neighbours
+    for (int32_t raw = INT16_MIN; raw <= INT16_MAX; raw++) {
+        checkFixed(q15_check, LogFormatter::q15((int16_t)raw));
+    }
+    for (int32_t raw : {INT32_MIN, INT32_MIN + 1, -(1 << 30), -1, 0, 1, 1 << 30, INT32_MAX - 1, INT32_MAX}) {
+        checkFixed(q31_check, LogFormatter::q31(raw));
+    }
+    checkFixed(fixed_check, LogFormatter::fixed<0>(INT32_MIN));
+    checkFixed(fixed_check, LogFormatter::fixed<8>(-384));
+    checkFixed(fixed_check, LogFormatter::fixed<24>(INT32_MAX));
+    for (uint8_t frac_bits = 0U; frac_bits <= 31U; frac_bits++) {
+        for (int32_t raw : {INT32_MIN, INT32_MIN + 1, -1, 0, 1, INT32_MAX - 1, INT32_MAX}) {
+            checkFixed(fixed_check, LogFixed{raw, frac_bits});
+        }
+        int32_t shift = (int32_t)frac_bits - (int32_t)fixedDecimals(frac_bits) - 1;
+        for (size_t i = 0; shift >= 0 && i < 10000U; i++) {
+            int64_t tie = (int64_t)(2U * (random() % (1U << (30 - shift))) + 1U) << shift;
+            tie *= random() & 1U ? -1 : 1;
+            for (int64_t raw : {tie - 1, tie, tie + 1}) {
+                if (raw >= INT32_MIN && raw <= INT32_MAX) {
+                    checkFixed(frac_bits == 31U ? q31_check : fixed_check, LogFixed{(int32_t)raw, frac_bits});
+                }
+            }
+        }
+    }
+
+    // random values: all bit patterns, all digit counts and sensor-like ranges
+    std::uniform_real_distribution<double> sensor(-2000.0, 2000.0), small(-0.01, 0.01);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t bits = random();
+        uint32_t digits = (uint32_t)(bits >> 59) % 10U;  // up to 10^digits
+        uint32_t scale = 1U;
+        for (uint32_t d = 0; d < digits; d++) {
+            scale *= 10U;
+        }
+        checkSigned(signed_check, (int32_t)bits);
+        checkSigned(signed_check, (int32_t)((uint32_t)bits % scale) * (bits & (1ULL << 40) ? -1 : 1));
+        checkUnsigned(unsigned_check, (uint32_t)(bits >> 32));
+        checkUnsigned(unsigned_check, (uint32_t)bits % scale);
+
+        float  any_float, scaled_float = (float)ldexp((double)(int32_t)bits, -(int)(bits >> 58));
+        double any_double, scaled_double = ldexp((double)(int64_t)bits, -(int)(bits >> 57));
+        uint32_t float_bits = (uint32_t)(bits >> 32);
+        memcpy(&any_float, &float_bits, sizeof(any_float));
+        memcpy(&any_double, &bits, sizeof(any_double));
+        checkFloat(float_check, any_float);
+        checkFloat(float_check, scaled_float);
+        checkFloat(float_check, (float)sensor(random));
+        checkFloat(float_check, (float)small(random));
+        checkDouble(double_check, any_double);
+        checkDouble(double_check, scaled_double);
+        checkDouble(double_check, sensor(random));
+        checkFixed(q31_check, LogFormatter::q31((int32_t)bits));
+        checkFixed(fixed_check, LogFixed{(int32_t)(bits >> 32), (uint8_t)(bits % 32U)});
+    }
+
+    size_t mismatches = 0U;
+    for (const Check* check :
+         {&signed_check, &unsigned_check, &float_check, &double_check, &q15_check, &q31_check, &fixed_check}) {
+        check->report();
+        mismatches += check->m_mismatches;
+    }
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,162 @@
+/**
+ * @file power_model.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Simulate the energy per logged KB of a duty-cycled device, spinning, sleeping or in Stop mode between records
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -I. -o power_model bench/power_model.cpp log_format.cpp logger_sinks.cpp
+        (logger.cpp is included, for the logger of the simulated UART)
+Usage:  power_model [records/s] [records per wake-up] [baud] [seconds]
+
+The real logger runs against a UART-DMA simulated on a virtual clock: a region of n bytes completes n * 10 / baud
+seconds after it's started. The application wakes up [records/s] / [records per wake-up] times per second and logs a
+burst of records. The CPU time of a record and of a DMA interrupt, and the currents, are the parameters below, typical
+of an STM32F407 at 168 MHz and 3.3 V; change them for another part. Three main loops are compared:
+  spin    logger.process() in a tight loop, the core never sleeps
+  sleep   logger.sleep(), WFI whenever canSleep(), the DMA drains the buffer meanwhile
+  stop    as sleep, plus the Stop mode when isIdle() until the next wake-up, paying the wake-up time at run current
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "logger.cpp"
+
+static constexpr double CPU_HZ = 168e6;
+static constexpr double CYCLES_PER_RECORD = 1500.0;  // format and enqueue a short record
+static constexpr double CYCLES_PER_IRQ = 250.0;      // DMA completion, HAL handler and the next region
+static constexpr double RUN_MA = 40.0;               // running from flash with the UART and the DMA clocked
+static constexpr double SLEEP_MA = 12.0;             // WFI, the UART and the DMA running
+static constexpr double STOP_MA = 0.3;               // Stop mode, low-power regulator
+static constexpr double STOP_WAKEUP_S = 20e-6;       // Stop exit and clock restart, at run current
+static constexpr double VOLTS = 3.3;
+
+static double now = 0.0;  // the virtual clock, in seconds
+
+/**
+ * @brief A UART-DMA on the virtual clock, the completion is delivered by the simulation loop
+ */
+struct SimUartSink {
+    void init(double baud) {
+        m_baud = baud;
+    }
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+    bool transmit(const volatile char*, uint16_t length) {
+        m_done = now + length * 10.0 / m_baud;
+        m_busy = true;
+        m_bytes += length;
+        return false;
+    }
+    void poll() {}
+
+    void complete() {
+        m_busy = false;
+        m_completed(m_context);
+    }
+
+    double m_baud;
+    double m_done = 0.0;
+    bool   m_busy = false;
+    double m_bytes = 0.0;
+    void (*m_completed)(void*);
+    void* m_context;
+};
+
+template class BasicLogger<SimUartSink>;
+
+enum class Mode { SPIN, SLEEP, STOP };
+
+struct Result {
+    double bytes, joules, active_s, sleep_s, stop_s;
+    uint16_t missed;
+};
+
+static Result simulate(Mode mode, double rate, uint32_t burst, double baud, double seconds) {
+    BasicLogger<SimUartSink> sim_logger;
+    sim_logger.init(baud);
+    SimUartSink& uart = sim_logger.getSink();
+
+    now = 0.0;
+    double   period = burst / rate, next_wake = 0.0;
+    double   active = 0.0, asleep = 0.0, stopped = 0.0;
+    uint32_t sequence = 0U;
+    while (now < seconds) {
+        bool wake = !uart.m_busy || next_wake <= uart.m_done;
+        double event = wake ? next_wake : uart.m_done;
+
+        // the gap until the next event
+        double gap = event > now ? event - now : 0.0;
+        if (mode == Mode::SPIN || !sim_logger.canSleep()) {
+            active += gap;
+        } else if (mode == Mode::STOP && wake && sim_logger.isIdle() && gap > STOP_WAKEUP_S) {
+            stopped += gap - STOP_WAKEUP_S;
+            active += STOP_WAKEUP_S;
+        } else {
+            asleep += gap;
+        }
+        now = event;
+
+        double cycles;
+        if (wake) {
+            for (uint32_t i = 0; i < burst; i++) {
+                sim_logger.logln("sensor ", (uint8_t)(i & 7U), ": value=", sequence++);
+            }
+            cycles = burst * CYCLES_PER_RECORD;
+            next_wake += period;
+        } else {
+            uart.complete();
+            cycles = CYCLES_PER_IRQ;
+        }
+        active += cycles / CPU_HZ;
+        now += cycles / CPU_HZ;
+        sim_logger.process();
+    }
+
+    Result result;
+    result.bytes = uart.m_bytes;
+    result.active_s = active;
+    result.sleep_s = asleep;
+    result.stop_s = stopped;
+    result.joules = (active * RUN_MA + asleep * SLEEP_MA + stopped * STOP_MA) * 1e-3 * VOLTS;
+    result.missed = sim_logger.getMissedCount();
+    return result;
+}
+
+int main(int argc, char** argv) {
+    double   rate = argc > 1 ? atof(argv[1]) : 100.0;
+    uint32_t burst = argc > 2 ? (uint32_t)atoi(argv[2]) : 10U;
+    double   baud = argc > 3 ? atof(argv[3]) : 115200.0;
+    double   seconds = argc > 4 ? atof(argv[4]) : 60.0;
+
+    printf("%.0f records/s in bursts of %u, %.0f baud, %.0f s\n", rate, burst, baud, seconds);
+    printf("mode   avg mA   mJ/KB   run %%  sleep %%  stop %%  missed\n");
+    const char* names[] = {"spin", "sleep", "stop"};
+    Mode        modes[] = {Mode::SPIN, Mode::SLEEP, Mode::STOP};
+    for (int m = 0; m < 3; m++) {
+        Result r = simulate(modes[m], rate, burst, baud, seconds);
+        double total = r.active_s + r.sleep_s + r.stop_s;
+        printf("%-5s  %6.2f  %6.3f  %5.1f  %7.1f  %6.1f  %6u\n", names[m], r.joules / total / VOLTS * 1e3,
+               r.joules * 1e3 / (r.bytes / 1024.0), 100.0 * r.active_s / total, 100.0 * r.sleep_s / total,
+               100.0 * r.stop_s / total, r.missed);
+    }
+    return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file pty_device.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief A simulated device streaming the logger output into a pty at a given baud rate, to test tools/logtail
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -DLOGGER_TIMESTAMPS=1 -I. -o pty_device bench/pty_device.cpp log_format.cpp
+        logger_sinks.cpp (logger.cpp is included, for the logger of the simulated UART)
+Usage:  pty_device [records] [baud] [reference] &     prints the pty to open, then waits a second
+        logtail -d /dev/pts/N -o tail.log -q
+        logdecode reference | cmp - tail.log
+
+The real logger sends to a simulated UART: every region is written to the master side of a pty, and the UART is busy
+for 10 bits per byte at [baud] (4000000 by default), so the stream has the timing of the real link. The records have
+the three levels and a few tags, with a metrics-like frame every 64 records. Everything sent is also written to
+[reference], the capture a logic analyzer would see. A write that blocks because the reader is behind stalls the
+device, the total and the longest stall are reported: a reader keeping up at line rate leaves both near zero.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#include "logger.cpp"
+
+static uint64_t nowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+static void sleepUntil(uint64_t ns) {
+    timespec until = {(time_t)(ns / 1000000000U), (long)(ns % 1000000000U)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr)) {
+    }
+}
+
+/**
+ * @brief A UART at [baud] writing to a pty, a region is over when its last bit would be on the wire
+ */
+struct PtyUartSink {
+    void init(int fd, uint32_t baud, FILE* reference) {
+        m_fd = fd;
+        m_ns_per_byte = 10e9 / baud;
+        m_reference = reference;
+    }
+    void bind(void (*)(void*), void*, const volatile char*, uint16_t) {}
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        const char* pos = (const char*)data;
+        fwrite(pos, 1, length, m_reference);
+        m_bytes += length;
+
+        // the region takes its time on the wire after the previous one, or from now if the link has been idle for
+        // longer than the oversleep of the timer
+        uint64_t start = nowNs();
+        m_wire_ns = m_wire_ns + 1000000U > start ? m_wire_ns : start;
+        m_wire_ns += (uint64_t)(length * m_ns_per_byte);
+        while (length) {
+            uint64_t before = nowNs();
+            ssize_t  written = write(m_fd, pos, length);
+            uint64_t blocked = nowNs() - before;
+            if (blocked > 1000000U) {  // a write to a pty returns in microseconds unless its buffer is full
+                m_stall_ns += blocked;
+                m_longest_stall_ns = blocked > m_longest_stall_ns ? blocked : m_longest_stall_ns;
+            }
+            if (written <= 0) {
+                break;
+            }
+            pos += written;
+            length -= (uint16_t)written;
+        }
+        if (m_wire_ns > nowNs() + 1000000U) {
+            sleepUntil(m_wire_ns);  // in steps of a millisecond, shorter sleeps would slow the link down
+        }
+        return true;
+    }
+    void poll() {}
+
+    int      m_fd = -1;
+    double   m_ns_per_byte = 0.0;
+    FILE*    m_reference = nullptr;
+    uint64_t m_wire_ns = 0U;
+    uint64_t m_bytes = 0U;
+    uint64_t m_stall_ns = 0U;
+    uint64_t m_longest_stall_ns = 0U;
+};
+
+template class BasicLogger<PtyUartSink>;
+
+int main(int argc, char** argv) {
+    uint32_t    records = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : 1000000U;
+    uint32_t    baud = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 4000000U;
+    const char* reference_path = argc > 3 ? argv[3] : "/dev/null";
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master)) {
+        perror("posix_openpt");
+        return 1;
+    }
+    // the slave side stays open, so the reader can come and go, and is raw like a serial port
+    int            slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    struct termios tty;
+    if (slave < 0 || tcgetattr(slave, &tty)) {
+        perror(ptsname(master));
+        return 1;
+    }
+    cfmakeraw(&tty);
+    tcsetattr(slave, TCSANOW, &tty);
+    FILE* reference = fopen(reference_path, "wb");
+    if (!reference) {
+        perror(reference_path);
+        return 1;
+    }
+    printf("%s\n", ptsname(master));
+    fflush(stdout);
+    sleep(1);
+
+    static BasicLogger<PtyUartSink> device;
+    device.init(master, baud, reference);
+    static const char* const tags[] = {"imu", "gps", "motor", "radio"};
+    uint64_t                 start = nowNs();
+    for (uint32_t i = 0; i < records; i++) {
+        const char* tag = tags[(i * 2654435761U) >> 30];
+        uint32_t    kind = (i * 40503U) % 100U;
+        if (kind < 2U) {
+            device.error(tag, ": seq=", i, " fault");
+        } else if (kind < 10U) {
+            device.warning(tag, ": seq=", i, " late by ", kind, "ms");
+        } else if (kind < 95U) {
+            device.info(tag, ": seq=", i, " value=", (float)i * 0.25f);
+        } else {
+            device.logln("seq=", i, " raw");
+        }
+        if ((i & 63U) == 63U) {
+            uint8_t frame[] = {LOG_FRAME_METRICS, (uint8_t)i, (uint8_t)(i >> 8), 0U, 2U, 0U, 0x81U, 0x01U};
+            device.enqueueFrame(frame, sizeof(frame));
+        }
+        device.process();
+    }
+    double seconds = (double)(nowNs() - start) * 1e-9;
+
+    // let the reader take what's still in the pty, closing the master would drop it
+    int waiting;
+    while (!ioctl(slave, FIONREAD, &waiting) && waiting > 0) {
+        usleep(10000);
+    }
+    usleep(100000);
+
+    PtyUartSink& uart = device.getSink();
+    fclose(reference);
+    close(slave);
+    close(master);
+    fprintf(stderr,
+            "%u records, %llu bytes in %.2f s: %.0f kB/s, %.1f%% of %u baud\n"
+            "stalled by the reader %.1f ms in total, %.1f ms at most, %u missed\n",
+            records, (unsigned long long)uart.m_bytes, seconds, uart.m_bytes / seconds / 1e3,
+            100.0 * uart.m_bytes * 10.0 / seconds / baud, baud, uart.m_stall_ns * 1e-6,
+            uart.m_longest_stall_ns * 1e-6, device.getMissedCount());
+    return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file rtt_bench.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Run a logger with the RttSink in a shared memory file, drained by tools/rtt_reader
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -DLOGGER_SINK=RttSink -I. -o rtt_bench bench/rtt_bench.cpp logger.cpp
+        log_format.cpp logger_sinks.cpp
+Usage:  rtt_bench /dev/shm/logger_rtt [records] &
+        rtt_reader -f /dev/shm/logger_rtt > capture.txt
+
+The logger is placed in the shared memory file, so the reader sees the control block and the send buffer exactly as a
+debug probe sees the RAM of the device. The records are "rtt <n>\n", a record is retried while the buffer is full, so
+the capture must hold every number in order. Reports the record rate through the reader.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <new>
+
+#include "logger.h"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s shm_file [records]\n", argv[0]);
+        return 1;
+    }
+    uint32_t records = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 0) : 100000U;
+
+    int fd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(Logger))) {
+        fprintf(stderr, "cannot create %s\n", argv[1]);
+        return 1;
+    }
+    void* memory = mmap(nullptr, sizeof(Logger), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        fprintf(stderr, "cannot map %s\n", argv[1]);
+        return 1;
+    }
+    Logger* rtt_logger = new (memory) Logger;
+    rtt_logger->init();
+
+    timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32_t retries = 0U;
+    for (uint32_t i = 0; i < records; i++) {
+        while (rtt_logger->getAvailableSpace() < 16U) {  // wait for the reader instead of missing the record
+            rtt_logger->process();
+            ++retries;
+        }
+        rtt_logger->logln("rtt ", i);
+    }
+    while (rtt_logger->getAvailableSpace() != Logger::SEND_BUFFER_SIZE - 1U) {  // until everything is read
+        rtt_logger->process();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) * 1e-9;
+    fprintf(stderr, "%u records in %.3f s, %.0f records/s, %u polls waiting for the reader, %u missed\n", records,
+            seconds, records / seconds, retries, rtt_logger->getMissedCount());
+    return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file sink_bench.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Benchmark the ring and the formatters of the logger on a PC
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -I. -o sink_bench bench/sink_bench.cpp logger.cpp log_format.cpp logger_sinks.cpp
+        add -DLOGGER_SINK=RamSink to measure without the write() system calls, "-DLOGGER_SINK=CrcSink<RamSink>" for
+        the cost of the CRC per region
+Usage:  sink_bench [records] [output] [consumers]
+
+The same logger code as on the target, with the FileSink writing to [output] (/dev/null by default) or a RamSink.
+Reports the cost of formatting alone, then of formatting plus the ring plus the sink, per record. With [consumers] 1
+or 2, a non-lossy and then a lossy consumer read the same data after every record, like a flash spill and a RAM
+snapshot would.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "logger.h"
+
+static char ram_buffer[1U << 16];
+
+template <typename L>
+static void initSink(L& logger_, RamSink*, const char*) {
+    logger_.init(ram_buffer, (uint32_t)sizeof(ram_buffer));
+}
+
+template <typename L>
+static void initSink(L& logger_, FileSink*, const char* output) {
+    int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s\n", output);
+        exit(1);
+    }
+    logger_.init(fd);
+}
+
+template <typename L, typename Inner>
+static void initSink(L& logger_, CrcSink<Inner>*, const char* output) {
+    initSink(logger_, (Inner*)nullptr, output);  // the arguments of the inner sink
+}
+
+static uint64_t nowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+    uint32_t    records = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 0) : 1000000U;
+    const char* output = argc > 2 ? argv[2] : "/dev/null";
+    uint8_t     consumers = argc > 3 ? (uint8_t)atoi(argv[3]) : 0U;
+    initSink(logger, (LOGGER_SINK*)nullptr, output);
+
+    uint8_t ids[2];
+    for (uint8_t i = 0; i < consumers && i < 2U; i++) {
+        ids[i] = logger.addConsumer(i == 1U);
+    }
+    char     consumer_buffer[Logger::SEND_BUFFER_SIZE];
+    uint64_t consumed = 0U;
+
+    // formatting only
+    char     line_buffer[Logger::SINGLE_MSG_SIZE];
+    uint64_t bytes = 0U, start = nowNs();
+    for (uint32_t i = 0; i < records; i++) {
+        bytes += Logger::formatMulti(line_buffer, "sensor ", (uint8_t)(i & 7U), ": raw=", (int32_t)(i * 7U - 5000U),
+                                     " value=", (float)i * 0.125f);
+    }
+    uint64_t format_ns = nowNs() - start;
+
+    // formatting, enqueue and sink
+    start = nowNs();
+    for (uint32_t i = 0; i < records; i++) {
+        logger.info("sensor ", (uint8_t)(i & 7U), ": raw=", (int32_t)(i * 7U - 5000U), " value=", (float)i * 0.125f);
+        for (uint8_t c = 0; c < consumers && c < 2U; c++) {
+            consumed += logger.consume(ids[c], consumer_buffer, sizeof(consumer_buffer));
+        }
+    }
+    uint64_t log_ns = nowNs() - start;
+
+    printf("records:          %u (%llu bytes formatted)\n", records, (unsigned long long)bytes);
+    printf("format only:      %.1f ns/record\n", (double)format_ns / records);
+    printf("format+ring+sink: %.1f ns/record, %.1f MB/s\n", (double)log_ns / records,
+           (double)bytes * 1000.0 / (double)log_ns);
+    printf("missed:           %u\n", logger.getMissedCount());
+    if (consumers) {
+        printf("consumers:        %u, %llu bytes consumed, %u skipped by the lossy one\n", consumers,
+               (unsigned long long)consumed, consumers > 1U ? logger.getSkippedCount(ids[1]) : 0U);
+    }
+    return 0;
+}
@@ -0,0 +1,411 @@
+/**
+ * @file workload_bench.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief End-to-end benchmark of the logger with synthetic workloads from the main loop and nested ISRs
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++14 -O2 -DLOGGER_HOST -DLOGGER_TIMESTAMPS=1 -I. -o workload_bench bench/workload_bench.cpp
+        log_format.cpp logger_sinks.cpp -lrt (logger.cpp is included, for the logger of the simulated UART)
+Usage:  workload_bench [-b baud] [-t seconds] [-z sizes] [-m rate] [-i rate] [-I rate] [-B burst]
+        -z fixed:48 | uniform:24-160 | bimodal:32,200,0.1 (the large size for 10% of the records)
+
+The real logger runs on the host against a UART-DMA simulated in real time: a region of n bytes is on the wire for
+n * 10 bits at [baud] (2000000 by default), then its completion interrupt chains the next one. Three producers log
+records of the [sizes] (uniform:24-120): the main loop at [-m] records/s (1500), a low priority ISR at [-i] (500)
+and a high priority ISR at [-I] (200), each in events of [burst] records back to back (1).
+
+The interrupts are POSIX timer signals, masked like the NVIC priorities: the high ISR preempts the DMA completion,
+which preempts the low ISR, which preempts the main loop, at any instruction, so the records are really enqueued
+concurrently through the LDREX/STREX emulation of logger_port.h.
+
+Reported per producer: the records offered, delivered and dropped (the send buffer was full), the latency from the
+timestamp of a record to its last byte on the wire, and the TSC cycles of the log call. A call preempted by an ISR
+includes the time of the ISR, the median is not affected. A call of the main loop finding the link idle includes
+starting the DMA, a timer_settime() here. The records of each producer are told apart by the sink
+from their first letter after the "[timestamp] " prefix.
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "logger.cpp"
+
+#if !LOGGER_TIMESTAMPS
+#error "build with -DLOGGER_TIMESTAMPS=1, the latency is measured from the timestamps of the records"
+#endif
+
+static uint64_t nowNs() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
+}
+
+static inline uint64_t cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return nowNs();
+#endif
+}
+
+/**
+ * @brief A log-linear histogram, 16 buckets per power of two (6% resolution), without allocation for the ISRs
+ */
+struct Histogram {
+    void add(uint64_t value) {
+        m_counts[bucket(value)]++;
+        m_total++;
+        m_sum += value;
+        m_max = value > m_max ? value : m_max;
+    }
+
+    /**
+     * @brief The lower bound of the bucket holding the [fraction] quantile
+     */
+    uint64_t quantile(double fraction) const {
+        uint64_t rank = (uint64_t)(fraction * (double)m_total), seen = 0U;
+        for (unsigned i = 0; i < BUCKETS; i++) {
+            seen += m_counts[i];
+            if (seen > rank) {
+                return i < 16U ? i : (uint64_t)(16U + i % 16U) << (i / 16U - 1U);
+            }
+        }
+        return m_max;
+    }
+
+    double mean() const {
+        return m_total ? (double)m_sum / (double)m_total : 0.0;
+    }
+
+    static unsigned bucket(uint64_t value) {
+        if (value < 16U) {
+            return (unsigned)value;
+        }
+        unsigned exponent = 63U - (unsigned)__builtin_clzll(value);
+        return (exponent - 3U) * 16U + (unsigned)((value >> (exponent - 4U)) & 15U);
+    }
+
+    static constexpr unsigned BUCKETS = 61U * 16U;
+    uint64_t                  m_counts[BUCKETS] = {};
+    uint64_t                  m_total = 0U;
+    uint64_t                  m_sum = 0U;
+    uint64_t                  m_max = 0U;
+};
+
+enum Producer : uint8_t { MAIN_LOOP, LOW_ISR, HIGH_ISR, PRODUCERS };
+
+static const char  PRODUCER_LETTERS[PRODUCERS] = {'m', 'l', 'h'};
+static const char* PRODUCER_NAMES[PRODUCERS] = {"main loop", "low ISR", "high ISR"};
+
+/**
+ * @brief A UART-DMA in real time: the completion interrupt is a timer signal at the end of the region on the wire
+ */
+struct SimUartSink {
+    void init(timer_t timer, uint32_t baud) {
+        m_timer = timer;
+        m_ns_per_byte = 10e9 / baud;
+    }
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        m_region = (const char*)data;
+        m_length = length;
+        m_start = nowNs();
+        uint64_t          done = m_start + (uint64_t)(length * m_ns_per_byte);
+        struct itimerspec when = {{0, 0}, {(time_t)(done / 1000000000U), (long)(done % 1000000000U)}};
+        timer_settime(m_timer, TIMER_ABSTIME, &when, nullptr);
+        return false;
+    }
+    void poll() {}
+
+    /**
+     * @brief The completion interrupt: account for the records of the region, then release it
+     */
+    void complete() {
+        for (uint16_t i = 0; i < m_length; i++) {
+            parse(m_region[i], m_start + (uint64_t)((i + 1U) * m_ns_per_byte));
+        }
+        m_bytes += m_length;
+        m_completed(m_context);
+    }
+
+    /**
+     * @brief "[timestamp] x..." then '\n', a region can end anywhere in a record
+     */
+    void parse(char c, uint64_t on_wire) {
+        if (c == '\n') {
+            if (m_producer < PRODUCERS) {
+                m_delivered[m_producer]++;
+                m_latency[m_producer].add((uint32_t)((uint32_t)on_wire - m_stamp));
+            }
+            m_field = 0U;
+            m_stamp = 0U;
+            m_producer = PRODUCERS;
+        } else if (m_field == 0U) {
+            m_field = c == '[' ? 1U : 3U;
+        } else if (m_field == 1U) {
+            if (c >= '0' && c <= '9') {
+                m_stamp = m_stamp * 10U + (uint32_t)(c - '0');
+            } else {
+                m_field = 2U;  // the space after ']'
+            }
+        } else if (m_field == 2U) {
+            m_field = c == ' ' ? 2U : 3U;
+            for (uint8_t p = 0; p < PRODUCERS && c != ' '; p++) {
+                m_producer = c == PRODUCER_LETTERS[p] ? p : m_producer;
+            }
+        }
+    }
+
+    timer_t     m_timer;
+    double      m_ns_per_byte = 0.0;
+    const char* m_region = nullptr;
+    uint16_t    m_length = 0U;
+    uint64_t    m_start = 0U;
+    uint64_t    m_bytes = 0U;
+    uint8_t     m_field = 0U;  // 0 at a record start, 1 in the timestamp, 2 before the text, 3 in the text
+    uint32_t    m_stamp = 0U;
+    uint8_t     m_producer = PRODUCERS;
+    uint64_t    m_delivered[PRODUCERS] = {};
+    Histogram   m_latency[PRODUCERS];
+    void (*m_completed)(void*);
+    void* m_context;
+};
+
+template class BasicLogger<SimUartSink>;
+
+/**
+ * @brief The sizes of the records, [large] for [large_share] of them
+ */
+struct SizeDistribution {
+    bool parse(const char* text) {
+        if (sscanf(text, "fixed:%u", &m_low) == 1) {
+            m_high = m_low;
+        } else if (sscanf(text, "uniform:%u-%u", &m_low, &m_high) == 2) {
+        } else if (sscanf(text, "bimodal:%u,%u,%lf", &m_low, &m_large, &m_large_share) == 3) {
+            m_high = m_low;
+        } else {
+            return false;
+        }
+        return m_low >= MIN_SIZE && m_high >= m_low && m_high <= MAX_SIZE && (!m_large_share || m_large <= MAX_SIZE);
+    }
+
+    uint32_t next(uint32_t& random) const {
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        if (m_large_share > 0.0 && (random >> 8) < (uint32_t)(m_large_share * (1U << 24))) {
+            return m_large;
+        }
+        return m_low + random % (m_high - m_low + 1U);
+    }
+
+    static constexpr uint32_t MIN_SIZE = 24U;   // the timestamp, the letter and the sequence number
+    static constexpr uint32_t MAX_SIZE = 240U;  // within SINGLE_MSG_SIZE
+    uint32_t                  m_low = 24U;
+    uint32_t                  m_high = 120U;
+    uint32_t                  m_large = 0U;
+    double                    m_large_share = 0.0;
+};
+
+static BasicLogger<SimUartSink> device;
+static SizeDistribution         sizes;
+static uint32_t                 burst = 1U;
+static char                     padding[SizeDistribution::MAX_SIZE + 1U];
+
+/**
+ * @brief The state of a producer, each one is only touched by its own context
+ */
+struct Source {
+    uint64_t  m_offered = 0U;
+    uint32_t  m_random = 0U;
+    Histogram m_cycles;
+};
+
+static Source sources[PRODUCERS];
+
+/**
+ * @brief Log one event of [burst] records, padded to their sizes: "[timestamp] m 123 0.25 xxxx\n"
+ */
+static void produce(Producer producer) {
+    Source& source = sources[producer];
+    char    letter[2] = {PRODUCER_LETTERS[producer], '\0'};
+    for (uint32_t i = 0; i < burst; i++) {
+        uint32_t size = sizes.next(source.m_random);
+        uint32_t seq = (uint32_t)source.m_offered;
+        // 13 bytes of timestamp and 3 + 10 + 5 of fields on average, the rest is padding
+        uint32_t    fixed = 13U + 3U + 10U + 5U;
+        const char* pad = padding + SizeDistribution::MAX_SIZE - (size > fixed ? size - fixed : 0U);
+        uint64_t    start = cycles();
+        device.logln(letter, " ", seq, " ", (float)(seq & 1023U) * 0.25f, " ", pad);
+        source.m_cycles.add(cycles() - start);
+        source.m_offered++;
+    }
+}
+
+static void onLowIsr(int) {
+    log_host_ipsr = 1U;
+    produce(LOW_ISR);
+    __CLREX();
+    log_host_ipsr = 0U;
+}
+
+static void onHighIsr(int) {
+    uint32_t ipsr = log_host_ipsr;  // it may preempt another ISR
+    log_host_ipsr = 2U;
+    produce(HIGH_ISR);
+    __CLREX();
+    log_host_ipsr = ipsr;
+}
+
+static void onDmaComplete(int) {
+    uint32_t ipsr = log_host_ipsr;
+    log_host_ipsr = 3U;
+    device.getSink().complete();
+    __CLREX();
+    log_host_ipsr = ipsr;
+}
+
+/**
+ * @brief A handler masking the signals of lower priority, and its timer
+ */
+static timer_t startInterrupt(int signal_number, void (*handler)(int), const int* masked, size_t masked_count) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < masked_count; i++) {
+        sigaddset(&action.sa_mask, masked[i]);
+    }
+    action.sa_flags = SA_RESTART;
+    sigaction(signal_number, &action, nullptr);
+
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = signal_number;
+    timer_t timer;
+    if (timer_create(CLOCK_MONOTONIC, &event, &timer)) {
+        perror("timer_create");
+        exit(1);
+    }
+    return timer;
+}
+
+static void setPeriod(timer_t timer, double rate) {
+    uint64_t          ns = rate > 0.0 ? (uint64_t)(1e9 * burst / rate) : 0U;
+    struct itimerspec period = {{(time_t)(ns / 1000000000U), (long)(ns % 1000000000U)},
+                                {(time_t)(ns / 1000000000U), (long)(ns % 1000000000U)}};
+    timer_settime(timer, 0, &period, nullptr);
+}
+
+int main(int argc, char** argv) {
+    uint32_t    baud = 2000000U;
+    double      seconds = 5.0, rates[PRODUCERS] = {1500.0, 500.0, 200.0};
+    const char* size_text = "uniform:24-120";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-b")) {
+            baud = (uint32_t)strtoul(argv[i + 1], nullptr, 0);
+        } else if (!strcmp(argv[i], "-t")) {
+            seconds = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-z")) {
+            size_text = argv[i + 1];
+        } else if (!strcmp(argv[i], "-m")) {
+            rates[MAIN_LOOP] = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-i")) {
+            rates[LOW_ISR] = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-I")) {
+            rates[HIGH_ISR] = atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-B")) {
+            burst = (uint32_t)strtoul(argv[i + 1], nullptr, 0);
+        }
+    }
+    if (!sizes.parse(size_text) || !baud || !burst) {
+        fprintf(stderr, "usage: workload_bench [-b baud] [-t seconds] [-z fixed:N|uniform:A-B|bimodal:N,LARGE,SHARE] "
+                        "[-m rate] [-i rate] [-I rate] [-B burst], sizes from %u to %u\n",
+                SizeDistribution::MIN_SIZE, SizeDistribution::MAX_SIZE);
+        return 1;
+    }
+    memset(padding, 'x', SizeDistribution::MAX_SIZE);
+    for (uint8_t p = 0; p < PRODUCERS; p++) {
+        sources[p].m_random = 0x9E3779B9U * (p + 1U);
+    }
+
+    // priorities: high ISR > DMA completion > low ISR > main loop
+    const int low = SIGRTMIN + 1, dma = SIGRTMIN, high = SIGRTMIN + 2;
+    const int below_high[] = {dma, low}, below_dma[] = {low};
+    timer_t   dma_timer = startInterrupt(dma, onDmaComplete, below_dma, 1U);
+    timer_t   low_timer = startInterrupt(low, onLowIsr, nullptr, 0U);
+    timer_t   high_timer = startInterrupt(high, onHighIsr, below_high, 2U);
+    device.init(dma_timer, baud);
+
+    uint64_t start_cycles = cycles(), start = nowNs(), end = start + (uint64_t)(seconds * 1e9);
+    setPeriod(low_timer, rates[LOW_ISR]);
+    setPeriod(high_timer, rates[HIGH_ISR]);
+    uint64_t next_event = start, event_ns = rates[MAIN_LOOP] > 0.0 ? (uint64_t)(1e9 * burst / rates[MAIN_LOOP]) : 0U;
+    uint64_t now;
+    while ((now = nowNs()) < end) {
+        if (event_ns && now >= next_event) {
+            produce(MAIN_LOOP);
+            next_event += event_ns;
+        }
+        device.process();
+    }
+    setPeriod(low_timer, 0.0);
+    setPeriod(high_timer, 0.0);
+    double elapsed = (double)(nowNs() - start) * 1e-9;
+    double ns_per_cycle = (double)(nowNs() - start) / (double)(cycles() - start_cycles);
+    while (!device.isIdle()) {
+        device.process();  // the DMA drains what was accepted
+    }
+    timer_delete(dma_timer);
+
+    SimUartSink& uart = device.getSink();
+    uint64_t     offered = 0U, delivered = 0U;
+    printf("%u baud, %.1f s, sizes %s, bursts of %u, send buffer %u bytes\n", baud, elapsed, size_text, burst,
+           BasicLogger<SimUartSink>::SEND_BUFFER_SIZE);
+    printf("producer    rate/s   offered  delivered  dropped %%  latency ms p50    p99  p99.9    max  cycles p50  p99"
+           "   mean\n");
+    for (uint8_t p = 0; p < PRODUCERS; p++) {
+        const Source&    source = sources[p];
+        const Histogram& latency = uart.m_latency[p];
+        offered += source.m_offered;
+        delivered += uart.m_delivered[p];
+        printf("%-9s  %7.0f  %8llu  %9llu  %9.2f  %13.2f  %5.2f  %5.2f  %5.2f  %10llu  %5llu  %5.0f\n", PRODUCER_NAMES[p],
+               rates[p], (unsigned long long)source.m_offered, (unsigned long long)uart.m_delivered[p],
+               source.m_offered ? 100.0 * (double)(source.m_offered - uart.m_delivered[p]) / source.m_offered : 0.0,
+               latency.quantile(0.5) * 1e-6, latency.quantile(0.99) * 1e-6, latency.quantile(0.999) * 1e-6,
+               latency.m_max * 1e-6, (unsigned long long)source.m_cycles.quantile(0.5),
+               (unsigned long long)source.m_cycles.quantile(0.99), source.m_cycles.mean());
+    }
+    printf("%llu records/s delivered of %llu offered, %.2f%% dropped, %.1f bytes per record, %.1f%% of the link\n",
+           (unsigned long long)(delivered / elapsed), (unsigned long long)(offered / elapsed),
+           offered ? 100.0 * (double)(offered - delivered) / offered : 0.0,
+           delivered ? (double)uart.m_bytes / delivered : 0.0, 100.0 * uart.m_bytes * 10.0 / elapsed / baud);
+    printf("%.3f ns per TSC cycle\n", ns_per_cycle);
+    return 0;
+}
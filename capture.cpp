@@ -0,0 +1,179 @@
+/**
+ * @file capture.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Oscilloscope-style pre/post trigger capture on top of the UART-DMA logger
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "capture.h"
+
+/**
+ * @brief Clear the capture buffer and start recording
+ */
+void Capture::arm(uint16_t post_trigger_records) {
+    m_state = IDLE;
+    m_write_pos = 0U;
+    m_wrapped = false;
+    m_post_trigger_records = post_trigger_records;
+    m_state = ARMED;
+}
+
+/**
+ * @brief Mark the trigger position and open the post-trigger window
+ */
+void Capture::trigger() {
+    if (m_state != ARMED) {  // only the first trigger counts
+        return;
+    }
+    m_trigger_pos = m_write_pos;
+    m_post_remaining = m_post_trigger_records;
+    m_state = m_post_trigger_records ? TRIGGERED : FROZEN;
+}
+
+/**
+ * @brief Store a record into the capture buffer, overwriting the oldest ones
+ * @note This method will be called in both main thread and ISRs, so it has to be thread-safe
+ */
+void Capture::store(const char* str, uint16_t length) {
+
+    ATOMIC_INCH(m_store_guard);  // Start the store progress, process() waits for it before walking the buffer
+
+    bool accepted = m_state == ARMED;
+    if (m_state == TRIGGERED) {
+        // Take a slot of the post-trigger window atomically, the one taking the last slot freezes the capture
+        uint16_t remaining;
+        do {
+            remaining = __LDREXH(&m_post_remaining);
+            if (remaining == 0U) {
+                __CLREX();
+                break;
+            }
+        } while (__STREXH(remaining - 1U, &m_post_remaining));
+
+        if (remaining == 1U) {
+            m_state = FROZEN;
+        }
+        accepted = remaining != 0U;
+    }
+
+    if (accepted) {
+        uint16_t total_length = length + RECORD_OVERHEAD;
+        uint16_t write_pos;
+        do {
+            write_pos = __LDREXH(&m_write_pos);
+        } while (__STREXH(advancePos(write_pos, total_length), &m_write_pos));  // Reserve space atomically
+
+        if (write_pos + total_length >= CAPTURE_BUFFER_SIZE) {
+            m_wrapped = true;  // From now on the whole buffer holds valid data
+        }
+
+        char length_byte = (char)(length - 1U);
+        m_capture_buffer[write_pos] = length_byte;
+        write_pos = advancePos(write_pos);
+        for (uint16_t i = 0; i < length; i++) {
+            m_capture_buffer[write_pos] = str[i];
+            write_pos = advancePos(write_pos);
+        }
+        m_capture_buffer[write_pos] = length_byte;
+    }
+
+    ATOMIC_DECH(m_store_guard);  // Finish the store progress
+}
+
+/**
+ * @brief Walk the frozen buffer backward from the newest record to find the oldest intact one
+ */
+void Capture::locateOldest() {
+    uint16_t end = m_write_pos;
+    uint16_t valid = m_wrapped ? CAPTURE_BUFFER_SIZE : end;  // bytes holding records, older ones may be partial
+    uint16_t pos = end, used = 0U, count = 0U;
+
+    m_records_after_trigger = NO_TRIGGER;
+    while (used + RECORD_OVERHEAD <= valid) {
+        if (pos == m_trigger_pos && m_records_after_trigger == NO_TRIGGER) {
+            m_records_after_trigger = count;
+        }
+        uint16_t length = (uint8_t)m_capture_buffer[retreatPos(pos)] + 1U;
+        if (used + length + RECORD_OVERHEAD > valid) {
+            break;  // the beginning of this record has been overwritten
+        }
+        used += length + RECORD_OVERHEAD;
+        pos = retreatPos(pos, length + RECORD_OVERHEAD);
+        ++count;
+    }
+    if (pos == m_trigger_pos && m_records_after_trigger == NO_TRIGGER) {
+        m_records_after_trigger = count;
+    }
+
+    m_read_pos = pos;
+    m_record_count = count;
+    m_trigger_marked = false;
+}
+
+/**
+ * @brief Stream the frozen capture to the logger, one record at a time while there is room in the send buffer
+ */
+void Capture::process() {
+    char line_buffer[Logger::SINGLE_MSG_SIZE];
+
+    if (m_state == FROZEN && m_store_guard == 0U) {
+        uint16_t length = Logger::formatMulti(line_buffer, begin_str);
+        if (logger.getAvailableSpace() < length) {
+            return;
+        }
+        locateOldest();
+        logger.enqueue(line_buffer, length);
+        m_state = STREAMING;
+    }
+    if (m_state != STREAMING) {
+        return;
+    }
+
+    while (true) {
+        if (m_record_count == m_records_after_trigger && !m_trigger_marked) {
+            uint16_t length = Logger::formatMulti(line_buffer, trigger_str);
+            if (logger.getAvailableSpace() < length) {
+                return;  // try again in next entry
+            }
+            logger.enqueue(line_buffer, length);
+            m_trigger_marked = true;
+        }
+        if (m_record_count == 0U) {
+            break;
+        }
+
+        uint16_t length = (uint8_t)m_capture_buffer[m_read_pos] + 1U;
+        if (logger.getAvailableSpace() < length) {
+            return;  // try again in next entry
+        }
+        uint16_t read_pos = advancePos(m_read_pos);
+        for (uint16_t i = 0; i < length; i++) {
+            line_buffer[i] = m_capture_buffer[read_pos];
+            read_pos = advancePos(read_pos);
+        }
+        logger.enqueue(line_buffer, length);
+        m_read_pos = advancePos(read_pos);  // skip the length trailer
+        --m_record_count;
+    }
+
+    uint16_t length = Logger::formatMulti(line_buffer, end_str);
+    if (logger.getAvailableSpace() < length) {
+        return;
+    }
+    logger.enqueue(line_buffer, length);
+    m_state = IDLE;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file capture.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Oscilloscope-style pre/post trigger capture on top of the UART-DMA logger
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+Records passed to capture() are formatted like logger.logln() but kept in a circular pre-trigger buffer in RAM instead
+of being sent, the oldest records are overwritten silently. trigger() marks the event and lets a configurable number of
+post-trigger records in, then the buffer is frozen. process() streams the frozen block to the logger at leisure, only
+when the send buffer has room for the next record, so the capture never causes missed messages.
+
+Usage:
+Capture scope;
+scope.arm(100);                        // keep 100 records after the trigger
+scope.capture(adc_value, ',', speed);  // in the control loop or an ISR
+scope.trigger();                       // on the rare event, in any context
+scope.process();                       // in the main loop, next to logger.process()
+
+Output:
+Capture: begin
+...pre-trigger records...
+Capture: trigger
+...post-trigger records...
+Capture: end
+*/
+
+#include "logger.h"
+
+class Capture {
+
+   public:
+    enum State : uint8_t {
+        IDLE,       // not recording, capture() calls are discarded
+        ARMED,      // recording into the pre-trigger buffer
+        TRIGGERED,  // recording the post-trigger window
+        FROZEN,     // post-trigger window is complete, waiting for process() to stream it
+        STREAMING,  // process() is copying the records to the logger
+    };
+
+    /**
+     * @brief Clear the capture buffer and start recording
+     *
+     * @param post_trigger_records the number of records accepted after trigger()
+     * @note Should not be called while process() is streaming a previous capture
+     */
+    void arm(uint16_t post_trigger_records);
+
+    /**
+     * @brief Freeze the capture after the post-trigger window, can be called in ISRs
+     */
+    void trigger();
+
+    /**
+     * @brief Format and store a record into the capture buffer
+     */
+    template <typename... T>
+    void capture(T... args) {
+        char     line_buffer[Logger::SINGLE_MSG_SIZE];
+        uint16_t total_length = Logger::formatMulti(line_buffer, args...);
+        line_buffer[total_length++] = '\n';
+        assert_param(total_length <= Logger::SINGLE_MSG_SIZE);
+        store(line_buffer, total_length);
+    }
+
+    /**
+     * @brief Stream a frozen capture to the logger
+     * @note Need to poll it frequently, so put it into the main loop
+     */
+    void process();
+
+    /**
+     * @brief Get the state of the capture
+     */
+    State getState() {
+        return m_state;
+    }
+
+   private:
+    /**
+     * @brief Store a formatted record into the capture buffer
+     * @note This method will be called in both main thread and ISRs, so it has to be thread-safe
+     */
+    void store(const char* str, uint16_t length);
+
+    /**
+     * @brief Find the oldest intact record in the frozen buffer
+     */
+    void locateOldest();
+
+    /**
+     * @brief Advance pos in the capture buffer
+     */
+    static inline uint16_t advancePos(uint16_t pos, uint16_t step = 1) {
+        return (pos + step) % CAPTURE_BUFFER_SIZE;
+    }
+
+    /**
+     * @brief Move pos backward in the capture buffer
+     */
+    static inline uint16_t retreatPos(uint16_t pos, uint16_t step = 1) {
+        return (pos + CAPTURE_BUFFER_SIZE - step) % CAPTURE_BUFFER_SIZE;
+    }
+
+    static constexpr const char* begin_str = "Capture: begin\n";  // markers around the streamed block
+    static constexpr const char* trigger_str = "Capture: trigger\n";
+    static constexpr const char* end_str = "Capture: end\n";
+
+    // Each record is stored as [length - 1][payload][length - 1], so the buffer can be walked in both directions
+    static constexpr uint16_t RECORD_OVERHEAD = 2U;
+    static constexpr uint16_t CAPTURE_BUFFER_SIZE = 4096U;  // The length of the pre-trigger buffer
+    static constexpr uint16_t NO_TRIGGER = 0xFFFFU;         // the trigger position has been overwritten
+
+    static_assert(Logger::SINGLE_MSG_SIZE <= 256U, "record length must fit in a byte");
+
+    volatile char  m_capture_buffer[CAPTURE_BUFFER_SIZE];  // all captured records are kept here until streamed
+    volatile State m_state = IDLE;
+
+    volatile uint16_t m_write_pos = 0U;          // the write_pos can be modified by both main thread and ISRs
+    volatile uint16_t m_store_guard = 0U;        // When it's 0, all records have been stored
+    volatile uint16_t m_post_remaining = 0U;     // records still accepted after the trigger
+    volatile uint16_t m_trigger_pos = 0U;        // write_pos when trigger() is called
+    volatile bool     m_wrapped = false;         // if the oldest records have been overwritten
+
+    uint16_t m_post_trigger_records = 0U;        // the post-trigger window set by arm()
+    uint16_t m_read_pos = 0U;                    // next record to stream, only used by process()
+    uint16_t m_record_count = 0U;                // records left to stream
+    uint16_t m_records_after_trigger = 0U;       // the trigger marker goes before the last N records
+    bool     m_trigger_marked = false;           // if the trigger marker has been streamed
+};
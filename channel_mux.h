@@ -0,0 +1,234 @@
+/**
+ * @file channel_mux.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Virtual channels, several loggers sharing one sink with a weighted bandwidth share
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+Every channel is a logger of its own, with its own send buffer, so a burst on one channel never takes the space of the
+others. The loggers use the ChannelSink (build with LOGGER_SINK=ChannelSink, the global logger is then a channel too)
+and hand their regions to the mux, which sends them on its own sink with a deficit round-robin: a channel of weight w
+may send up to w * QUANTUM bytes per turn, so under load the channels share the link in proportion to their weights and
+an idle channel costs nothing. Every chunk is a LOG_FRAME_CHANNEL header followed by the raw bytes, see log_protocol.h,
+and tools/logdemux.cpp splits a capture back into one stream per channel.
+
+Usage:
+ChannelMux<UartDmaSink> mux;
+BasicLogger<ChannelSink> telemetry;
+mux.init(&huart2);
+logger.init(&mux, 0, 1);       // console, 1 share
+telemetry.init(&mux, 1, 4);    // telemetry, 4 shares
+mux.process();                 // in the main loop, next to logger.process()
+*/
+
+#include "logger.h"
+
+template <typename Sink, uint8_t MAX_CHANNELS = 4U>
+class ChannelMux {
+
+   public:
+    /**
+     * @brief Initialize the sink of the mux, the arguments are passed to Sink::init()
+     */
+    template <typename... A>
+    void init(A... args) {
+        m_sink.init(args...);
+        m_sink.bind(transferCompleted, this, nullptr, 0U);
+    }
+
+    /**
+     * @brief Attach the sink of a logger to a channel, called by logger.init(&mux, channel, weight)
+     */
+    void attach(ChannelSink* sink, uint8_t channel, uint8_t weight) {
+        assert_param(channel < MAX_CHANNELS && weight > 0U);
+        m_channels[channel].sink = sink;
+        m_channels[channel].quantum = (uint16_t)weight * QUANTUM;
+        sink->connect(this, channel, submit);
+    }
+
+    /**
+     * @brief Poll the sink of the mux
+     * @note Need to poll it frequently, so put it into the main loop
+     */
+    void process() {
+        m_sink.poll();
+    }
+
+    /**
+     * @brief Get the bytes sent on a channel, headers excluded
+     */
+    uint32_t getSentCount(uint8_t channel) {
+        return m_channels[channel].sent;
+    }
+
+    static constexpr uint16_t QUANTUM = 64U;  // bytes per turn and per unit of weight
+
+   private:
+    struct Channel {
+        ChannelSink*                  sink = nullptr;
+        const volatile char* volatile data = nullptr;  // the pending region of the channel
+        volatile uint16_t             length = 0U;     // bytes of the region not sent yet, 0 when idle
+        uint16_t                      quantum = 0U;
+        uint16_t                      deficit = 0U;    // bytes the channel may still send in its turn
+        uint8_t                       seq = 0U;
+        uint32_t                      sent = 0U;
+    };
+
+    /**
+     * @brief A channel has a region to send, called by its logger in any context
+     */
+    static void submit(void* context, uint8_t channel, const volatile char* data, uint16_t length) {
+        ChannelMux* self = static_cast<ChannelMux*>(context);
+        self->m_channels[channel].data = data;
+        self->m_channels[channel].length = length;  // published last, the scheduler only looks at the length
+        self->kick();
+    }
+
+    /**
+     * @brief Start the scheduler unless it's already running in another context
+     */
+    void kick() {
+        while (true) {
+            uint8_t busy;
+            do {
+                busy = __LDREXB(&m_busy);
+                if (busy) {
+                    __CLREX();
+                    return;  // the running scheduler will see the new region
+                }
+            } while (__STREXB(1U, &m_busy));
+
+            if (run()) {
+                return;  // the sink is sending, the completion continues the schedule
+            }
+            m_busy = 0U;
+
+            // a region submitted between the last look of run() and the release would be stuck, look again
+            if (!anyPending()) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Send chunks in deficit round-robin order as long as the sink consumes them at once
+     * @return true if the sink is busy with a chunk
+     */
+    bool run() {
+        while (pick()) {
+            // the state is set before each transfer, the completion may come before transmit() returns
+            m_sending_body = false;
+            if (!m_sink.transmit(m_header, m_header_length)) {
+                return true;
+            }
+            m_sending_body = true;
+            if (!m_sink.transmit(m_channels[m_current].data, m_chunk_length)) {
+                return true;
+            }
+            finishChunk();
+        }
+        return false;
+    }
+
+    /**
+     * @brief Choose the next chunk and encode its header
+     * @return false if no channel has data
+     */
+    bool pick() {
+        for (uint8_t visited = 0; visited <= MAX_CHANNELS; visited++) {
+            Channel& channel = m_channels[m_current];
+            if (channel.length && channel.deficit == 0U) {
+                channel.deficit = channel.quantum;  // a new turn of the channel
+            }
+            if (channel.length) {
+                m_chunk_length = channel.length < channel.deficit ? channel.length : channel.deficit;
+                channel.deficit -= m_chunk_length;
+
+                // [type][channel][seq][length u16]
+                uint8_t header[5] = {LOG_FRAME_CHANNEL, m_current, channel.seq++, (uint8_t)m_chunk_length,
+                                     (uint8_t)(m_chunk_length >> 8)};
+                m_header_length = LogFormatter::encodeFrame(m_header, header, sizeof(header));
+                return true;
+            }
+            channel.deficit = 0U;  // an idle channel doesn't save its turn
+            m_current = m_current + 1U == MAX_CHANNELS ? 0U : m_current + 1U;
+        }
+        return false;
+    }
+
+    /**
+     * @brief A chunk is out, release the region of the channel when it's fully sent
+     */
+    void finishChunk() {
+        Channel& channel = m_channels[m_current];
+        channel.sent += m_chunk_length;
+        channel.data = channel.data + m_chunk_length;
+        channel.length = channel.length - m_chunk_length;
+        if (channel.deficit == 0U) {
+            m_current = m_current + 1U == MAX_CHANNELS ? 0U : m_current + 1U;  // the turn is over
+        }
+        if (channel.length == 0U) {
+            channel.sink->completed();  // may submit the next region of the channel right away
+        }
+    }
+
+    bool anyPending() {
+        for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+            if (m_channels[i].length) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief The sink has sent the header or the body of a chunk, usually called in its ISR
+     */
+    static void transferCompleted(void* context) {
+        ChannelMux* self = static_cast<ChannelMux*>(context);
+        if (!self->m_sending_body) {
+            self->m_sending_body = true;
+            if (!self->m_sink.transmit(self->m_channels[self->m_current].data, self->m_chunk_length)) {
+                return;
+            }
+        }
+        self->finishChunk();
+        if (self->run()) {
+            return;
+        }
+        self->m_busy = 0U;
+        if (self->anyPending()) {
+            self->kick();
+        }
+    }
+
+    static constexpr uint8_t CHANNEL_HEADER_SIZE = 8U;  // An encoded LOG_FRAME_CHANNEL header
+
+    Channel m_channels[MAX_CHANNELS];
+
+    volatile uint8_t m_busy = 0U;                  // the scheduler is running or the sink is sending a chunk
+    volatile bool    m_sending_body = false;       // the header of the chunk is out, the body is on
+    uint8_t          m_current = 0U;               // the channel in turn
+    uint16_t         m_chunk_length = 0U;
+    uint16_t         m_header_length = 0U;
+    char             m_header[CHANNEL_HEADER_SIZE];
+
+    Sink m_sink;
+};
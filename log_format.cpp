@@ -0,0 +1,559 @@
+/**
+ * @file logger.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Formatters of the logger, shared by all sinks
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "log_format.h"
+
+#include <string.h>
+
+/**
+ * @brief Enable the trace unit and start the DWT cycle counter
+ */
+void LogFormatter::startTimestamp() {
+    logPortStartCycles();
+}
+
+/**
+ * @brief Format a signed number
+ */
+uint16_t LogFormatter::formatSignedNum(char* buf, int32_t val) {
+    char*    start = buf;
+    uint32_t magnitude = (uint32_t)val;
+    if (val < 0) {
+        magnitude = 0U - magnitude;  // in unsigned, INT32_MIN has no positive int32_t
+        *(buf++) = '-';
+    }
+    uint16_t length = formatUnsignedNum(buf, magnitude);
+    return buf + length - start;
+}
+
+/**
+ * @brief Format an unsigned number
+ */
+uint16_t LogFormatter::formatUnsignedNum(char* buf, uint32_t val) {
+    uint8_t i = 0;
+    do {
+        buf[i++] = val % 10 + '0';
+        val /= 10;
+    } while (val);
+
+    // swap
+    uint8_t start = 0, end = i - 1;
+    while (start < end) {
+        char temp = buf[start];
+        buf[start++] = buf[end];
+        buf[end--] = temp;
+    }
+    return i;
+}
+
+/**
+ * @brief Format an integer part beyond 32 bits, the 64-bit division is left out of the common path
+ */
+static uint16_t formatUnsigned64(char* buf, uint64_t val) {
+    char    digits[20];
+    uint8_t count = 0;
+    do {
+        digits[count++] = (char)(val % 10U + '0');
+        val /= 10U;
+    } while (val);
+    for (uint8_t i = 0; i < count; i++) {
+        buf[i] = digits[count - 1U - i];
+    }
+    return count;
+}
+
+/**
+ * @brief Format a double number with 3 decimal places, rounded half away from zero
+ * @note The fraction is scaled by 1000 in a single multiplication, which is exact for a float. NaN is "nan", a
+ * magnitude from 2^64 up "inf"
+ */
+uint16_t LogFormatter::formatDouble(char* buf, double val) {
+    char* start = buf;
+    if (val != val) {
+        return _strcpy(buf, "nan");
+    }
+    if (val < 0) {
+        *(buf++) = '-';
+        val = -val;
+    }
+    if (val >= 18446744073709551616.0) {
+        return buf + _strcpy(buf, "inf") - start;
+    }
+
+    uint64_t int_part = (uint64_t)val;
+    uint16_t fraction = (uint16_t)((val - (double)int_part) * 1000.0 + 0.5);
+    if (fraction == 1000U) {
+        int_part++;  // .9995 and above round to the next integer
+        fraction = 0U;
+    }
+    buf += int_part <= UINT32_MAX ? formatUnsignedNum(buf, (uint32_t)int_part) : formatUnsigned64(buf, int_part);
+
+    *(buf++) = '.';
+    *(buf++) = (char)(fraction / 100U + '0');
+    *(buf++) = (char)(fraction / 10U % 10U + '0');
+    *(buf++) = (char)(fraction % 10U + '0');
+    return buf - start;
+}
+
+static const uint32_t POW10[10] = {1U,      10U,      100U,      1000U,      10000U,
+                                   100000U, 1000000U, 10000000U, 100000000U, 1000000000U};
+
+/**
+ * @brief Format a fixed-point number with ceil(frac_bits * log10(2)) decimals, rounded half away from zero
+ * @note The fraction is scaled by a power of 10 in a 32x32-bit multiplication, in two groups of decimals beyond 9 so
+ * that each group fits 32 bits. Exact, no float nor 64-bit division
+ */
+uint16_t LogFormatter::formatFixed(char* buf, int32_t raw, uint8_t frac_bits) {
+    char*    start = buf;
+    uint32_t magnitude = (uint32_t)raw;
+    if (raw < 0) {
+        magnitude = 0U - magnitude;
+        *(buf++) = '-';
+    }
+    if (frac_bits == 0U) {
+        return buf + formatUnsignedNum(buf, magnitude) - start;
+    }
+
+    uint32_t mask = (1U << frac_bits) - 1U;
+    uint32_t int_part = magnitude >> frac_bits;
+    uint32_t rest = magnitude & mask;
+    uint8_t  decimals = (uint8_t)((frac_bits * 1233U >> 12) + 1U);  // 1233 / 4096 is log10(2), 10^decimals > 2^bits
+    uint8_t  sizes[2] = {(uint8_t)(decimals > 9U ? 5U : decimals), (uint8_t)(decimals > 9U ? decimals - 5U : 0U)};
+    uint32_t groups[2] = {0U, 0U};
+    for (uint8_t k = 0; k < 2U && sizes[k]; k++) {
+        uint64_t scaled = (uint64_t)rest * POW10[sizes[k]];
+        groups[k] = (uint32_t)(scaled >> frac_bits);
+        rest = (uint32_t)scaled & mask;
+    }
+    bool carry = rest >= 1U << (frac_bits - 1U);  // half of the last decimal and above round up
+    for (int8_t k = 1; k >= 0 && carry; k--) {
+        if (sizes[k]) {
+            carry = ++groups[k] == POW10[sizes[k]];
+            groups[k] = carry ? 0U : groups[k];
+        }
+    }
+    buf += formatUnsignedNum(buf, int_part + carry);
+
+    *(buf++) = '.';
+    for (uint8_t k = 0; k < 2U && sizes[k]; k++) {
+        for (uint8_t i = sizes[k]; i > 0; i--) {
+            buf[i - 1U] = (char)(groups[k] % 10U + '0');
+            groups[k] /= 10U;
+        }
+        buf += sizes[k];
+    }
+    return buf - start;
+}
+
+#if LOGGER_FLOAT_SHORTEST
+
+/* Note
+The shortest digits are found with Ryu (Ulf Adams, PLDI 2018) restricted to float: the bounds of the interval rounding
+to the float are scaled by a power of 5 with a 32x64-bit multiplication, then digits are removed while the bounds
+still differ. 78 constants of 64 bits, no division beyond by 10, no double arithmetic.
+*/
+
+static constexpr int32_t FLOAT_MANTISSA_BITS = 23;
+static constexpr int32_t FLOAT_BIAS = 127;
+static constexpr int32_t FLOAT_POW5_INV_BITCOUNT = 59;
+static constexpr int32_t FLOAT_POW5_BITCOUNT = 61;
+
+/**
+ * @brief floor(2^(pow5bits(i) - 1 + 59) / 5^i) + 1, for the positive binary exponents
+ */
+static const uint64_t FLOAT_POW5_INV_SPLIT[31] = {
+    0x0800000000000001ULL, 0x0666666666666667ULL, 0x051EB851EB851EB9ULL, 0x04189374BC6A7EFAULL, 0x068DB8BAC710CB2AULL,
+    0x053E2D6238DA3C22ULL, 0x0431BDE82D7B634EULL, 0x06B5FCA6AF2BD216ULL, 0x055E63B88C230E78ULL, 0x044B82FA09B5A52DULL,
+    0x06DF37F675EF6EAEULL, 0x057F5FF85E592558ULL, 0x0465E6604B7A8447ULL, 0x0709709A125DA071ULL, 0x05A126E1A84AE6C1ULL,
+    0x0480EBE7B9D58567ULL, 0x0734ACA5F6226F0BULL, 0x05C3BD5191B525A3ULL, 0x049C97747490EAE9ULL, 0x0760F253EDB4AB0EULL,
+    0x05E72843249088D8ULL, 0x04B8ED0283A6D3E0ULL, 0x078E480405D7B966ULL, 0x060B6CD004AC9452ULL, 0x04D5F0A66A23A9DBULL,
+    0x07BCB43D769F762BULL, 0x063090312BB2C4EFULL, 0x04F3A68DBC8F03F3ULL, 0x07EC3DAF94180651ULL, 0x065697BFA9ACD1DAULL,
+    0x051212FFBAF0A7E2ULL};
+
+/**
+ * @brief 5^i on its top 61 bits, for the negative binary exponents
+ */
+static const uint64_t FLOAT_POW5_SPLIT[47] = {
+    0x1000000000000000ULL, 0x1400000000000000ULL, 0x1900000000000000ULL, 0x1F40000000000000ULL, 0x1388000000000000ULL,
+    0x186A000000000000ULL, 0x1E84800000000000ULL, 0x1312D00000000000ULL, 0x17D7840000000000ULL, 0x1DCD650000000000ULL,
+    0x12A05F2000000000ULL, 0x174876E800000000ULL, 0x1D1A94A200000000ULL, 0x12309CE540000000ULL, 0x16BCC41E90000000ULL,
+    0x1C6BF52634000000ULL, 0x11C37937E0800000ULL, 0x16345785D8A00000ULL, 0x1BC16D674EC80000ULL, 0x1158E460913D0000ULL,
+    0x15AF1D78B58C4000ULL, 0x1B1AE4D6E2EF5000ULL, 0x10F0CF064DD59200ULL, 0x152D02C7E14AF680ULL, 0x1A784379D99DB420ULL,
+    0x108B2A2C28029094ULL, 0x14ADF4B7320334B9ULL, 0x19D971E4FE8401E7ULL, 0x1027E72F1F128130ULL, 0x1431E0FAE6D7217CULL,
+    0x193E5939A08CE9DBULL, 0x1F8DEF8808B02452ULL, 0x13B8B5B5056E16B3ULL, 0x18A6E32246C99C60ULL, 0x1ED09BEAD87C0378ULL,
+    0x13426172C74D822BULL, 0x1812F9CF7920E2B6ULL, 0x1E17B84357691B64ULL, 0x12CED32A16A1B11EULL, 0x178287F49C4A1D66ULL,
+    0x1D6329F1C35CA4BFULL, 0x125DFA371A19E6F7ULL, 0x16F578C4E0A060B5ULL, 0x1CB2D6F618C878E3ULL, 0x11EFC659CF7D4B8DULL,
+    0x166BB7F0435C9E71ULL, 0x1C06A5EC5433C60DULL};
+
+/**
+ * @brief Bits of 5^e, ceil(log2(5^e)) and 1 for e = 0
+ */
+static inline int32_t pow5Bits(int32_t e) {
+    return (int32_t)(((uint32_t)e * 1217359U) >> 19) + 1;
+}
+
+/**
+ * @brief floor(log10(2^e))
+ */
+static inline uint32_t log10Pow2(int32_t e) {
+    return ((uint32_t)e * 78913U) >> 18;
+}
+
+/**
+ * @brief floor(log10(5^e))
+ */
+static inline uint32_t log10Pow5(int32_t e) {
+    return ((uint32_t)e * 732923U) >> 20;
+}
+
+static inline bool multipleOfPowerOf5(uint32_t value, uint32_t p) {
+    uint32_t count = 0U;
+    while (value && value % 5U == 0U) {
+        value /= 5U;
+        count++;
+    }
+    return count >= p;
+}
+
+static inline bool multipleOfPowerOf2(uint32_t value, uint32_t p) {
+    return (value & ((1U << p) - 1U)) == 0U;
+}
+
+/**
+ * @brief (m * factor) >> shift, with shift above 32
+ */
+static inline uint32_t mulShift(uint32_t m, uint64_t factor, int32_t shift) {
+    uint64_t low = (uint64_t)m * (uint32_t)factor;
+    uint64_t high = (uint64_t)m * (uint32_t)(factor >> 32);
+    return (uint32_t)(((low >> 32) + high) >> (shift - 32));
+}
+
+/**
+ * @brief The shortest decimal mantissa * 10^exponent rounding to the float of [ieee_mantissa] and [ieee_exponent]
+ */
+static void shortestDecimal(uint32_t ieee_mantissa, uint32_t ieee_exponent, uint32_t& mantissa, int32_t& exponent) {
+    int32_t  e2;
+    uint32_t m2;
+    if (ieee_exponent == 0U) {
+        e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;  // denormal
+        m2 = ieee_mantissa;
+    } else {
+        e2 = (int32_t)ieee_exponent - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = (1U << FLOAT_MANTISSA_BITS) | ieee_mantissa;
+    }
+    bool accept_bounds = (m2 & 1U) == 0U;  // round half to even when reading back
+
+    // the float and the bounds of the interval rounding to it, times 4
+    uint32_t mv = 4U * m2, mp = 4U * m2 + 2U;
+    uint32_t mm_shift = ieee_mantissa != 0U || ieee_exponent <= 1U;
+    uint32_t mm = 4U * m2 - 1U - mm_shift;
+
+    uint32_t vr, vp, vm;
+    int32_t  e10;
+    bool     vm_trailing_zeros = false, vr_trailing_zeros = false;
+    uint8_t  last_removed = 0U;
+    if (e2 >= 0) {
+        uint32_t q = log10Pow2(e2);
+        int32_t  k = FLOAT_POW5_INV_BITCOUNT + pow5Bits((int32_t)q) - 1;
+        int32_t  i = -e2 + (int32_t)q + k;
+        e10 = (int32_t)q;
+        vr = mulShift(mv, FLOAT_POW5_INV_SPLIT[q], i);
+        vp = mulShift(mp, FLOAT_POW5_INV_SPLIT[q], i);
+        vm = mulShift(mm, FLOAT_POW5_INV_SPLIT[q], i);
+        if (q != 0U && (vp - 1U) / 10U <= vm / 10U) {
+            // one removed digit is needed even if none is removed below
+            int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5Bits((int32_t)q - 1) - 1;
+            last_removed = (uint8_t)(mulShift(mv, FLOAT_POW5_INV_SPLIT[q - 1U], -e2 + (int32_t)q - 1 + l) % 10U);
+        }
+        if (q <= 9U) {
+            // only one of mp, mv and mm can be a multiple of 5
+            if (mv % 5U == 0U) {
+                vr_trailing_zeros = multipleOfPowerOf5(mv, q);
+            } else if (accept_bounds) {
+                vm_trailing_zeros = multipleOfPowerOf5(mm, q);
+            } else {
+                vp -= multipleOfPowerOf5(mp, q);
+            }
+        }
+    } else {
+        uint32_t q = log10Pow5(-e2);
+        int32_t  i = -e2 - (int32_t)q;
+        int32_t  j = (int32_t)q - (pow5Bits(i) - FLOAT_POW5_BITCOUNT);
+        e10 = (int32_t)q + e2;
+        vr = mulShift(mv, FLOAT_POW5_SPLIT[i], j);
+        vp = mulShift(mp, FLOAT_POW5_SPLIT[i], j);
+        vm = mulShift(mm, FLOAT_POW5_SPLIT[i], j);
+        if (q != 0U && (vp - 1U) / 10U <= vm / 10U) {
+            j = (int32_t)q - 1 - (pow5Bits(i + 1) - FLOAT_POW5_BITCOUNT);
+            last_removed = (uint8_t)(mulShift(mv, FLOAT_POW5_SPLIT[i + 1], j) % 10U);
+        }
+        if (q <= 1U) {
+            // mv = 4 * m2 has at least 2 trailing zero bits, mm has 1 when mm_shift is 1, mp always has 1
+            vr_trailing_zeros = true;
+            if (accept_bounds) {
+                vm_trailing_zeros = mm_shift == 1U;
+            } else {
+                vp--;
+            }
+        } else if (q < 31U) {
+            vr_trailing_zeros = multipleOfPowerOf2(mv, q - 1U);
+        }
+    }
+
+    // remove digits while the bounds differ, the exact cases need the removed digits to round
+    int32_t removed = 0;
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        while (vp / 10U > vm / 10U) {
+            vm_trailing_zeros &= vm % 10U == 0U;
+            vr_trailing_zeros &= last_removed == 0U;
+            last_removed = (uint8_t)(vr % 10U);
+            vr /= 10U;
+            vp /= 10U;
+            vm /= 10U;
+            removed++;
+        }
+        if (vm_trailing_zeros) {
+            while (vm % 10U == 0U) {
+                vr_trailing_zeros &= last_removed == 0U;
+                last_removed = (uint8_t)(vr % 10U);
+                vr /= 10U;
+                vp /= 10U;
+                vm /= 10U;
+                removed++;
+            }
+        }
+        if (vr_trailing_zeros && last_removed == 5U && vr % 2U == 0U) {
+            last_removed = 4U;  // exactly halfway, to even
+        }
+        mantissa = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5U);
+    } else {
+        while (vp / 10U > vm / 10U) {
+            last_removed = (uint8_t)(vr % 10U);
+            vr /= 10U;
+            vp /= 10U;
+            vm /= 10U;
+            removed++;
+        }
+        mantissa = vr + (vr == vm || last_removed >= 5U);
+    }
+    exponent = e10 + removed;
+}
+
+/**
+ * @brief The shortest digits, written as an integer, a decimal or in scientific notation by the position of the point
+ */
+uint16_t LogFormatter::formatFloatShortest(char* buf, float val) {
+    char*    start = buf;
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    uint32_t ieee_mantissa = bits & ((1U << FLOAT_MANTISSA_BITS) - 1U);
+    uint32_t ieee_exponent = (bits >> FLOAT_MANTISSA_BITS) & 0xFFU;
+    if (ieee_exponent == 0xFFU && ieee_mantissa) {
+        return _strcpy(buf, "nan");
+    }
+    if (bits >> 31) {
+        *(buf++) = '-';
+    }
+    if (ieee_exponent == 0xFFU) {
+        return buf + _strcpy(buf, "inf") - start;
+    }
+    if (ieee_exponent == 0U && ieee_mantissa == 0U) {
+        *(buf++) = '0';
+        return buf - start;
+    }
+
+    uint32_t mantissa;
+    int32_t  exponent;
+    shortestDecimal(ieee_mantissa, ieee_exponent, mantissa, exponent);
+    char    digits[10];
+    int32_t length = formatUnsignedNum(digits, mantissa);
+    int32_t point = length + exponent;  // digits before the point, the value is 0.digits * 10^point
+
+    if (point > 9 || point < -3) {
+        *(buf++) = digits[0];
+        if (length > 1) {
+            *(buf++) = '.';
+            memcpy(buf, &digits[1], length - 1);
+            buf += length - 1;
+        }
+        *(buf++) = 'e';
+        buf += formatSignedNum(buf, point - 1);
+    } else if (point <= 0) {
+        *(buf++) = '0';
+        *(buf++) = '.';
+        for (int32_t i = point; i < 0; i++) {
+            *(buf++) = '0';
+        }
+        memcpy(buf, digits, length);
+        buf += length;
+    } else if (point >= length) {
+        memcpy(buf, digits, length);
+        buf += length;
+        for (int32_t i = length; i < point; i++) {
+            *(buf++) = '0';
+        }
+    } else {
+        memcpy(buf, digits, point);
+        buf += point;
+        *(buf++) = '.';
+        memcpy(buf, &digits[point], length - point);
+        buf += length - point;
+    }
+    return buf - start;
+}
+
+#endif
+
+/**
+ * @brief Format the "[timestamp] " prefix of a record
+ */
+uint16_t LogFormatter::formatTimestamp(char* buf) {
+    uint16_t length = 0;
+    buf[length++] = '[';
+    length += formatUnsignedNum(&buf[length], timestamp());
+    buf[length++] = ']';
+    buf[length++] = ' ';
+    return length;
+}
+
+/**
+ * @brief Copy a string(ends with '\0') and return the length
+ * @return length of the string
+ */
+uint16_t LogFormatter::_strcpy(char* des, const char* src) {
+    uint16_t i = 0;
+    while (src[i] != '\0') {
+        des[i] = src[i];
+        ++i;
+    }
+    return i;
+}
+
+#if !defined(LOGGER_HOST) && LOGGER_CRC_HW
+
+void LogFormatter::startCrc() {
+    __HAL_RCC_CRC_CLK_ENABLE();
+}
+
+/**
+ * @brief Feed the region to the CRC unit a word at a time: a load and a store per 4 bytes, the unit takes 4 AHB cycles
+ * per word. A region starting off a word boundary is read with unaligned loads, which the Cortex-M4 does in hardware,
+ * so the words stay grouped from the start of the region. Only the last 1 to 3 bytes are gathered one by one
+ * @note The region is not written while the sink holds it, so it's read as plain memory
+ */
+uint32_t LogFormatter::crc32(const volatile char* data, uint16_t length) {
+    const char* bytes = (const char*)data;
+    uint16_t    words = length / 4U;
+    CRC->CR = CRC_CR_RESET;
+    if (((uintptr_t)bytes & 3U) == 0U) {
+        const uint32_t* aligned = (const uint32_t*)bytes;
+        for (uint16_t i = 0; i < words; i++) {
+            CRC->DR = aligned[i];
+        }
+    } else {
+        for (uint16_t i = 0; i < words; i++) {
+            uint32_t word;
+            memcpy(&word, &bytes[4U * i], sizeof(word));  // a single unaligned LDR
+            CRC->DR = word;
+        }
+    }
+    if (length & 3U) {
+        uint32_t word = 0U;  // the last word is padded with zeros
+        for (uint16_t i = 4U * words; i < length; i++) {
+            word |= (uint32_t)(uint8_t)bytes[i] << (8U * (i & 3U));
+        }
+        CRC->DR = word;
+    }
+    return CRC->DR;
+}
+
+#else
+
+/**
+ * @brief The CRC of every byte value, MSB first with the polynomial of the CRC unit
+ */
+struct CrcTable {
+    uint32_t entries[256];
+
+    constexpr CrcTable() : entries() {
+        for (uint32_t i = 0; i < 256U; i++) {
+            uint32_t crc = i << 24;
+            for (uint8_t bit = 0; bit < 8U; bit++) {
+                crc = crc & 0x80000000U ? (crc << 1) ^ 0x04C11DB7U : crc << 1;
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+static constexpr CrcTable crc_table;
+
+void LogFormatter::startCrc() {}
+
+/**
+ * @brief The CRC unit takes a word MSB first, so its bytes go through the table from the last one
+ */
+uint32_t LogFormatter::crc32(const volatile char* data, uint16_t length) {
+    uint32_t crc = 0xFFFFFFFFU;
+    for (uint16_t i = 0; i < length; i += 4U) {
+        uint8_t bytes[4] = {0U, 0U, 0U, 0U};  // the last word is padded with zeros
+        for (uint16_t k = 0; k < 4U && i + k < length; k++) {
+            bytes[k] = (uint8_t)data[i + k];
+        }
+        crc = (crc << 8) ^ crc_table.entries[(crc >> 24) ^ bytes[3]];
+        crc = (crc << 8) ^ crc_table.entries[(crc >> 24) ^ bytes[2]];
+        crc = (crc << 8) ^ crc_table.entries[(crc >> 24) ^ bytes[1]];
+        crc = (crc << 8) ^ crc_table.entries[(crc >> 24) ^ bytes[0]];
+    }
+    return crc;
+}
+
+#endif
+
+/**
+ * @brief COBS encode a payload, so the frame contains no 0x00 except the two delimiters
+ */
+uint16_t LogFormatter::encodeFrame(char* buf, const uint8_t* payload, uint16_t length) {
+    uint16_t pos = 0, code_pos;
+    uint8_t  code = 1;
+
+    buf[pos++] = LOG_FRAME_DELIMITER;
+    code_pos = pos++;
+    for (uint16_t i = 0; i < length; i++) {
+        if (payload[i] == 0U) {
+            // a zero ends the block, its code byte holds the distance to the zero
+            buf[code_pos] = code;
+            code_pos = pos++;
+            code = 1;
+        } else {
+            buf[pos++] = payload[i];
+            if (++code == 0xFFU) {
+                // a full block of 254 non-zero bytes, continue without an implicit zero
+                buf[code_pos] = code;
+                code_pos = pos++;
+                code = 1;
+            }
+        }
+    }
+    buf[code_pos] = code;
+    buf[pos++] = LOG_FRAME_DELIMITER;
+    return pos;
+}
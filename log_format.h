@@ -0,0 +1,252 @@
+/**
+ * @file log_format.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Formatters of the logger, shared by all sinks
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+The formatters write into the caller's buffer and never allocate, so they work in any context. To log your own message
+type, add a formatSingle overload here.
+*/
+
+#include "logger_port.h"
+#include "log_protocol.h"
+
+/**
+ * @brief Compute LogFormatter::crc32() with the CRC unit of the STM32, which must not be used by the application then.
+ * The host build and LOGGER_CRC_HW 0 use a table
+ */
+#ifndef LOGGER_CRC_HW
+#define LOGGER_CRC_HW 1
+#endif
+
+/**
+ * @brief Format a float with the fewest digits that read back as the same float, e.g. 0.1 as "0.1", 1e-05 as "1e-5"
+ * instead of "0.000" and 3.0 as "3", in scientific notation from 1e9 up and below 1e-4. 0 keeps the 3 decimals of
+ * formatDouble(), a double always has them
+ */
+#ifndef LOGGER_FLOAT_SHORTEST
+#define LOGGER_FLOAT_SHORTEST 0
+#endif
+
+/**
+ * @brief A fixed-point value, raw / 2^frac_bits, made by LogFormatter::q15(), q31() and fixed<>() to be logged
+ */
+struct LogFixed {
+    int32_t raw;
+    uint8_t frac_bits;
+};
+
+class LogFormatter {
+
+   public:
+    /**
+     *@brief Format multiple messages
+     */
+    template <typename T, typename... Ts>
+    static uint16_t formatMulti(char* pos, T first, Ts... rest) {
+        uint16_t length = formatSingle(pos, first);
+        return length + formatMulti(pos + length, rest...);
+    }
+    /**
+     * @brief formatMulti recursion end
+     */
+    static inline uint16_t formatMulti(char* pos) {
+        return 0U;
+    }
+
+    /**
+     * @brief COBS encode a frame payload between two delimiters
+     * @return uint16_t length of the encoded frame
+     */
+    static uint16_t encodeFrame(char* buf, const uint8_t* payload, uint16_t length);
+
+    /**
+     * @brief The CRC-32 of LOG_FRAME_CRC over a region of the send buffer, see log_protocol.h
+     * @note Not reentrant with the CRC unit, called by the sink of a single logger
+     */
+    static uint32_t crc32(const volatile char* data, uint16_t length);
+
+    /**
+     * @brief Enable the clock of the CRC unit
+     */
+    static void startCrc();
+
+    /**
+     * @brief Start the DWT cycle counter used as the timestamp of records and time sync
+     */
+    static void startTimestamp();
+
+    /**
+     * @brief Get the current timestamp, in CPU cycles wrapping at 2^32
+     */
+    static inline uint32_t timestamp() {
+        return logPortCycles();
+    }
+
+    /**
+     * @brief Log a Q15 value without converting it to float, e.g. logger.logln("gain=", Logger::q15(x)) prints
+     * "gain=0.50000" for x = 16384
+     */
+    static inline LogFixed q15(int16_t value) {
+        return LogFixed{value, 15U};
+    }
+
+    /**
+     * @brief Log a Q31 value without converting it to float
+     */
+    static inline LogFixed q31(int32_t value) {
+        return LogFixed{value, 31U};
+    }
+
+    /**
+     * @brief Log a fixed-point value with [FRAC_BITS] fractional bits, e.g. fixed<8>(x) for a Q23.8
+     */
+    template <uint8_t FRAC_BITS>
+    static inline LogFixed fixed(int32_t value) {
+        static_assert(FRAC_BITS <= 31U, "at most 31 fractional bits in 32 bits");
+        return LogFixed{value, FRAC_BITS};
+    }
+
+    static constexpr uint16_t SINGLE_MSG_SIZE = 256U;   // The maximum size of a single log message
+
+   protected:
+    /**
+     * @brief Format the "[timestamp] " prefix of a record
+     * @return uint16_t length of formatted string
+     */
+    static uint16_t formatTimestamp(char* buf);
+
+    /**
+     * @brief Copy a string(ends with '\0') and return the length
+     * @return length of the string
+     */
+    static uint16_t _strcpy(char* des, const char* src);
+
+   private:
+    /**
+     * @brief Format a signed value
+     */
+    static inline uint16_t formatSingle(char* pos, int32_t value) {
+        return formatSignedNum(pos, value);
+    }
+    static inline uint16_t formatSingle(char* pos, int16_t value) {
+        return formatSignedNum(pos, value);
+    }
+    static inline uint16_t formatSingle(char* pos, int8_t value) {
+        return formatSignedNum(pos, value);
+    }
+#ifndef LOGGER_HOST  // int32_t is long on ARM but int on a PC
+    static inline uint16_t formatSingle(char* pos, int value) {
+        return formatSignedNum(pos, value);
+    }
+#endif
+
+    /**
+     * @brief Format an unsigned value
+     */
+    static inline uint16_t formatSingle(char* pos, uint32_t value) {
+        return formatUnsignedNum(pos, value);
+    }
+    static inline uint16_t formatSingle(char* pos, uint16_t value) {
+        return formatUnsignedNum(pos, value);
+    }
+    static inline uint16_t formatSingle(char* pos, uint8_t value) {
+        return formatUnsignedNum(pos, value);
+    }
+#ifndef LOGGER_HOST
+    static inline uint16_t formatSingle(char* pos, unsigned int value) {
+        return formatUnsignedNum(pos, value);
+    }
+#endif
+
+    /**
+     * @brief Format a float value
+     */
+    static inline uint16_t formatSingle(char* pos, float value) {
+#if LOGGER_FLOAT_SHORTEST
+        return formatFloatShortest(pos, value);
+#else
+        return formatDouble(pos, value);
+#endif
+    }
+
+    /**
+     * @brief Format a double value
+     */
+    static inline uint16_t formatSingle(char* pos, double value) {
+        return formatDouble(pos, value);
+    }
+
+    /**
+     * @brief Format a fixed-point value
+     */
+    static inline uint16_t formatSingle(char* pos, LogFixed value) {
+        return formatFixed(pos, value.raw, value.frac_bits);
+    }
+
+    /**
+     * @brief Format a string
+     */
+    static inline uint16_t formatSingle(char* pos, const char* str) {
+        return _strcpy(pos, str);
+    }
+
+    /**
+     * @brief Format a char
+     */
+    static inline uint16_t formatSingle(char* pos, char cha) {
+        *pos = cha;
+        return 1;
+    }
+
+    /**
+     * @brief Format an unsigned value
+     * @return uint16_t length of formatted string
+     */
+    static uint16_t formatUnsignedNum(char* buf, uint32_t val);
+
+    /**
+     * @brief Format a signed value
+     * @return uint16_t length of formatted string
+     */
+    static uint16_t formatSignedNum(char* buf, int32_t val);
+
+    /**
+     * @brief Format a decimal value
+     * @return uint16_t length of formatted string
+     */
+    static uint16_t formatDouble(char* buf, double val);
+
+    /**
+     * @brief Format raw / 2^frac_bits with integer arithmetic only, with the fewest decimals telling all the values
+     * apart: 5 for Q15, 10 for Q31
+     * @return uint16_t length of formatted string, at most 13
+     */
+    static uint16_t formatFixed(char* buf, int32_t raw, uint8_t frac_bits);
+
+#if LOGGER_FLOAT_SHORTEST
+    /**
+     * @brief Format a float with the fewest significant digits that round-trip, see LOGGER_FLOAT_SHORTEST
+     * @return uint16_t length of formatted string, at most 15
+     */
+    static uint16_t formatFloatShortest(char* buf, float val);
+#endif
+};
@@ -0,0 +1,121 @@
+/**
+ * @file log_protocol.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Binary frames interleaved with the text output of the logger, shared by the firmware and the host tools
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+Text messages are sent as they are. Binary frames are interleaved with them as
+
+    0x00 | COBS(payload) | 0x00
+
+Formatted text never contains 0x00 and COBS removes every 0x00 from the payload, so a decoder reading from the start of
+the stream simply toggles between text and frame on every 0x00. Consecutive 0x00 open a single frame.
+
+A decoder joining a live stream, or missing a 0x00, is out of phase and has to resynchronize. The text is expected to
+contain no control byte other than \t \n \r and ESC, while a frame almost always does (its type follows the first
+COBS code), and a frame has a known type, the length of that type and at most LOG_FRAME_MAX_PAYLOAD bytes. So
+tools/logstream.h skips to the next 0x00 on a control byte in the text, and takes what fails as a frame for the text
+before a frame when it looks like text, the 0x00 ending it then starting the frame.
+
+The first byte of a payload is the frame type, the layout of the rest depends on the type. Multi-byte integers are
+little-endian, varints are LEB128 and signed varints are zigzag encoded before.
+
+LOG_FRAME_METRICS_DESC: [type][id][kind][name...]
+    Describes metric [id], one descriptor is sent before every LOG_FRAME_METRICS in turn.
+
+LOG_FRAME_METRICS:      [type][seq u16][flags][count][varint * count]
+    The values of metric 0..count-1. With LOG_FRAME_FLAG_KEY the varints are the values themselves, otherwise the
+    difference from the previous frame, so a decoder needs a key frame and no gap in [seq] to follow the deltas.
+
+LOG_FRAME_SYNC_REQUEST: [type][seq u16][host_time u64]
+    Sent by the host to the RX pin of the logger's uart, [host_time] is the UTC time in microseconds at which the last
+    byte of the frame is expected to reach the device.
+
+LOG_FRAME_SYNC_RESPONSE: [type][seq u16][host_time u64][device_time u32][device_hz u32]
+    The echo of a request with the device timestamp taken when its last byte was received. [device_time] uses the same
+    counter as the "[timestamp] " prefix of the text records, running at [device_hz] and wrapping at 2^32.
+
+LOG_FRAME_BOND: [type][link_seq u16][span_seq u16][part][parts][length u16]
+    Only on bonded links (Logger::init() with several uarts). Every chunk of the send buffer gets the next [span_seq]
+    and is split into [parts] parts, part i is sent on link i as this header followed by [length] raw bytes. [link_seq]
+    counts the parts sent on each link. The raw bytes of all parts in (span_seq, part) order are the logger output.
+
+LOG_FRAME_CHANNEL: [type][channel][seq][length u16]
+    Only behind a ChannelMux (channel_mux.h). Every chunk on the link is this header followed by [length] raw bytes of
+    virtual channel [channel], [seq] counts the chunks of the channel. The raw bytes of a channel in order are the output
+    of the logger attached to it.
+
+LOG_FRAME_CRC: [type][seq u16][length u16][crc u32]
+    Only with a CrcSink. Every region of the send buffer is this header followed by [length] raw bytes, [seq] counts
+    the regions. [crc] is the CRC-32 of the STM32 CRC unit over the raw bytes zero-padded to a multiple of 4, each group
+    of 4 taken as a little-endian word: polynomial 0x04C11DB7, initial value 0xFFFFFFFF, MSB first, no final xor. The
+    raw bytes of all regions in order are the logger output.
+*/
+
+#include <stdint.h>
+
+enum LogFrameType : uint8_t {
+    LOG_FRAME_METRICS_DESC = 0x01U,
+    LOG_FRAME_METRICS = 0x02U,
+    LOG_FRAME_SYNC_REQUEST = 0x03U,
+    LOG_FRAME_SYNC_RESPONSE = 0x04U,
+    LOG_FRAME_BOND = 0x05U,
+    LOG_FRAME_CHANNEL = 0x06U,
+    LOG_FRAME_CRC = 0x07U,
+};
+
+enum LogMetricKind : uint8_t {
+    LOG_METRIC_COUNTER = 0x00U,  // monotonic, wraps at 2^32
+    LOG_METRIC_GAUGE = 0x01U,    // signed 32-bit value
+};
+
+static constexpr uint8_t  LOG_FRAME_DELIMITER = 0x00U;
+static constexpr uint8_t  LOG_FRAME_FLAG_KEY = 0x01U;   // the values are absolute
+static constexpr uint16_t LOG_FRAME_MAX_PAYLOAD = 253U;  // COBS adds 1 byte per 254, plus 2 delimiters: 256 in total
+static constexpr uint8_t  LOG_VARINT_MAX_SIZE = 5U;      // for 32-bit values
+
+/**
+ * @brief Append an unsigned LEB128 varint
+ * @return uint8_t bytes written
+ */
+static inline uint8_t logPutVarint(uint8_t* buf, uint32_t value) {
+    uint8_t i = 0;
+    while (value >= 0x80U) {
+        buf[i++] = (uint8_t)(value | 0x80U);
+        value >>= 7;
+    }
+    buf[i++] = (uint8_t)value;
+    return i;
+}
+
+/**
+ * @brief Map a signed value to unsigned so that small magnitudes get short varints
+ */
+static inline uint32_t logZigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief Reverse logZigzag()
+ */
+static inline int32_t logUnzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1U);
+}
@@ -21,47 +21,15 @@
 
 #include "logger.h"
 
-Logger logger;
-
-/**
- * @brief Increase a half-word atomically
- */
-#define ATOMIC_INCH(VAL)                           \
-    while (__STREXH(__LDREXH(&(VAL)) + 1, &(VAL))) \
-        ;
-
-/**
- * @brief Decrease a half-word atomically
- */
-#define ATOMIC_DECH(VAL)                           \
-    while (__STREXH(__LDREXH(&(VAL)) - 1, &(VAL))) \
-        ;
-
-/**
- * @brief Initialize the Logger with a uart handle
- *
- * @param huart A uart handle initialized as follows
- *
- * 1. The `USE_HAL_UART_REGISTER_CALLBACKS` macro in `stm32f4xx_hal_conf.h` should be defined to `1U`
- *
- * 2. Enable UARTx global interrupt
- *
- * 3. The DMA and related interrupt should be enabled for the TX pin of the huart with following settings
- *    - `Normal` mode
- *    - Peripheral Increment Address `Disabled` and Memory Increment Address `Enabled`
- *    - Use Fifo `Disable`
- *    - Set Data Width of both Peripheral and Memory to `Byte`
- */
-void Logger::init(UART_HandleTypeDef* huart) {
-    m_uart = huart;
-    HAL_UART_RegisterCallback(m_uart, HAL_UART_TX_COMPLETE_CB_ID, transferCompletedCallback);
-}
-
 /**
  * @brief Enqueue a string into the send buffer
  * @note This method will be called in both main thread and ISRs, so it has to be thread-safe
  */
-void Logger::enqueue(char* str, uint16_t length) {
+template <typename Sink>
+void BasicLogger<Sink>::enqueue(const char* str, uint16_t length, uint8_t slot) {
+#if !LOGGER_DEADLINE_SLOTS
+    (void)slot;  // always NO_DEADLINE
+#endif
 
     ATOMIC_INCH(m_enqueue_guard);  // Start the enqueue progress
 
@@ -76,6 +44,9 @@ void Logger::enqueue(char* str, uint16_t length) {
     } while (__STREXH(new_write_pos, &m_write_pos));  // Set new write pos atomically
 
     if (write_pos != new_write_pos) {
+        if (m_consumer_count) {
+            overrunConsumers(write_pos, length);
+        }
 
         // There is enough space to enqueue the string, start to enqueue
         if (new_write_pos > write_pos) {
@@ -96,128 +67,313 @@ void Logger::enqueue(char* str, uint16_t length) {
                 m_send_buffer[write_pos++] = str[i++];
             }
         }
+#if LOGGER_DEADLINE_SLOTS
+        if (slot != NO_DEADLINE) {
+            // ready before the guard is released, so the sink always knows the record when it reaches it
+            m_deadlines[slot].start = advancePos(new_write_pos, SEND_BUFFER_SIZE - length);
+            m_deadlines[slot].length = length;
+            m_deadlines[slot].state = DEADLINE_READY;
+        }
+#endif
     } else {
         // The available space is not enough for this message. Discard message and simply increase m_missed_count for debugging
-        ATOMIC_INCH(m_missed_count);  // Increase the m_missed_count for debugging purpose
+        ATOMIC_INCW(m_missed_count);  // Increase the m_missed_count for debugging purpose
+#if LOGGER_DEADLINE_SLOTS
+        if (slot != NO_DEADLINE) {
+            m_deadlines[slot].state = DEADLINE_FREE;
+        }
+#endif
     }
     ATOMIC_DECH(m_enqueue_guard);     // Finish the enqueue progress
 
+    checkWatermarks();
     process();                        // Try to start transfer if it's called in main loop
 }
 
-void Logger::process() {
-    if (m_is_sending || isInISR()) {  // do nothing if dma has already been working or called in ISRs
-        return;
+/**
+ * @brief Claim a free deadline slot for the record, the deadline is set before the record can be reached by the sink
+ */
+template <typename Sink>
+void BasicLogger<Sink>::enqueueExpiring(const char* str, uint16_t length, uint32_t ttl) {
+#if LOGGER_DEADLINE_SLOTS
+    for (uint8_t i = 0; i < LOGGER_DEADLINE_SLOTS; i++) {
+        bool claimed;
+        do {
+            claimed = __LDREXB(&m_deadlines[i].state) == DEADLINE_FREE;
+            if (!claimed) {
+                __CLREX();
+                break;
+            }
+        } while (__STREXB(DEADLINE_WRITING, &m_deadlines[i].state));
+
+        if (claimed) {
+            m_deadlines[i].deadline = timestamp() + ttl;
+            enqueue(str, length, i);
+            return;
+        }
     }
-    startTransfer();  // Start send out data in the buffer
+#else
+    (void)ttl;
+#endif
+    enqueue(str, length, NO_DEADLINE);  // all slots taken, send it whatever its age
 }
 
 /**
- * @brief try to start transfer if any data is ready
+ * @brief A lossy consumer whose oldest unread byte is in the reserved region loses the bytes of the region it has not
+ * read. Its cursor is pushed one byte past the region, so a full buffer is never mistaken for an empty one.
+ * @note Called before the region is written, so consume() can tell from the cursor if its copy was overwritten
  */
-void Logger::startTransfer() {
-    uint16_t send_pos = m_write_pos;
+template <typename Sink>
+void BasicLogger<Sink>::overrunConsumers(uint16_t write_pos, uint16_t length) {
+    for (uint8_t i = 0; i < m_consumer_count; i++) {
+        if (!m_consumer_lossy[i]) {
+            continue;
+        }
+        uint16_t new_pos = advancePos(write_pos, length + 1U);
+        uint16_t pos, distance;
+        do {
+            pos = __LDREXH(&m_consumer_pos[i]);
+            distance = usedSpace(pos, write_pos);  // from write_pos forward to the cursor
+            if (distance == 0U || distance > length) {
+                __CLREX();
+                break;
+            }
+        } while (__STREXH(new_pos, &m_consumer_pos[i]));
 
-    // Ensure that all enqueue progresses have been finished before send_pos by checking m_enqueue_guard, if not,
-    // try to start the transfer in next entry
-    if (send_pos != m_read_pos && m_enqueue_guard == 0) {
-        m_is_sending = true;
-        if (send_pos > m_read_pos) {
-            // the data to send is in a continuous region, send all data
-            m_new_read_pos = send_pos;
-            HAL_UART_Transmit_DMA(m_uart, (const uint8_t*)(&m_send_buffer[m_read_pos]), send_pos - m_read_pos);
-        } else {
-            // the data cross the end of the buffer. Send the data to the end, and the rest will be sent in next ISR
-            m_new_read_pos = 0;
-            HAL_UART_Transmit_DMA(m_uart, (const uint8_t*)(&m_send_buffer[m_read_pos]), SEND_BUFFER_SIZE - m_read_pos);
+        if (distance != 0U && distance <= length) {
+            uint32_t skipped;
+            do {
+                skipped = __LDREXW(&m_consumer_skipped[i]) + usedSpace(new_pos, pos);
+            } while (__STREXW(skipped, &m_consumer_skipped[i]));
         }
-        __HAL_DMA_DISABLE_IT(m_uart->hdmatx, DMA_IT_HT);  // Disable the half transfer interrupt
-    } else {
-        m_is_sending = false;                             // no more data to send
     }
 }
 
 /**
- * @brief uart transfer complete callback, need to be modified if there are mutiple logger instances
+ * @brief Register a consumer at the current write pos
  */
-void Logger::transferCompletedCallback(UART_HandleTypeDef* huart) {
-    // Add other instances here if multiple loggers are used
-    if (huart == logger.getUARTHandle()) {
-        logger.m_read_pos = logger.m_new_read_pos;
-        logger.startTransfer();
+template <typename Sink>
+uint8_t BasicLogger<Sink>::addConsumer(bool lossy) {
+    if (m_consumer_count == MAX_CONSUMERS) {
+        return INVALID_CONSUMER;
     }
+    uint8_t id = m_consumer_count;
+    m_consumer_pos[id] = m_write_pos;
+    m_consumer_skipped[id] = 0U;
+    m_consumer_lossy[id] = lossy;
+    m_consumer_count = id + 1U;  // visible to the producers once the cursor is set
+    return id;
 }
 
 /**
- * @brief Format a signed number
+ * @brief Copy the unread data of a consumer. A lossy consumer commits its cursor with LDREX/STREX, so a push by a
+ * producer during the copy is detected and the copy is dropped
  */
-uint16_t Logger::formatSignedNum(char* buf, int32_t val) {
-    char* start = buf;
-    if (val < 0) {
-        val = -val;
-        *(buf++) = '-';
+template <typename Sink>
+uint16_t BasicLogger<Sink>::consume(uint8_t id, char* buffer, uint16_t size) {
+    uint16_t end = m_write_pos;
+    if (m_enqueue_guard != 0) {
+        return 0U;  // some data before end may not be written yet, try again in next entry
+    }
+
+    uint16_t pos = m_consumer_pos[id];
+    uint16_t length = usedSpace(end, pos);
+    length = length > size ? size : length;
+    for (uint16_t i = 0, read_pos = pos; i < length; i++) {
+        buffer[i] = m_send_buffer[read_pos];
+        read_pos = advancePos(read_pos);
+    }
+
+    if (!m_consumer_lossy[id]) {
+        m_consumer_pos[id] = advancePos(pos, length);
+        checkWatermarks();
+        return length;
     }
-    uint16_t length = formatUnsignedNum(buf, (uint32_t)val);
-    return buf + length - start;
+    do {
+        if (__LDREXH(&m_consumer_pos[id]) != pos) {
+            __CLREX();
+            return 0U;  // overrun during the copy, the cursor has been pushed to the oldest valid data
+        }
+    } while (__STREXH(advancePos(pos, length), &m_consumer_pos[id]));
+    return length;
 }
 
 /**
- * @brief Format an unsigned number
+ * @brief Encode a binary frame and enqueue it as a whole
  */
-uint16_t Logger::formatUnsignedNum(char* buf, uint32_t val) {
-    uint8_t i = 0;
-    do {
-        buf[i++] = val % 10 + '0';
-        val /= 10;
-    } while (val);
-
-    // swap
-    uint8_t start = 0, end = i - 1;
-    while (start < end) {
-        char temp = buf[start];
-        buf[start++] = buf[end];
-        buf[end--] = temp;
+template <typename Sink>
+void BasicLogger<Sink>::enqueueFrame(const uint8_t* payload, uint16_t length) {
+    char frame_buffer[SINGLE_MSG_SIZE];
+    assert_param(length <= LOG_FRAME_MAX_PAYLOAD);
+    enqueue(frame_buffer, encodeFrame(frame_buffer, payload, length));
+}
+
+template <typename Sink>
+void BasicLogger<Sink>::process() {
+    m_sink.poll();
+    if (m_is_sending || isInISR()) {  // do nothing if the sink has already been working or called in ISRs
+        return;
     }
-    return i;
+    startTransfer();  // Start send out data in the buffer
+    checkWatermarks();  // a sink consuming the data right away may have drained the buffer
 }
 
 /**
- * @brief Format a double number with 3 decimal places
+ * @brief The check and the WFI are done with the interrupts masked, so an interrupt coming right after the check still
+ * wakes the core instead of being handled before the WFI and then waiting for the next one
  */
-uint16_t Logger::formatDouble(char* buf, double val) {
-    char* start = buf;
-    if (val < 0) {
-        *(buf++) = '-';
-        val = -val;
+template <typename Sink>
+void BasicLogger<Sink>::sleep() {
+    process();
+    uint32_t primask = logPortDisableIrq();
+    if (canSleep()) {
+        logPortWaitForInterrupt();
     }
+    logPortRestoreIrq(primask);  // the pending interrupt is handled here
+}
 
-    double rounding = 0.5 * 0.001;  // For 3 decimal places
-    val += rounding;
-
-    uint32_t int_part = (uint32_t)val;
-    double   remainder = val - int_part;
-    uint16_t length = formatUnsignedNum(buf, int_part);
-    buf += length;
+template <typename Sink>
+bool BasicLogger<Sink>::suspend(uint32_t timeout) {
+    m_suspended = true;  // the completion of the region in flight doesn't start the next one
+    startTimestamp();    // the timeout is in cycles, init() only starts the counter for timestamps and deadlines
+    uint32_t start = timestamp();
+    while (m_is_sending) {
+        if (timestamp() - start >= timeout) {
+            return false;
+        }
+        m_sink.poll();  // the sinks completed by polling, the others by their interrupt
+        uint32_t primask = logPortDisableIrq();
+        if (m_is_sending) {
+            logPortWaitForInterrupt();  // the SysTick wakes up the polled ones
+        }
+        logPortRestoreIrq(primask);
+    }
+    return true;
+}
 
-    *(buf++) = '.';
+template <typename Sink>
+void BasicLogger<Sink>::resume() {
+    m_suspended = false;
+    process();
+}
 
-    for (uint8_t i = 0; i < 3; i++) {
-        remainder *= 10;
-        *(buf++) = (char)remainder + '0';
-        remainder -= (char)remainder;
+/**
+ * @brief Only the context winning the switch of m_congested calls the callback, so every crossing is notified once
+ */
+template <typename Sink>
+void BasicLogger<Sink>::checkWatermarks() {
+    void (*callback)(bool, void*) = m_watermark_callback;
+    if (callback == nullptr) {
+        return;
     }
-    return buf - start;
+    uint16_t fill = getFillLevel();
+    uint8_t  congested, next;
+    do {
+        congested = __LDREXB(&m_congested);
+        next = congested ? fill > m_low_watermark : fill >= m_high_watermark;
+        if (next == congested) {
+            __CLREX();
+            return;
+        }
+    } while (__STREXB(next, &m_congested));
+    callback(next, m_watermark_context);
 }
 
 /**
- * @brief Copy a string(ends with '\0') and return the length
- * @return length of the string
+ * @brief try to start transfer if any data is ready
  */
-uint16_t Logger::_strcpy(char* des, const char* src) {
-    uint16_t i = 0;
-    while (src[i] != '\0') {
-        des[i] = src[i];
-        ++i;
+template <typename Sink>
+void BasicLogger<Sink>::startTransfer() {
+    uint16_t send_pos = m_write_pos;
+
+    // Ensure that all enqueue progresses have been finished before send_pos by checking m_enqueue_guard, if not,
+    // try to start the transfer in next entry. A sink consuming the data right away is fed until the buffer is empty.
+    while (send_pos != m_read_pos && m_enqueue_guard == 0 && !m_suspended) {
+        m_is_sending = true;
+#if LOGGER_DEADLINE_SLOTS
+        send_pos = applyDeadlines(send_pos);
+        if (send_pos == m_read_pos) {
+            send_pos = m_write_pos;  // all the data were expired records
+            continue;
+        }
+#endif
+        uint16_t read_pos = m_read_pos, length;
+        if (send_pos > read_pos) {
+            // the data to send is in a continuous region, send all data
+            m_new_read_pos = send_pos;
+            length = send_pos - read_pos;
+        } else {
+            // the data cross the end of the buffer. Send the data to the end, and the rest will be sent next
+            m_new_read_pos = 0;
+            length = SEND_BUFFER_SIZE - read_pos;
+        }
+        if (!m_sink.transmit(&m_send_buffer[read_pos], length)) {
+            return;  // the sink calls transferCompleted() when it's done
+        }
+        m_read_pos = m_new_read_pos;
+        send_pos = m_write_pos;
     }
-    return i;
+    m_is_sending = false;  // no more data to send
+}
+
+#if LOGGER_DEADLINE_SLOTS
+
+/**
+ * @brief The records are only checked when the region starting with them is built, so a record that has been handed to
+ * the sink is always sent in full. A dropped record is released right away, like a sent one.
+ */
+template <typename Sink>
+uint16_t BasicLogger<Sink>::applyDeadlines(uint16_t send_pos) {
+    uint16_t read_pos = m_read_pos, end;
+    bool     dropped;
+    do {
+        uint16_t pending = usedSpace(send_pos, read_pos);
+        end = pending;
+        dropped = false;
+        for (uint8_t i = 0; i < LOGGER_DEADLINE_SLOTS; i++) {
+            Deadline& slot = m_deadlines[i];
+            if (slot.state != DEADLINE_READY) {
+                continue;
+            }
+            uint16_t distance = usedSpace(slot.start, read_pos);
+            if (distance >= pending) {
+                continue;  // enqueued after send_pos was taken
+            }
+            if (distance == 0U) {
+                dropped = (int32_t)(timestamp() - slot.deadline) > 0;
+                if (dropped) {
+                    read_pos = advancePos(read_pos, slot.length);
+                    m_expired_count++;
+                    m_expired_bytes += slot.length;
+                }
+                slot.state = DEADLINE_FREE;  // either dropped or about to be sent
+                if (dropped) {
+                    break;  // look again from the next record
+                }
+            } else if (distance < end) {
+                end = distance;
+            }
+        }
+    } while (dropped);
+
+    m_read_pos = read_pos;
+    return advancePos(read_pos, end);
 }
+
+#endif
+
+/**
+ * @brief The sink has sent the region, release it and send the next one
+ */
+template <typename Sink>
+void BasicLogger<Sink>::transferCompleted(void* context) {
+    BasicLogger* self = static_cast<BasicLogger*>(context);
+    self->m_read_pos = self->m_new_read_pos;
+    self->checkWatermarks();
+    self->startTransfer();
+}
+
+// Instantiate the logger for the sink in use, add other sinks here if more loggers are used
+template class BasicLogger<LOGGER_SINK>;
+
+Logger logger;
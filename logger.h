@@ -26,6 +26,8 @@ This is a thread-safe and non-blocking logger with a small footprint STM32 appli
 messages into an internal circular send buffer first, and then send out all data via UART with DMA mode automatically.
 LDREX/STREX instructions are used to exclusively access the shared buffer, so the interrupt is never disabled.
 
+The way out of the device is the Sink template parameter, UART-DMA by default, see logger_sinks.h for the others.
+
 Usage:
 This logger can log message in any number and in any order. If you need log your own message type, please overwrite the
 formatSingle function
@@ -38,27 +40,64 @@ logger.warning("Sensor A: ", float_value, "Sensor B: ", int_value);
 logger.error(uint_value, " is bigger than ", uint_value);
 */
 
-#include "stm32f4xx_hal.h"
+#include "logger_sinks.h"
+
+/**
+ * @brief Prefix the records of logln(), info(), warning() and error() with "[timestamp] "
+ * @note The timestamp is the DWT cycle counter, tools/logdecode.cpp converts it to UTC with the time sync frames
+ */
+#ifndef LOGGER_TIMESTAMPS
+#define LOGGER_TIMESTAMPS 0
+#endif
+
+/**
+ * @brief Records with a deadline that can wait in the send buffer at once, see Logger::loglnExpiring()
+ * @note A record beyond that is sent whatever its age. 0 compiles the deadlines out: no cycle counter is started for
+ * them, loglnExpiring() logs plain records and the sink is not slowed down by the slots
+ */
+#ifndef LOGGER_DEADLINE_SLOTS
+#define LOGGER_DEADLINE_SLOTS 0
+#endif
+
+/**
+ * @brief Increase a half-word atomically
+ */
+#define ATOMIC_INCH(VAL)                           \
+    while (__STREXH(__LDREXH(&(VAL)) + 1, &(VAL))) \
+        ;
 
-class Logger {
+/**
+ * @brief Increase a word atomically
+ */
+#define ATOMIC_INCW(VAL)                           \
+    while (__STREXW(__LDREXW(&(VAL)) + 1, &(VAL))) \
+        ;
+
+/**
+ * @brief Decrease a half-word atomically
+ */
+#define ATOMIC_DECH(VAL)                           \
+    while (__STREXH(__LDREXH(&(VAL)) - 1, &(VAL))) \
+        ;
+
+template <typename Sink>
+class BasicLogger : public LogFormatter {
 
    public:
     /**
-     * @brief Initialize the Logger with a uart handle
-     *
-     * @param huart A uart handle initialized as follows
-     *
-     * 1. The `USE_HAL_UART_REGISTER_CALLBACKS` macro in `stm32f4xx_hal_conf.h` should be defined to `1U`
+     * @brief Initialize the sink of the Logger, the arguments are passed to Sink::init()
      *
-     * 2. Enable UARTx global interrupt
-     *
-     * 3. The DMA and related interrupt should be enabled for the TX pin of the huart with following settings
-     *    - `Normal` mode
-     *    - Peripheral Increment Address `Disabled` and Memory Increment Address `Enabled`
-     *    - Use Fifo `Disable`
-     *    - Set Data Width of both Peripheral and Memory to `Byte`
+     * logger.init(&huart2);           // UartDmaSink, see UartDmaSink::init() for the settings of the huart
+     * logger.init(huarts, 2);         // UartDmaSink with 2 bonded uarts
      */
-    void init(UART_HandleTypeDef* huart);
+    template <typename... A>
+    void init(A... args) {
+        m_sink.init(args...);
+        m_sink.bind(transferCompleted, this, m_send_buffer, SEND_BUFFER_SIZE);
+        if (LOGGER_TIMESTAMPS || LOGGER_DEADLINE_SLOTS) {
+            startTimestamp();
+        }
+    }
 
     /**
      * @brief Start transfer if any message is ready
@@ -66,6 +105,71 @@ class Logger {
      */
     void process();
 
+    /**
+     * @brief Process, then sleep until the next interrupt unless the logger has work for the main loop
+     * @note For the end of the main loop when the application has nothing else to do. The DMA keeps draining the send
+     * buffer during the sleep, its completion interrupt chains the next region by itself. Not with the interrupts
+     * masked: the WFI still returns but the pending interrupt isn't handled, the PRIMASK of the caller is kept
+     */
+    void sleep();
+
+    /**
+     * @brief If the main loop may sleep as far as the logger is concerned: the data are being sent by interrupts or
+     * there are none. A record enqueued by an ISR while the sink was idle needs process(), the ISR wakes the core anyway
+     */
+    bool canSleep() {
+        return m_is_sending || m_suspended || m_write_pos == m_read_pos;
+    }
+
+    /**
+     * @brief If everything has been sent and the sink is idle
+     */
+    bool isIdle() {
+        return !m_is_sending && m_write_pos == m_read_pos;
+    }
+
+    /**
+     * @brief Prepare the Stop mode: no region is started any more and the one in flight is finished, sleeping
+     *
+     * @param timeout in timestamp() ticks (CPU cycles), to wait for the region in flight
+     * @return true if the sink is idle and the Stop mode can be entered, false if the region is still being sent
+     * @note The records enqueued while suspended are kept and sent by resume(), as long as there is space. A region in
+     * flight is never cut, the UART would send a broken byte when its clock stops. Not with the interrupts masked: the
+     * completion interrupt wouldn't run before m_is_sending is checked again, so it would only return on the timeout
+     *
+     * logger.suspend(SystemCoreClock / 10U);
+     * HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+     * SystemClock_Config();
+     * logger.resume();
+     */
+    bool suspend(uint32_t timeout);
+
+    /**
+     * @brief Resume the transfers after suspend(), once the clocks are back
+     */
+    void resume();
+
+    /**
+     * @brief Change the clocks between two regions, then let the sink adapt to them, e.g. a new baud rate divisor
+     *
+     * @param set_clock changes the clocks, called once the region in flight is finished and before the next one starts
+     * @param timeout in timestamp() ticks (CPU cycles), to wait for the region in flight
+     * @return false if the region was not finished in time, then the clocks are left as they are
+     * @note The records enqueued meanwhile are kept. The timestamps are CPU cycles, so they tick at the new rate
+     *
+     * logger.changeClock([] { SystemClock_Config_48MHz(); }, SystemCoreClock / 10U);
+     */
+    template <typename F>
+    bool changeClock(F set_clock, uint32_t timeout) {
+        bool quiet = suspend(timeout);
+        if (quiet) {
+            set_clock();
+            m_sink.clockChanged();
+        }
+        resume();
+        return quiet;
+    }
+
     /**
      * @brief Format and Log data to the send buffer
      */
@@ -78,15 +182,16 @@ class Logger {
     /**
      * @brief Generate function with a header and an EOL
      */
-#define GENERATE_FUNC(NAME)                                               \
-    template <typename... T>                                              \
-    void NAME(T... args) {                                                \
-        char     line_buffer[SINGLE_MSG_SIZE];                            \
-        uint16_t total_length = _strcpy(line_buffer, NAME##_str);         \
-        total_length += formatMulti(&line_buffer[total_length], args...); \
-        line_buffer[total_length++] = '\n';                               \
-        assert_param(total_length <= SINGLE_MSG_SIZE);                    \
-        enqueue(line_buffer, total_length);                               \
+#define GENERATE_FUNC(NAME)                                                            \
+    template <typename... T>                                                           \
+    void NAME(T... args) {                                                             \
+        char     line_buffer[SINGLE_MSG_SIZE];                                         \
+        uint16_t total_length = LOGGER_TIMESTAMPS ? formatTimestamp(line_buffer) : 0U; \
+        total_length += _strcpy(&line_buffer[total_length], NAME##_str);               \
+        total_length += formatMulti(&line_buffer[total_length], args...);              \
+        line_buffer[total_length++] = '\n';                                            \
+        assert_param(total_length <= SINGLE_MSG_SIZE);                                 \
+        enqueue(line_buffer, total_length);                                            \
     }
 
     /**
@@ -98,138 +203,177 @@ class Logger {
     GENERATE_FUNC(error);
 
     /**
-     * @brief Get the uart handle of the logger
+     * @brief Like logln(), but the record is dropped instead of sent if it's still in the send buffer [ttl] ticks later
+     *
+     * logger.loglnExpiring(SystemCoreClock / 10U, "speed=", speed);    // worthless after 100 ms
+     *
+     * @param ttl in timestamp() ticks (CPU cycles), below 2^31
      */
-    UART_HandleTypeDef* getUARTHandle() {
-        return m_uart;
+    template <typename... T>
+    void loglnExpiring(uint32_t ttl, T... args) {
+        char     line_buffer[SINGLE_MSG_SIZE];
+        uint16_t total_length = LOGGER_TIMESTAMPS ? formatTimestamp(line_buffer) : 0U;
+        total_length += formatMulti(&line_buffer[total_length], args...);
+        line_buffer[total_length++] = '\n';
+        assert_param(total_length <= SINGLE_MSG_SIZE);
+        enqueueExpiring(line_buffer, total_length, ttl);
+    }
+
+    /**
+     * @brief Get the sink of the logger
+     */
+    Sink& getSink() {
+        return m_sink;
     }
 
     /**
      * @brief Get the count of missed messages which are unable to be cached into the circular buffer
      * @note When missed_count is not 0, try to increase the [SEND_BUFFER_SIZE] or  the uart Baud rate
      */
-    uint16_t getMissedCount() {
+    uint32_t getMissedCount() {
         return m_missed_count;
     }
 
-   private:
     /**
-     * @brief enqueue a formatted string to the circular buffer
-     *
-     * @param str formatted string
-     * @param length length of the string
+     * @brief Get the free space in the send buffer, in bytes
+     * @note The value is a snapshot, other contexts may enqueue or send data right after it's read
      */
-    void enqueue(char* str, uint16_t length);
+    uint16_t getAvailableSpace() {
+        return availableSpace(m_write_pos);
+    }
 
     /**
-     *@brief Format multiple messages
+     * @brief Get the bytes waiting in the send buffer, behind the slowest of the sink and the non-lossy consumers
+     * @note As cheap as getAvailableSpace(), fill level + available space = SEND_BUFFER_SIZE - 1
      */
-    template <typename T, typename... Ts>
-    static uint16_t formatMulti(char* pos, T first, Ts... rest) {
-        uint16_t length = formatSingle(pos, first);
-        return length + formatMulti(pos + length, rest...);
+    uint16_t getFillLevel() {
+        return SEND_BUFFER_SIZE - 1U - availableSpace(m_write_pos);
     }
+
     /**
-     * @brief formatMulti recursion end
+     * @brief Get notified when the send buffer fills up and when it has drained again
+     *
+     * @param high the callback gets true when the fill level reaches [high] bytes
+     * @param low then it gets false when the fill level is back to [low] bytes or less, below [high]
+     * @param callback called by the context that crossed the watermark, which can be an ISR, so keep it short (e.g.
+     * lower the telemetry rate or set a flag). nullptr to disable
+     *
+     * logger.setWatermarks(384U, 128U, [](bool congested, void*) { telemetry_divider = congested ? 10U : 1U; });
      */
-    static inline uint16_t formatMulti(char* pos) {
-        return 0U;
+    void setWatermarks(uint16_t high, uint16_t low, void (*callback)(bool congested, void* context),
+                       void* context = nullptr) {
+        assert_param(low < high && high < SEND_BUFFER_SIZE);
+        m_watermark_callback = nullptr;  // not called with half-set thresholds
+        m_high_watermark = high;
+        m_low_watermark = low;
+        m_watermark_context = context;
+        m_congested = 0U;
+        m_watermark_callback = callback;
     }
 
     /**
-     * @brief Format a signed value
+     * @brief If the fill level has reached the high watermark and not yet come back to the low one
      */
-    static inline uint16_t formatSingle(char* pos, int32_t value) {
-        return formatSignedNum(pos, value);
-    }
-    static inline uint16_t formatSingle(char* pos, int16_t value) {
-        return formatSignedNum(pos, value);
-    }
-    static inline uint16_t formatSingle(char* pos, int8_t value) {
-        return formatSignedNum(pos, value);
-    }
-    static inline uint16_t formatSingle(char* pos, int value) {
-        return formatSignedNum(pos, value);
+    bool isCongested() {
+        return m_congested;
     }
 
     /**
-     * @brief Format an unsigned value
+     * @brief Get the count of records dropped because their deadline passed before they could be sent
      */
-    static inline uint16_t formatSingle(char* pos, uint32_t value) {
-        return formatUnsignedNum(pos, value);
-    }
-    static inline uint16_t formatSingle(char* pos, uint16_t value) {
-        return formatUnsignedNum(pos, value);
-    }
-    static inline uint16_t formatSingle(char* pos, uint8_t value) {
-        return formatUnsignedNum(pos, value);
-    }
-    static inline uint16_t formatSingle(char* pos, unsigned int value) {
-        return formatUnsignedNum(pos, value);
+    uint32_t getExpiredCount() {
+        return m_expired_count;
     }
 
     /**
-     * @brief Format a float value
+     * @brief Get the bytes of the expired records, the link time given to fresher data
      */
-    static inline uint16_t formatSingle(char* pos, float value) {
-        return formatDouble(pos, value);
+    uint32_t getExpiredBytes() {
+        return m_expired_bytes;
     }
 
     /**
-     * @brief Format a double value
+     * @brief enqueue a formatted string to the circular buffer
+     *
+     * @param str formatted string
+     * @param length length of the string
      */
-    static inline uint16_t formatSingle(char* pos, double value) {
-        return formatDouble(pos, value);
+    void enqueue(const char* str, uint16_t length) {
+        enqueue(str, length, NO_DEADLINE);
     }
 
     /**
-     * @brief Format a string
+     * @brief enqueue a record which is dropped if it has not been handed to the sink [ttl] ticks later
+     * @note The record is sent as a plain one when all LOGGER_DEADLINE_SLOTS are taken. The consumers get it anyway
      */
-    static inline uint16_t formatSingle(char* pos, const char* str) {
-        return _strcpy(pos, str);
-    }
+    void enqueueExpiring(const char* str, uint16_t length, uint32_t ttl);
 
     /**
-     * @brief Format a char
+     * @brief Enqueue a binary frame, see log_protocol.h for the format
+     *
+     * @param payload frame type followed by the frame data
+     * @param length length of the payload, up to LOG_FRAME_MAX_PAYLOAD
      */
-    static inline uint16_t formatSingle(char* pos, char cha) {
-        *pos = cha;
-        return 1;
-    }
+    void enqueueFrame(const uint8_t* payload, uint16_t length);
 
     /**
-     * @brief Start transfer to uart if any data is ready in the send buffer
+     * @brief Add a consumer reading the same data as the sink, with its own cursor
+     *
+     * @param lossy a lossy consumer never holds back the producers, when it falls a whole buffer behind its oldest data
+     * are overwritten and its cursor is pushed ahead. The space read by a non-lossy consumer is only reclaimed when the
+     * sink and all non-lossy consumers have read it.
+     * @return uint8_t id of the consumer, or INVALID_CONSUMER if there are already MAX_CONSUMERS
+     * @note The consumer starts with the data enqueued after this call. Add the consumers at init.
      */
-    void startTransfer();
+    uint8_t addConsumer(bool lossy);
+
+    /**
+     * @brief Copy unread data of a consumer and advance its cursor
+     *
+     * @return uint16_t bytes copied, up to [size]. 0 when there is nothing to read, or when a lossy consumer has been
+     * overrun during the copy, then the copy is discarded and the skipped bytes are counted
+     * @note Call it from a single context per consumer, usually the main loop
+     */
+    uint16_t consume(uint8_t id, char* buffer, uint16_t size);
 
     /**
-     * @brief message transfer completed ISR
+     * @brief Get the bytes a lossy consumer has lost because it was overrun
      */
-    static void transferCompletedCallback(UART_HandleTypeDef* huart);
+    uint32_t getSkippedCount(uint8_t id) {
+        return m_consumer_skipped[id];
+    }
+
+    static constexpr uint16_t SEND_BUFFER_SIZE = 512U;  // The length of the send buffer
+    static constexpr uint8_t  INVALID_CONSUMER = 0xFFU;
 
+   private:
     /**
-     * @brief Format an unsigned value
-     * @return uint16_t length of formatted string
+     * @brief Start transfer to the sink if any data is ready in the send buffer
      */
-    static uint16_t formatUnsignedNum(char* buf, uint32_t val);
+    void startTransfer();
 
+#if LOGGER_DEADLINE_SLOTS
     /**
-     * @brief Format a signed value
-     * @return uint16_t length of formatted string
+     * @brief Drop the expired records at the read pos and stop the next region before the next record with a deadline
+     * @return uint16_t the end of the next region
      */
-    static uint16_t formatSignedNum(char* buf, int32_t val);
+    uint16_t applyDeadlines(uint16_t send_pos);
+#endif
 
     /**
-     * @brief Format a decimal value
-     * @return uint16_t length of formatted string
+     * @brief Notify the watermark callback if the fill level crossed the watermark of the current state
      */
-    static uint16_t formatDouble(char* buf, double val);
+    void checkWatermarks();
 
     /**
-     * @brief Copy a string(ends with '\0') and return the length
-     * @return length of the string
+     * @brief enqueue a string, and track it in a deadline slot unless [slot] is NO_DEADLINE
      */
-    static uint16_t _strcpy(char* des, const char* src);
+    void enqueue(const char* str, uint16_t length, uint8_t slot);
+
+    /**
+     * @brief The sink has sent the region, called by the sink, usually in its ISR
+     */
+    static void transferCompleted(void* context);
 
     /**
      * @brief If caller is in an ISR
@@ -239,13 +383,32 @@ class Logger {
     }
 
     /**
-     * @brief Available space with write_pos in the send buffer
+     * @brief Available space with write_pos in the send buffer, behind the slowest of the sink and the non-lossy
+     * consumers
      */
     inline uint16_t availableSpace(uint16_t write_pos) {
-        // one slot is always empty
-        return write_pos >= m_read_pos ? SEND_BUFFER_SIZE - (write_pos - m_read_pos) - 1U : m_read_pos - write_pos - 1U;
+        uint16_t used = usedSpace(write_pos, m_read_pos);
+        for (uint8_t i = 0; i < m_consumer_count; i++) {
+            if (!m_consumer_lossy[i]) {
+                uint16_t consumer_used = usedSpace(write_pos, m_consumer_pos[i]);
+                used = consumer_used > used ? consumer_used : used;
+            }
+        }
+        return SEND_BUFFER_SIZE - used - 1U;  // one slot is always empty
+    }
+
+    /**
+     * @brief Bytes between a read pos and write_pos
+     */
+    static inline uint16_t usedSpace(uint16_t write_pos, uint16_t read_pos) {
+        return write_pos >= read_pos ? write_pos - read_pos : SEND_BUFFER_SIZE - (read_pos - write_pos);
     }
 
+    /**
+     * @brief Push the lossy consumers out of the region about to be overwritten
+     */
+    void overrunConsumers(uint16_t write_pos, uint16_t length);
+
     /**
      * @brief Advance pos in the circular buffer
      */
@@ -253,27 +416,58 @@ class Logger {
         return (pos + step) % SEND_BUFFER_SIZE;
     }
 
-   public:
-    volatile uint16_t m_read_pos;      // the read pos of the circular buffer, only modified in DMA ISR
-    volatile uint16_t m_new_read_pos;  // the new read_pos to be set
-
-   private:
     static constexpr const char* logln_str = "";  // headers for different log function
     static constexpr const char* info_str = "Info: ";
     static constexpr const char* warning_str = "Warning: ";
     static constexpr const char* error_str = "Error: ";
 
-    static constexpr uint16_t SEND_BUFFER_SIZE = 512U;  // The length of the send buffer
-    static constexpr uint16_t SINGLE_MSG_SIZE = 256U;   // The maximum size of a single log message
-
-    volatile char m_send_buffer[SEND_BUFFER_SIZE];      // all log data are cached here before send via uart
-    volatile bool m_is_sending = 0U;                    // indicate if the dma is sending out the log data
+    volatile char m_send_buffer[SEND_BUFFER_SIZE];      // all log data are cached here before send via the sink
+    volatile bool m_is_sending = 0U;                    // indicate if the sink is sending out the log data
+    volatile bool m_suspended = false;                  // no region is started while it's set, see suspend()
 
+    volatile uint16_t m_read_pos = 0U;                  // the read pos of the circular buffer, only modified by the sink
+    volatile uint16_t m_new_read_pos = 0U;              // the new read_pos to be set
     volatile uint16_t m_write_pos = 0U;                 // the write_pos can be modified by both main thread and ISRs
     volatile uint16_t m_enqueue_guard = 0U;             // When it's 0, all data have been enqueued and ready to send
-    volatile uint16_t m_missed_count = 0U;              // A counter for missed messages when the send buffer is full
+    volatile uint32_t m_missed_count = 0U;              // A counter for missed messages when the send buffer is full
+
+    static constexpr uint8_t MAX_CONSUMERS = 2U;  // consumers besides the sink
+
+    volatile uint16_t m_consumer_pos[MAX_CONSUMERS];      // read pos of each consumer
+    volatile uint32_t m_consumer_skipped[MAX_CONSUMERS];  // bytes lost by each lossy consumer
+    bool              m_consumer_lossy[MAX_CONSUMERS];
+    uint8_t           m_consumer_count = 0U;
 
-    UART_HandleTypeDef* m_uart;                         // Uart handle
+    /**
+     * @brief A record with a deadline waiting in the send buffer
+     */
+    struct Deadline {
+        volatile uint8_t state = DEADLINE_FREE;
+        uint16_t         start;  // pos of the record in the send buffer
+        uint16_t         length;
+        uint32_t         deadline;  // timestamp() after which the record is not worth sending
+    };
+
+    static constexpr uint8_t NO_DEADLINE = 0xFFU;
+    static constexpr uint8_t DEADLINE_FREE = 0U;     // the slot can be claimed by a producer
+    static constexpr uint8_t DEADLINE_WRITING = 1U;  // claimed, the record is being enqueued
+    static constexpr uint8_t DEADLINE_READY = 2U;    // the record is in the send buffer
+
+    void (*volatile m_watermark_callback)(bool, void*) = nullptr;
+    void*            m_watermark_context = nullptr;
+    uint16_t         m_high_watermark = 0U;
+    uint16_t         m_low_watermark = 0U;
+    volatile uint8_t m_congested = 0U;  // 1 between the high and the low watermark, switched with LDREXB/STREXB
+
+#if LOGGER_DEADLINE_SLOTS
+    Deadline m_deadlines[LOGGER_DEADLINE_SLOTS];
+#endif
+    uint32_t m_expired_count = 0U;  // only modified by the sink side
+    uint32_t m_expired_bytes = 0U;
+
+    Sink m_sink;
 };
 
+using Logger = BasicLogger<LOGGER_SINK>;
+
 extern Logger logger;
\ No newline at end of file
@@ -0,0 +1,153 @@
+/**
+ * @file logger_port.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief The few target primitives the logger relies on, for STM32 and for a host build
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+On STM32 this is the HAL and the DWT cycle counter. Define LOGGER_HOST to build the ring and the formatters on a PC,
+e.g. to benchmark them with a FileSink: LDREX/STREX are emulated with a compare-and-swap against the value loaded by
+the last LDREX of the thread, which keeps the enqueue lock-free across threads (an ABA on the 16-bit positions would
+need 64K bytes to be enqueued between the load and the store). A signal handler can stand in for an ISR: it sets
+log_host_ipsr while it runs and calls __CLREX() before it returns, like the exception return clearing the exclusive
+monitor, so the STREX of the context it preempted fails (see bench/workload_bench.cpp).
+
+g++ -std=c++14 -O2 -DLOGGER_HOST logger.cpp log_format.cpp logger_sinks.cpp app.cpp
+*/
+
+#ifdef LOGGER_HOST
+
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+
+#define assert_param(expr) assert(expr)
+
+static thread_local uint32_t log_host_exclusive;       // the value loaded by the last LDREX of this thread
+static thread_local bool     log_host_exclusive_open;  // an LDREX not yet followed by a STREX or a CLREX
+static thread_local uint32_t log_host_ipsr;            // nonzero in a signal handler standing in for an ISR
+
+template <typename T>
+static inline T logHostLoadExclusive(volatile T* addr) {
+    T value = __atomic_load_n(addr, __ATOMIC_ACQUIRE);
+    log_host_exclusive = value;
+    log_host_exclusive_open = true;
+    return value;
+}
+
+template <typename T>
+static inline uint32_t logHostStoreExclusive(T value, volatile T* addr) {
+    if (!log_host_exclusive_open) {
+        return 1U;
+    }
+    log_host_exclusive_open = false;
+    T expected = (T)log_host_exclusive;
+    return !__atomic_compare_exchange_n(addr, &expected, value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline uint8_t __LDREXB(volatile uint8_t* addr) {
+    return logHostLoadExclusive(addr);
+}
+static inline uint16_t __LDREXH(volatile uint16_t* addr) {
+    return logHostLoadExclusive(addr);
+}
+static inline uint32_t __LDREXW(volatile uint32_t* addr) {
+    return logHostLoadExclusive(addr);
+}
+static inline uint32_t __STREXB(uint8_t value, volatile uint8_t* addr) {
+    return logHostStoreExclusive(value, addr);
+}
+static inline uint32_t __STREXH(uint16_t value, volatile uint16_t* addr) {
+    return logHostStoreExclusive(value, addr);
+}
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t* addr) {
+    return logHostStoreExclusive(value, addr);
+}
+static inline void __CLREX() {
+    log_host_exclusive_open = false;
+}
+static inline void __DMB() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t __get_IPSR() {
+    return log_host_ipsr;
+}
+
+/**
+ * @brief Nanoseconds of the monotonic clock, standing in for the cycle counter
+ */
+static inline uint32_t logPortCycles() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec);
+}
+
+static inline void logPortStartCycles() {}
+
+/**
+ * @brief Nothing to wait for on the host, the caller polls again
+ */
+static inline uint32_t logPortDisableIrq() {
+    return 0U;
+}
+static inline void logPortRestoreIrq(uint32_t) {}
+static inline void logPortWaitForInterrupt() {}
+
+#else
+
+#include "stm32f4xx_hal.h"
+
+/**
+ * @brief The DWT cycle counter
+ */
+static inline uint32_t logPortCycles() {
+    return DWT->CYCCNT;
+}
+
+/**
+ * @brief Enable the trace unit and start the DWT cycle counter
+ */
+static inline void logPortStartCycles() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief Mask the interrupts around the last check before sleeping, WFI still wakes up on a pending one
+ * @return the PRIMASK to give back to logPortRestoreIrq(), a caller already masking the interrupts keeps them masked
+ */
+static inline uint32_t logPortDisableIrq() {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+static inline void logPortRestoreIrq(uint32_t primask) {
+    __set_PRIMASK(primask);
+}
+
+/**
+ * @brief Sleep until the next interrupt, the clocks and the DMA keep running
+ */
+static inline void logPortWaitForInterrupt() {
+    __WFI();
+}
+
+#endif
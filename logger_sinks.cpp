@@ -0,0 +1,208 @@
+/**
+ * @file logger_sinks.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Sinks moving the send buffer of the logger out of the device
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "logger_sinks.h"
+
+#ifndef LOGGER_HOST
+
+UartDmaSink* UartDmaSink::s_instances[MAX_INSTANCES];
+uint8_t      UartDmaSink::s_instance_count = 0U;
+
+/**
+ * @brief Initialize the sink with a uart handle
+ */
+void UartDmaSink::init(UART_HandleTypeDef* huart) {
+    init(&huart, 1U);
+}
+
+/**
+ * @brief Initialize the sink with several uart handles bonded into one logical link
+ */
+void UartDmaSink::init(UART_HandleTypeDef* const* huarts, uint8_t count) {
+    assert_param(count > 0U && count <= MAX_LINKS);
+    assert_param(s_instance_count < MAX_INSTANCES);
+    s_instances[s_instance_count++] = this;
+    m_link_count = count;
+    for (uint8_t i = 0; i < count; i++) {
+        m_links[i] = huarts[i];
+        m_link_seq[i] = 0U;
+        HAL_UART_RegisterCallback(m_links[i], HAL_UART_TX_COMPLETE_CB_ID, transferCompletedCallback);
+    }
+}
+
+/**
+ * @brief Send a region of the send buffer. When bonded, the region is split into one part per link and each part is
+ * sent as a LOG_FRAME_BOND header followed by the raw bytes
+ */
+bool UartDmaSink::transmit(const volatile char* data, uint16_t length) {
+    if (m_link_count == 1U) {
+        startDMA(m_links[0], data, length);
+        return false;
+    }
+
+    uint8_t parts = length / MIN_PART_SIZE;
+    parts = parts == 0U ? 1U : (parts > m_link_count ? m_link_count : parts);
+    uint16_t part_length = length / parts;
+
+    m_pending_parts = parts;  // set before the first part starts, so no completion can see 0 too early
+    for (uint8_t i = 0; i < parts; i++) {
+        m_part_data[i] = data + i * part_length;
+        m_part_length[i] = i == parts - 1U ? length - i * part_length : part_length;
+        m_part_body_sent[i] = false;
+
+        // [type][link_seq u16][span_seq u16][part][parts][length u16]
+        uint8_t header[9] = {LOG_FRAME_BOND,
+                             (uint8_t)m_link_seq[i],
+                             (uint8_t)(m_link_seq[i] >> 8),
+                             (uint8_t)m_span_seq,
+                             (uint8_t)(m_span_seq >> 8),
+                             i,
+                             parts,
+                             (uint8_t)m_part_length[i],
+                             (uint8_t)(m_part_length[i] >> 8)};
+        ++m_link_seq[i];
+        startDMA(m_links[i], m_part_header[i], LogFormatter::encodeFrame(m_part_header[i], header, sizeof(header)));
+    }
+    return false;
+}
+
+/**
+ * @brief Set the baud rate of every link
+ */
+int32_t UartDmaSink::setBaudRate(uint32_t baud) {
+    for (uint8_t i = 0; i < m_link_count; i++) {
+        m_links[i]->Init.BaudRate = baud;
+    }
+    clockChanged();
+    return m_baud_error_ppm;
+}
+
+/**
+ * @brief The divisor and the oversampling of uartBaud(), for the APB clock of each link: USART1 and USART6 are on APB2,
+ * the others on APB1
+ * @note Called between two regions: the HAL reports the completion on TC, so the last byte has already left the line
+ */
+void UartDmaSink::clockChanged() {
+    int32_t worst_ppm = 0;
+    for (uint8_t i = 0; i < m_link_count; i++) {
+        UART_HandleTypeDef* huart = m_links[i];
+        uint32_t            pclk = huart->Instance == USART1 || huart->Instance == USART6 ? HAL_RCC_GetPCLK2Freq()
+                                                                                       : HAL_RCC_GetPCLK1Freq();
+        UartBaud setting = uartBaud(pclk, huart->Init.BaudRate);
+        assert_param(setting.valid);  // the rate is above PCLK / 8
+        if (!setting.valid) {
+            continue;
+        }
+
+        __HAL_UART_DISABLE(huart);
+        if (setting.over8) {
+            huart->Init.OverSampling = UART_OVERSAMPLING_8;
+            huart->Instance->CR1 |= USART_CR1_OVER8;
+        } else {
+            huart->Init.OverSampling = UART_OVERSAMPLING_16;
+            huart->Instance->CR1 &= ~USART_CR1_OVER8;
+        }
+        huart->Instance->BRR = setting.brr;
+        __HAL_UART_ENABLE(huart);
+
+        int32_t error_ppm = setting.error_ppm < 0 ? -setting.error_ppm : setting.error_ppm;
+        worst_ppm = error_ppm > (worst_ppm < 0 ? -worst_ppm : worst_ppm) ? setting.error_ppm : worst_ppm;
+    }
+    m_baud_error_ppm = worst_ppm;
+}
+
+/**
+ * @brief Start a DMA transfer on a link
+ */
+void UartDmaSink::startDMA(UART_HandleTypeDef* huart, const volatile char* data, uint16_t length) {
+    HAL_UART_Transmit_DMA(huart, (const uint8_t*)data, length);
+    __HAL_DMA_DISABLE_IT(huart->hdmatx, DMA_IT_HT);  // Disable the half transfer interrupt
+}
+
+/**
+ * @brief A DMA transfer on link [index] is completed. A bonded region is done when the bodies of all parts are sent
+ */
+void UartDmaSink::linkCompleted(uint8_t index) {
+    if (m_link_count > 1U) {
+        if (!m_part_body_sent[index]) {
+            m_part_body_sent[index] = true;  // the header is out, send the body of the part
+            startDMA(m_links[index], m_part_data[index], m_part_length[index]);
+            return;
+        }
+
+        // The links may have different IRQ priorities, so the countdown has to be atomic
+        uint8_t remaining;
+        do {
+            remaining = __LDREXB(&m_pending_parts) - 1U;
+        } while (__STREXB(remaining, &m_pending_parts));
+        if (remaining) {
+            return;
+        }
+        ++m_span_seq;
+    }
+    m_completed(m_context);
+}
+
+/**
+ * @brief uart transfer complete callback, find the sink and the link of the huart
+ */
+void UartDmaSink::transferCompletedCallback(UART_HandleTypeDef* huart) {
+    for (uint8_t n = 0; n < s_instance_count; n++) {
+        UartDmaSink* sink = s_instances[n];
+        for (uint8_t i = 0; i < sink->m_link_count; i++) {
+            if (huart == sink->m_links[i]) {
+                sink->linkCompleted(i);
+                return;
+            }
+        }
+    }
+}
+
+SpiDmaSink* SpiDmaSink::s_instances[MAX_INSTANCES];
+uint8_t     SpiDmaSink::s_instance_count = 0U;
+
+/**
+ * @brief Initialize the sink with a spi handle
+ */
+void SpiDmaSink::init(SPI_HandleTypeDef* hspi) {
+    assert_param(s_instance_count < MAX_INSTANCES);
+    s_instances[s_instance_count++] = this;
+    m_spi = hspi;
+    HAL_SPI_RegisterCallback(m_spi, HAL_SPI_TX_COMPLETE_CB_ID, transferCompletedCallback);
+}
+
+/**
+ * @brief spi transfer complete callback, find the sink of the hspi
+ */
+void SpiDmaSink::transferCompletedCallback(SPI_HandleTypeDef* hspi) {
+    for (uint8_t n = 0; n < s_instance_count; n++) {
+        if (hspi == s_instances[n]->m_spi) {
+            s_instances[n]->m_completed(s_instances[n]->m_context);
+            return;
+        }
+    }
+}
+
+#if LOGGER_USB_CDC
+UsbCdcSink* UsbCdcSink::s_instance = nullptr;
+#endif
+
+#endif
@@ -0,0 +1,651 @@
+/**
+ * @file logger_sinks.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Sinks moving the send buffer of the logger out of the device
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+BasicLogger<Sink> hands every contiguous region of its send buffer to the sink, and the sink tells when the region can
+be reused. The sink is a template parameter, so the calls are resolved at compile time and inlined. Any class with the
+following members can be used:
+
+void init(...);                                             // logger.init(...) forwards its arguments here
+void bind(void (*completed)(void*), void* context,          // called by the logger after init(), with the send
+          const volatile char* buffer, uint16_t size);      // buffer for sinks exposing it as it is
+bool transmit(const volatile char* data, uint16_t length);  // start sending the region
+void poll();                                                // called by logger.process() in the main loop
+
+transmit() returns true when the region has been consumed before returning, the logger then moves on by itself. When it
+returns false, the sink must call completed(context) exactly once after the whole region is sent, usually in its ISR.
+
+Logger::changeClock() also needs void clockChanged(), called between two regions after the bus clocks changed.
+
+The sink of the global logger is selected with LOGGER_SINK, UartDmaSink by default and FileSink with LOGGER_HOST.
+Another sink needs its own explicit instantiation, see the end of logger.cpp.
+
+USB CDC: define LOGGER_USB_CDC to 1 and call UsbCdcSink::transmitCompleted() in CDC_TransmitCplt_FS() of
+usbd_cdc_if.c.
+*/
+
+#include "log_format.h"
+#include "uart_baud.h"
+
+#ifndef LOGGER_HOST
+
+/**
+ * @brief UART with DMA, a single uart or up to MAX_LINKS uarts bonded into one logical link
+ */
+class UartDmaSink {
+
+   public:
+    /**
+     * @brief Initialize the sink with a uart handle
+     *
+     * @param huart A uart handle initialized as follows
+     *
+     * 1. The `USE_HAL_UART_REGISTER_CALLBACKS` macro in `stm32f4xx_hal_conf.h` should be defined to `1U`
+     *
+     * 2. Enable UARTx global interrupt
+     *
+     * 3. The DMA and related interrupt should be enabled for the TX pin of the huart with following settings
+     *    - `Normal` mode
+     *    - Peripheral Increment Address `Disabled` and Memory Increment Address `Enabled`
+     *    - Use Fifo `Disable`
+     *    - Set Data Width of both Peripheral and Memory to `Byte`
+     */
+    void init(UART_HandleTypeDef* huart);
+
+    /**
+     * @brief Initialize the sink with several uart handles bonded into one logical link
+     *
+     * @param huarts uart handles, each initialized like the one of init(UART_HandleTypeDef*)
+     * @param count number of handles, up to MAX_LINKS
+     *
+     * Every region of the send buffer is split across the links, each part preceded by a LOG_FRAME_BOND header with
+     * per-link and global sequence numbers, see log_protocol.h. tools/logmerge.cpp merges the captures of all links
+     * back into the original stream.
+     */
+    void init(UART_HandleTypeDef* const* huarts, uint8_t count);
+
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+
+    /**
+     * @brief Send a region of the send buffer, split across the links when bonded
+     */
+    bool transmit(const volatile char* data, uint16_t length);
+
+    void poll() {}
+
+    /**
+     * @brief Set the baud rate of every link, with 8x oversampling when 16x can't reach it, see uart_baud.h
+     *
+     * @return int32_t error of the actual rate in ppm, the largest of the links. Check it, the other side usually
+     * needs it within +-20000 ppm
+     * @note Call it before logging or in the function given to Logger::changeClock(), not during a transfer
+     *
+     * logger.init(&huart2);
+     * int32_t error_ppm = logger.getSink().setBaudRate(3000000U);
+     */
+    int32_t setBaudRate(uint32_t baud);
+
+    /**
+     * @brief Get the error of the actual baud rate set by setBaudRate() or clockChanged(), in ppm
+     */
+    int32_t getBaudError() {
+        return m_baud_error_ppm;
+    }
+
+    /**
+     * @brief Recompute the baud rate divisor of every link for the current APB clocks, see Logger::changeClock()
+     */
+    void clockChanged();
+
+    /**
+     * @brief Get the uart handle, the first link when bonded
+     */
+    UART_HandleTypeDef* getUARTHandle() {
+        return m_links[0];
+    }
+
+    static constexpr uint8_t MAX_LINKS = 4U;      // The maximum number of bonded uarts
+    static constexpr uint8_t MAX_INSTANCES = 4U;  // The maximum number of UartDmaSinks
+
+   private:
+    /**
+     * @brief Start a DMA transfer on a link
+     */
+    static void startDMA(UART_HandleTypeDef* huart, const volatile char* data, uint16_t length);
+
+    /**
+     * @brief A DMA transfer on link [index] is completed
+     */
+    void linkCompleted(uint8_t index);
+
+    /**
+     * @brief message transfer completed ISR, dispatched to the sink owning the huart
+     */
+    static void transferCompletedCallback(UART_HandleTypeDef* huart);
+
+    static UartDmaSink* s_instances[MAX_INSTANCES];
+    static uint8_t      s_instance_count;
+
+    static constexpr uint16_t MIN_PART_SIZE = 64U;     // Smaller regions are not split across bonded links
+    static constexpr uint8_t  BOND_HEADER_SIZE = 12U;  // An encoded LOG_FRAME_BOND header
+
+    void (*m_completed)(void*);
+    void* m_context;
+
+    UART_HandleTypeDef*  m_links[MAX_LINKS];           // Uart handles
+    uint8_t              m_link_count = 1U;
+    int32_t              m_baud_error_ppm = 0;
+    volatile uint8_t     m_pending_parts = 0U;         // parts of the current region not sent yet
+    uint16_t             m_span_seq = 0U;              // global sequence number of the regions
+    uint16_t             m_link_seq[MAX_LINKS];        // per-link sequence number of the parts
+    const volatile char* m_part_data[MAX_LINKS];       // the part of the current region sent by each link
+    uint16_t             m_part_length[MAX_LINKS];
+    volatile bool        m_part_body_sent[MAX_LINKS];  // if the header of the part has been sent and the body is on
+    char                 m_part_header[MAX_LINKS][BOND_HEADER_SIZE];
+};
+
+/**
+ * @brief SPI with DMA, e.g. to a logic analyzer or a second MCU
+ */
+class SpiDmaSink {
+
+   public:
+    /**
+     * @brief Initialize the sink with a spi handle
+     *
+     * @param hspi A spi handle in master TX mode, with `USE_HAL_SPI_REGISTER_CALLBACKS` defined to `1U` and a
+     * `Normal` mode DMA stream of byte width on its TX
+     */
+    void init(SPI_HandleTypeDef* hspi);
+
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        HAL_SPI_Transmit_DMA(m_spi, (const uint8_t*)data, length);
+        __HAL_DMA_DISABLE_IT(m_spi->hdmatx, DMA_IT_HT);  // Disable the half transfer interrupt
+        return false;
+    }
+
+    void poll() {}
+
+    /**
+     * @brief Nothing to do, the receiver follows SCK whatever its frequency
+     */
+    void clockChanged() {}
+
+    static constexpr uint8_t MAX_INSTANCES = 2U;  // The maximum number of SpiDmaSinks
+
+   private:
+    /**
+     * @brief message transfer completed ISR, dispatched to the sink owning the hspi
+     */
+    static void transferCompletedCallback(SPI_HandleTypeDef* hspi);
+
+    static SpiDmaSink* s_instances[MAX_INSTANCES];
+    static uint8_t     s_instance_count;
+
+    SPI_HandleTypeDef* m_spi;
+    void (*m_completed)(void*);
+    void* m_context;
+};
+
+/**
+ * @brief ITM stimulus port, read by the debug probe through SWO
+ * @note The write is blocking on the ITM FIFO, so the SWO clock sets the cost of a record. The data are dropped when
+ * no debugger has enabled the port.
+ */
+class ItmSink {
+
+   public:
+    void init(uint8_t port = 0U) {
+        m_port = port;
+    }
+
+    void bind(void (*)(void*), void*, const volatile char*, uint16_t) {}
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        if (!(ITM->TCR & ITM_TCR_ITMENA_Msk) || !(ITM->TER & (1UL << m_port))) {
+            return true;
+        }
+        for (uint16_t i = 0; i < length; i++) {
+            while (ITM->PORT[m_port].u32 == 0UL) {  // wait until the FIFO can take a byte
+            }
+            ITM->PORT[m_port].u8 = (uint8_t)data[i];
+        }
+        return true;
+    }
+
+    void poll() {}
+
+   private:
+    uint8_t m_port = 0U;
+};
+
+#if LOGGER_USB_CDC
+#include "usbd_cdc_if.h"
+
+/**
+ * @brief USB CDC device (virtual COM port) of the CubeMX USB device middleware
+ * @note The region is handed to the USB stack as it is, so the DMA-free path needs no copy. A busy endpoint is retried
+ * in poll(). Any other failure, e.g. USBD_FAIL when the host isn't connected, never gets a completion: the region is
+ * dropped and counted by getMissedCount(), so the logger goes on with the next one.
+ */
+class UsbCdcSink {
+
+   public:
+    void init() {
+        s_instance = this;
+    }
+
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        m_data = data;
+        m_length = length;
+        uint8_t result = CDC_Transmit_FS((uint8_t*)data, length);
+        m_retry = result == USBD_BUSY;
+        if (result != USBD_OK && !m_retry) {
+            m_missed_count++;
+            return true;  // dropped, consumed as far as the logger is concerned
+        }
+        return false;
+    }
+
+    void poll() {
+        if (m_retry) {
+            uint8_t result = CDC_Transmit_FS((uint8_t*)m_data, m_length);
+            m_retry = result == USBD_BUSY;
+            if (result != USBD_OK && !m_retry) {
+                m_missed_count++;
+                m_completed(m_context);  // dropped, transmit() has already returned false
+            }
+        }
+    }
+
+    /**
+     * @brief The regions dropped because the USB stack failed to take them
+     */
+    uint32_t getMissedCount() const {
+        return m_missed_count;
+    }
+
+    /**
+     * @brief Call it in CDC_TransmitCplt_FS()
+     */
+    static void transmitCompleted() {
+        if (s_instance && !s_instance->m_retry) {
+            s_instance->m_completed(s_instance->m_context);
+        }
+    }
+
+   private:
+    static UsbCdcSink* s_instance;
+
+    void (*m_completed)(void*);
+    void*                m_context;
+    const volatile char* m_data;  // the region being sent
+    uint16_t             m_length;
+    volatile bool        m_retry = false;  // the endpoint was busy, try again in poll()
+    uint32_t             m_missed_count = 0U;
+};
+#endif
+
+#endif
+
+/**
+ * @brief Keep the output in a RAM buffer only, the newest bytes overwrite the oldest ones
+ * @note Useful for post-mortem dumps with a debugger, and as a baseline to benchmark the ring and the formatters
+ */
+class RamSink {
+
+   public:
+    /**
+     * @param buffer storage of the output
+     * @param size size of the buffer
+     */
+    void init(char* buffer, uint32_t size) {
+        m_buffer = buffer;
+        m_size = size;
+    }
+
+    void bind(void (*)(void*), void*, const volatile char*, uint16_t) {}
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        for (uint16_t i = 0; i < length; i++) {
+            m_buffer[m_pos] = data[i];
+            m_pos = m_pos + 1U == m_size ? 0U : m_pos + 1U;
+        }
+        m_total += length;
+        return true;
+    }
+
+    void poll() {}
+
+    /**
+     * @brief Position of the next byte in the buffer, the oldest byte once the buffer has wrapped
+     */
+    uint32_t getPos() {
+        return m_pos;
+    }
+
+    /**
+     * @brief Total number of bytes written
+     */
+    uint32_t getTotal() {
+        return m_total;
+    }
+
+   private:
+    char*    m_buffer;
+    uint32_t m_size;
+    uint32_t m_pos = 0U;
+    uint32_t m_total = 0U;
+};
+
+/**
+ * @brief A virtual channel of a ChannelMux, see channel_mux.h
+ * @note logger.init(&mux, channel, weight) attaches the logger to the channel
+ */
+class ChannelSink {
+
+   public:
+    template <typename Mux>
+    void init(Mux* mux, uint8_t channel, uint8_t weight) {
+        mux->attach(this, channel, weight);
+    }
+
+    void bind(void (*completed)(void*), void* context, const volatile char*, uint16_t) {
+        m_completed = completed;
+        m_context = context;
+    }
+
+    /**
+     * @brief Queue the region on the channel, the mux sends it in turn with the other channels
+     */
+    bool transmit(const volatile char* data, uint16_t length) {
+        m_submit(m_mux, m_channel, data, length);
+        return false;
+    }
+
+    void poll() {}
+
+    /**
+     * @brief Connect the sink to its mux, called by the mux
+     */
+    void connect(void* mux, uint8_t channel, void (*submit)(void*, uint8_t, const volatile char*, uint16_t)) {
+        m_mux = mux;
+        m_channel = channel;
+        m_submit = submit;
+    }
+
+    /**
+     * @brief The region has been sent by the mux
+     */
+    void completed() {
+        m_completed(m_context);
+    }
+
+   private:
+    void* m_mux;
+    void (*m_submit)(void*, uint8_t, const volatile char*, uint16_t);
+    uint8_t m_channel;
+
+    void (*m_completed)(void*);
+    void* m_context;
+};
+
+/**
+ * @brief Any sink with a CRC-32 per region: every region goes out as a LOG_FRAME_CRC header and the raw bytes
+ * @note The CRC is computed when the logger hands the region over, by the CRC unit of the STM32 (LOGGER_CRC_HW) fed a
+ * word at a time, so the ISRs chaining the regions stay short. Build with e.g.
+ * LOGGER_SINK=CrcSink<UartDmaSink>, logger.init() takes the arguments of the inner sink. tools/logcrc.cpp checks the
+ * capture and outputs the logger stream.
+ */
+template <typename Inner>
+class CrcSink {
+
+   public:
+    template <typename... A>
+    void init(A... args) {
+        LogFormatter::startCrc();
+        m_inner.init(args...);
+    }
+
+    void bind(void (*completed)(void*), void* context, const volatile char* buffer, uint16_t size) {
+        m_completed = completed;
+        m_context = context;
+        m_inner.bind(innerCompleted, this, buffer, size);
+    }
+
+    /**
+     * @brief Send the header with the CRC of the region, then the region
+     */
+    bool transmit(const volatile char* data, uint16_t length) {
+        uint32_t crc = LogFormatter::crc32(data, length);
+
+        // [type][seq u16][length u16][crc u32]
+        uint8_t header[9] = {LOG_FRAME_CRC,       (uint8_t)m_seq,         (uint8_t)(m_seq >> 8),
+                             (uint8_t)length,     (uint8_t)(length >> 8), (uint8_t)crc,
+                             (uint8_t)(crc >> 8), (uint8_t)(crc >> 16),   (uint8_t)(crc >> 24)};
+        ++m_seq;
+        m_header_length = LogFormatter::encodeFrame(m_header, header, sizeof(header));
+        m_data = data;
+        m_length = length;
+
+        // the state is set before each transfer, the completion may come before transmit() returns
+        m_sending_body = false;
+        if (!m_inner.transmit(m_header, m_header_length)) {
+            return false;
+        }
+        m_sending_body = true;
+        return m_inner.transmit(data, length);
+    }
+
+    void poll() {
+        m_inner.poll();
+    }
+
+    void clockChanged() {
+        m_inner.clockChanged();
+    }
+
+    /**
+     * @brief Get the sink sending the regions and their headers
+     */
+    Inner& getInner() {
+        return m_inner;
+    }
+
+   private:
+    /**
+     * @brief The inner sink has sent the header or the region
+     */
+    static void innerCompleted(void* context) {
+        CrcSink* self = static_cast<CrcSink*>(context);
+        if (!self->m_sending_body) {
+            self->m_sending_body = true;
+            if (!self->m_inner.transmit(self->m_data, self->m_length)) {
+                return;
+            }
+        }
+        self->m_completed(self->m_context);
+    }
+
+    static constexpr uint8_t CRC_HEADER_SIZE = 12U;  // An encoded LOG_FRAME_CRC header
+
+    void (*m_completed)(void*);
+    void* m_context;
+
+    const volatile char* m_data;
+    uint16_t             m_length;
+    volatile bool        m_sending_body = false;  // the header is out, the region is on
+    uint16_t             m_seq = 0U;
+    uint16_t             m_header_length;
+    char                 m_header[CRC_HEADER_SIZE];
+
+    Inner m_inner;
+};
+
+/**
+ * @brief The control block of RttSink, read and written by a debug probe through memory accesses
+ *
+ * All fields are little-endian 32-bit words at fixed offsets:
+ *   0  id[16]         "LOGGER RTT", zero padded, written last by init() so a valid id means a valid block
+ *  16  version        LOGGER_RTT_VERSION
+ *  20  buffer_offset  offset of the send buffer from the control block, signed
+ *  24  size           size of the send buffer
+ *  28  write_off      end of the data ready to be read, written by the device
+ *  32  read_off       next byte to be read, written by the probe
+ *
+ * The probe reads [read_off, write_off) of the circular buffer and then stores the new read_off, the space is released
+ * once all the published data have been read. write_off == read_off means empty.
+ */
+struct LoggerRttControlBlock {
+    char              id[16];
+    uint32_t          version;
+    int32_t           buffer_offset;
+    uint32_t          size;
+    volatile uint32_t write_off;
+    volatile uint32_t read_off;
+};
+
+static constexpr const char* LOGGER_RTT_ID = "LOGGER RTT";
+static constexpr uint32_t    LOGGER_RTT_VERSION = 1U;
+
+/**
+ * @brief Expose the send buffer itself to a debug probe, in the way of SEGGER RTT, no byte leaves through a peripheral
+ * @note Nothing is copied: the control block points at the send buffer of the logger and publishes every region, and
+ * the region is released in poll() once the probe has read it. Without a probe the buffer fills and the messages are
+ * counted as missed. tools/rtt_reader.cpp drains a memory dump or a shared memory file.
+ */
+class RttSink {
+
+   public:
+    void init() {}
+
+    void bind(void (*completed)(void*), void* context, const volatile char* buffer, uint16_t size) {
+        m_completed = completed;
+        m_context = context;
+        m_buffer = buffer;
+        m_cb.version = LOGGER_RTT_VERSION;
+        m_cb.buffer_offset = (int32_t)((const volatile char*)buffer - (const char*)&m_cb);
+        m_cb.size = size;
+        m_cb.write_off = 0U;
+        m_cb.read_off = 0U;
+        __DMB();
+        const char* id = LOGGER_RTT_ID;
+        for (uint8_t i = 0; i < sizeof(m_cb.id); i++) {
+            m_cb.id[i] = *id ? *id++ : '\0';
+        }
+    }
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        m_region_end = (uint32_t)(data - m_buffer) + length;
+        m_region_end = m_region_end == m_cb.size ? 0U : m_region_end;
+        __DMB();  // the data must be visible before the probe sees the new write_off
+        m_cb.write_off = m_region_end;
+        m_waiting = true;
+        return false;
+    }
+
+    /**
+     * @brief Release the region when the probe has read it
+     */
+    void poll() {
+        if (m_waiting && m_cb.read_off == m_region_end) {
+            m_waiting = false;
+            m_completed(m_context);
+        }
+    }
+
+    /**
+     * @brief Get the control block, e.g. to give its address to the probe
+     */
+    const LoggerRttControlBlock* getControlBlock() {
+        return &m_cb;
+    }
+
+   private:
+    LoggerRttControlBlock m_cb;
+
+    void (*m_completed)(void*);
+    void*                m_context;
+    const volatile char* m_buffer;
+    uint32_t             m_region_end;        // write_off of the region being read
+    bool                 m_waiting = false;   // a region is published and not read yet
+};
+
+#ifdef LOGGER_HOST
+#include <unistd.h>
+
+/**
+ * @brief A file descriptor of the host, e.g. a file, a pipe or /dev/null
+ */
+class FileSink {
+
+   public:
+    void init(int fd) {
+        m_fd = fd;
+    }
+
+    void bind(void (*)(void*), void*, const volatile char*, uint16_t) {}
+
+    bool transmit(const volatile char* data, uint16_t length) {
+        const char* pos = (const char*)data;
+        while (length) {
+            ssize_t written = write(m_fd, pos, length);
+            if (written <= 0) {
+                break;  // the output is gone, drop the region like a disconnected uart would
+            }
+            pos += written;
+            length -= (uint16_t)written;
+        }
+        return true;
+    }
+
+    void poll() {}
+
+   private:
+    int m_fd = -1;
+};
+#endif
+
+/**
+ * @brief The sink of the global logger
+ */
+#ifndef LOGGER_SINK
+#ifdef LOGGER_HOST
+#define LOGGER_SINK FileSink
+#else
+#define LOGGER_SINK UartDmaSink
+#endif
+#endif
@@ -0,0 +1,106 @@
+/**
+ * @file metrics.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief A registry of counters and gauges, exported periodically as a compact delta-encoded frame
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "metrics.h"
+
+Metrics metrics;
+
+/**
+ * @brief Register the logger's own counters
+ */
+Metrics::Metrics() {
+    add("logger_missed_total", LOG_METRIC_COUNTER);
+    add("logger_buffer_free", LOG_METRIC_GAUGE);
+}
+
+/**
+ * @brief Register a metric
+ */
+uint8_t Metrics::add(const char* name, LogMetricKind kind) {
+    if (m_count == MAX_METRICS) {
+        return INVALID_ID;
+    }
+    m_names[m_count] = name;
+    m_kinds[m_count] = kind;
+    m_values[m_count] = 0U;
+    m_exported[m_count] = 0U;
+    return m_count++;
+}
+
+/**
+ * @brief Sample the logger's counters and export the registry when the period is elapsed
+ */
+void Metrics::process() {
+    if (m_period_ms == 0U || HAL_GetTick() - m_last_export < m_period_ms) {
+        return;
+    }
+    m_values[METRIC_LOGGER_MISSED] = logger.getMissedCount();
+    m_values[METRIC_LOGGER_FREE] = logger.getAvailableSpace();
+
+    // If the send buffer is busy, try again in next entry with the same sequence number
+    if (exportFrame(m_seq % KEY_FRAME_INTERVAL == 0U)) {
+        m_last_export = HAL_GetTick();
+        ++m_seq;
+    }
+}
+
+/**
+ * @brief Send a descriptor and the metrics frame
+ */
+bool Metrics::exportFrame(bool key_frame) {
+    uint8_t  payload[LOG_FRAME_MAX_PAYLOAD];
+    uint32_t snapshot[MAX_METRICS];
+    uint16_t length = 0;
+
+    payload[length++] = LOG_FRAME_METRICS;
+    payload[length++] = (uint8_t)m_seq;
+    payload[length++] = (uint8_t)(m_seq >> 8);
+    payload[length++] = key_frame ? LOG_FRAME_FLAG_KEY : 0U;
+    payload[length++] = m_count;
+    for (uint8_t i = 0; i < m_count; i++) {
+        snapshot[i] = m_values[i];
+        uint32_t delta = key_frame ? snapshot[i] : snapshot[i] - m_exported[i];
+        length += logPutVarint(&payload[length], logZigzag((int32_t)delta));
+    }
+
+    // One descriptor rides along with every export in turn, so the names trickle out without a burst
+    uint8_t  desc[LOG_FRAME_MAX_PAYLOAD];
+    uint16_t desc_length = 0;
+    uint8_t  desc_id = m_seq % m_count;
+    desc[desc_length++] = LOG_FRAME_METRICS_DESC;
+    desc[desc_length++] = desc_id;
+    desc[desc_length++] = m_kinds[desc_id];
+    for (const char* c = m_names[desc_id]; *c != '\0' && desc_length < LOG_FRAME_MAX_PAYLOAD; c++) {
+        desc[desc_length++] = (uint8_t)*c;
+    }
+
+    // Every frame grows by the COBS code byte and two delimiters
+    if (logger.getAvailableSpace() < desc_length + 3U + length + 3U) {
+        return false;
+    }
+    logger.enqueueFrame(desc, desc_length);
+    logger.enqueueFrame(payload, length);
+
+    for (uint8_t i = 0; i < m_count; i++) {
+        m_exported[i] = snapshot[i];
+    }
+    return true;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file metrics.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief A registry of counters and gauges, exported periodically as a compact delta-encoded frame
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+All metric values are kept in a single contiguous array and exported as one LOG_FRAME_METRICS frame every period, see
+log_protocol.h. Only the difference from the previous export is sent as a zigzag varint, so an unchanged metric costs a
+single byte. Every KEY_FRAME_INTERVAL exports the absolute values are sent instead, and each export carries the name of
+one metric in turn, so a host attached later can pick up the stream. tools/metrics_export.cpp turns the frames into OpenMetrics text files.
+
+The logger's own counters are registered first: logger_missed_total and logger_buffer_free.
+
+Usage:
+uint8_t rx_packets = metrics.add("rx_packets_total", LOG_METRIC_COUNTER);  // at init
+uint8_t queue_depth = metrics.add("queue_depth", LOG_METRIC_GAUGE);
+metrics.increment(rx_packets);                                           // in any context
+metrics.set(queue_depth, depth);
+metrics.process();                                                       // in the main loop
+*/
+
+#include "logger.h"
+
+class Metrics {
+
+   public:
+    Metrics();
+
+    /**
+     * @brief Register a metric
+     *
+     * @param name metric name in OpenMetrics style, must be a string literal or outlive the registry
+     * @param kind LOG_METRIC_COUNTER or LOG_METRIC_GAUGE
+     * @return uint8_t id of the metric, or INVALID_ID if the registry is full
+     * @note Register all metrics at init, before the first export
+     */
+    uint8_t add(const char* name, LogMetricKind kind);
+
+    /**
+     * @brief Increase a counter atomically, can be called in ISRs
+     */
+    void increment(uint8_t id, uint32_t step = 1U) {
+        uint32_t value;
+        do {
+            value = __LDREXW(&m_values[id]);
+        } while (__STREXW(value + step, &m_values[id]));
+    }
+
+    /**
+     * @brief Set a gauge, can be called in ISRs
+     */
+    void set(uint8_t id, int32_t value) {
+        m_values[id] = (uint32_t)value;
+    }
+
+    /**
+     * @brief Get the current value of a metric
+     */
+    uint32_t get(uint8_t id) {
+        return m_values[id];
+    }
+
+    /**
+     * @brief Set the export period in milliseconds, 0 to disable the export
+     */
+    void setPeriod(uint32_t period_ms) {
+        m_period_ms = period_ms;
+    }
+
+    /**
+     * @brief Export the registry when the period is elapsed
+     * @note Need to poll it frequently, so put it into the main loop
+     */
+    void process();
+
+    static constexpr uint8_t INVALID_ID = 0xFFU;
+
+   private:
+    /**
+     * @brief Send a descriptor and the metrics frame if there is enough space in the send buffer
+     * @return true if the export has been enqueued
+     */
+    bool exportFrame(bool key_frame);
+
+    static constexpr uint8_t  MAX_METRICS = 32U;        // the frame holds up to 32 varints of 5 bytes
+    static constexpr uint8_t  KEY_FRAME_INTERVAL = 16U;  // absolute values and names every 16 exports
+    static constexpr uint32_t DEFAULT_PERIOD_MS = 1000U;
+    static constexpr uint8_t  METRIC_LOGGER_MISSED = 0U;  // the logger's own counters
+    static constexpr uint8_t  METRIC_LOGGER_FREE = 1U;
+
+    static_assert(5U + MAX_METRICS * LOG_VARINT_MAX_SIZE <= LOG_FRAME_MAX_PAYLOAD, "metrics frame is too large");
+
+    volatile uint32_t m_values[MAX_METRICS];    // current values, counters and gauges side by side
+    uint32_t          m_exported[MAX_METRICS];  // values sent in the last export, the base of the deltas
+    const char*       m_names[MAX_METRICS];
+    LogMetricKind     m_kinds[MAX_METRICS];
+    uint8_t           m_count = 0U;
+
+    uint16_t m_seq = 0U;             // sequence number of the metrics frame
+    uint32_t m_period_ms = DEFAULT_PERIOD_MS;
+    uint32_t m_last_export = 0U;     // tick of the last export
+};
+
+extern Metrics metrics;
@@ -0,0 +1,101 @@
+/**
+ * @file timesync.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Time synchronization with the host over the RX pin of the logger's uart
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "timesync.h"
+
+TimeSync timesync;
+
+/**
+ * @brief Start listening for sync requests
+ */
+void TimeSync::init(UART_HandleTypeDef* huart) {
+    m_uart = huart;
+    Logger::startTimestamp();
+    HAL_UART_RegisterCallback(m_uart, HAL_UART_RX_COMPLETE_CB_ID, receivedCallback);
+    HAL_UART_Receive_IT(m_uart, &m_rx_byte, 1U);
+}
+
+/**
+ * @brief Byte received ISR, need to be modified if there are mutiple instances
+ */
+void TimeSync::receivedCallback(UART_HandleTypeDef* huart) {
+    if (huart == timesync.m_uart) {
+        timesync.receive(timesync.m_rx_byte);
+        HAL_UART_Receive_IT(huart, &timesync.m_rx_byte, 1U);
+    }
+}
+
+/**
+ * @brief Collect the bytes of a frame, the timestamp is taken as soon as the closing delimiter arrives
+ */
+void TimeSync::receive(uint8_t byte) {
+    if (byte != LOG_FRAME_DELIMITER) {
+        if (m_rx_length < RX_FRAME_SIZE) {
+            m_rx_frame[m_rx_length++] = byte;
+        } else {
+            m_rx_overflow = true;
+        }
+        return;
+    }
+
+    // Either an opening or a closing delimiter, only a closing one has bytes before it
+    uint32_t device_time = Logger::timestamp();
+    if (m_rx_length && !m_rx_overflow) {
+        respond(device_time);
+    }
+    m_rx_length = 0U;
+    m_rx_overflow = false;
+}
+
+/**
+ * @brief COBS decode the request and echo it with the device time
+ */
+void TimeSync::respond(uint32_t device_time) {
+    uint8_t request[RX_FRAME_SIZE];
+    uint8_t length = 0U, pos = 0U;
+    while (pos < m_rx_length) {
+        uint8_t code = m_rx_frame[pos++];
+        if (code == 0U || pos + code - 1U > m_rx_length) {
+            return;  // malformed
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            request[length++] = m_rx_frame[pos++];
+        }
+        if (code != 0xFFU && pos < m_rx_length) {
+            request[length++] = 0U;
+        }
+    }
+    if (length != 11U || request[0] != LOG_FRAME_SYNC_REQUEST) {
+        return;
+    }
+
+    // [type][seq u16][host_time u64] are echoed as they are
+    uint8_t response[19];
+    for (uint8_t i = 0; i < 11U; i++) {
+        response[i] = request[i];
+    }
+    response[0] = LOG_FRAME_SYNC_RESPONSE;
+    for (uint8_t i = 0; i < 4U; i++) {
+        response[11U + i] = (uint8_t)(device_time >> (8U * i));
+        response[15U + i] = (uint8_t)(SystemCoreClock >> (8U * i));
+    }
+    logger.enqueueFrame(response, sizeof(response));
+}
@@ -0,0 +1,71 @@
+/**
+ * @file timesync.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Time synchronization with the host over the RX pin of the logger's uart
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+The host sends LOG_FRAME_SYNC_REQUEST frames with its UTC time to the RX pin of the logger's uart, and every request is
+answered with a LOG_FRAME_SYNC_RESPONSE frame carrying the device timestamp taken when the request was received, see
+log_protocol.h. tools/logsync.cpp sends the requests while capturing the output, and tools/logdecode.cpp uses the pairs
+of host/device time to convert the "[timestamp] " prefix of every record to UTC, correcting the drift of the device
+clock.
+
+Usage:
+timesync.init(&huart2);  // after logger.init(), the UART mode must be UART_MODE_TX_RX
+*/
+
+#include "logger.h"
+
+class TimeSync {
+
+   public:
+    /**
+     * @brief Start listening for sync requests on the RX pin of the huart
+     * @note The UARTx global interrupt must be enabled, the RX pin works in interrupt mode
+     */
+    void init(UART_HandleTypeDef* huart);
+
+   private:
+    /**
+     * @brief Byte received ISR
+     */
+    static void receivedCallback(UART_HandleTypeDef* huart);
+
+    /**
+     * @brief Handle a byte, and answer the request when its last delimiter arrives
+     */
+    void receive(uint8_t byte);
+
+    /**
+     * @brief Decode a request and enqueue the response
+     */
+    void respond(uint32_t device_time);
+
+    static constexpr uint8_t RX_FRAME_SIZE = 16U;  // a COBS encoded request is 12 bytes
+
+    UART_HandleTypeDef* m_uart;
+    uint8_t             m_rx_byte;
+    uint8_t             m_rx_frame[RX_FRAME_SIZE];  // the encoded request being received
+    uint8_t             m_rx_length = 0U;
+    bool                m_rx_overflow = false;      // drop the frame until the next delimiter
+};
+
+extern TimeSync timesync;
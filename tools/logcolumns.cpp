@@ -0,0 +1,513 @@
+/**
+ * @file logcolumns.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Export the metrics frames of a capture to a columnar file, one typed column per metric
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logcolumns tools/logcolumns.cpp
+Usage:  logcolumns [-c metrics.csv] capture metrics.col     export, and the same rows as CSV with -c
+        logcolumns -d metrics.col                           print the columns and their block statistics
+        logcolumns -b metrics.col metrics.csv [column]      time loading and filtering both files
+
+Every LOG_FRAME_METRICS applied by the decoder (see logmetrics.h) is a row. The columns are "seq", the frame sequence
+number unwrapped to 64 bits, "device_time", the unwrapped timestamp of the last record or sync response before the
+frame (0 without timestamps), then one column per metric: counters as u32, gauges as i32, named by their
+descriptors. A metric that appears later in the capture is 0 in the rows before.
+
+The file is little-endian and every array is aligned to 64 bytes, so a column is loaded by mapping the file and
+pointing at it, e.g. with numpy.frombuffer(). Layout:
+    ColumnFileHeader
+    ColumnEntry * columns           name, type, offset of the values and of the block statistics
+    values of each column           rows * 8 or 4 bytes
+    statistics of each column       {min, max} * ceil(rows / block_rows), widened to 64 bits of the column's sign
+A reader filtering on a column skips the blocks whose range can't match without touching their values.
+
+The benchmark loads the CSV (parse every field into typed arrays) and the columnar file (map it), then sums [column]
+(the last one by default) and counts the rows above the midpoint of its range, skipping blocks by their statistics.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "logmetrics.h"
+#include "logtime.h"
+
+static constexpr char     COLUMN_MAGIC[8] = {'L', 'O', 'G', 'C', 'O', 'L', '1', '\0'};
+static constexpr uint32_t BLOCK_ROWS = 8192U;
+static constexpr size_t   ALIGNMENT = 64U;
+
+enum ColumnType : uint8_t { COLUMN_U64, COLUMN_I32, COLUMN_U32 };
+
+struct ColumnFileHeader {
+    char     magic[8];
+    uint32_t columns;
+    uint32_t block_rows;
+    uint64_t rows;
+};
+
+struct ColumnEntry {
+    char     name[48];
+    uint8_t  type;         // ColumnType
+    uint8_t  reserved[7];
+    uint64_t data_offset;
+    uint64_t stats_offset;
+};
+
+/**
+ * @brief The {min, max} of a block, int64_t for i32 columns and uint64_t for the others
+ */
+struct BlockStats {
+    uint64_t min;
+    uint64_t max;
+};
+
+static_assert(sizeof(ColumnFileHeader) == 24U && sizeof(ColumnEntry) == 72U && sizeof(BlockStats) == 16U,
+              "the file layout is read as it is");
+
+static size_t typeSize(uint8_t type) {
+    return type == COLUMN_U64 ? 8U : 4U;
+}
+
+/**
+ * @brief A column being collected, the values widened to 64 bits
+ */
+struct Column {
+    std::string           name;
+    ColumnType            type;
+    std::vector<uint64_t> values;
+
+    int64_t signedAt(size_t row) const {
+        return (int64_t)(int32_t)(uint32_t)values[row];
+    }
+};
+
+/**
+ * @brief Collect the rows of a capture
+ */
+static bool readCapture(const char* input, std::vector<Column>& columns, size_t& errors) {
+    FILE* in = strcmp(input, "-") ? fopen(input, "rb") : stdin;
+    if (!in) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return false;
+    }
+    columns = {{"seq", COLUMN_U64, {}}, {"device_time", COLUMN_U64, {}}};
+    static constexpr size_t FIXED_COLUMNS = 2U;
+
+    MetricsState       state;
+    TimestampUnwrapper time_unwrapper;
+    uint64_t           seq = 0U;
+    std::string        prefix;  // the start of the record being received
+    bool               in_prefix = true;
+
+    LogStreamDecoder decoder;
+    decoder.onText = [&](const char* text, size_t length) {
+        // only the "[timestamp] " prefix of every record is needed
+        for (size_t i = 0; i < length; i++) {
+            if (in_prefix) {
+                prefix.push_back(text[i]);
+                uint32_t timestamp;
+                if (parseTimestampPrefix(prefix.data(), prefix.size(), timestamp)) {
+                    time_unwrapper.unwrap(timestamp);
+                    in_prefix = false;
+                } else if (prefix.size() >= 14U) {
+                    in_prefix = false;  // longer than "[4294967295] ", not a timestamp
+                }
+            }
+            if (text[i] == '\n') {
+                in_prefix = true;
+                prefix.clear();
+            }
+        }
+    };
+    decoder.onFrame = [&](const uint8_t* payload, size_t length) {
+        int64_t  host_us;
+        uint32_t device_time, device_hz;
+        if (parseSyncResponse(payload, length, host_us, device_time, device_hz)) {
+            time_unwrapper.unwrap(device_time);
+            return;
+        }
+        if (!state.apply(payload, length)) {
+            return;
+        }
+        size_t rows = columns[0].values.size();
+        seq = rows ? seq + (uint16_t)(state.seq() - (uint16_t)seq) : state.seq();  // 16 bits on the wire
+        while (columns.size() < FIXED_COLUMNS + state.size()) {
+            size_t id = columns.size() - FIXED_COLUMNS;
+            columns.push_back({"", state.kind(id) == LOG_METRIC_COUNTER ? COLUMN_U32 : COLUMN_I32,
+                               std::vector<uint64_t>(rows, 0U)});
+        }
+        columns[0].values.push_back(seq);
+        columns[1].values.push_back(time_unwrapper.started() ? time_unwrapper.last() : 0U);
+        for (size_t id = 0; id < state.size(); id++) {
+            Column& column = columns[FIXED_COLUMNS + id];
+            column.values.push_back(state.value(id));
+            if (!state.name(id).empty()) {
+                column.name = state.name(id);
+                column.type = state.kind(id) == LOG_METRIC_COUNTER ? COLUMN_U32 : COLUMN_I32;
+            }
+        }
+    };
+    decoder.onError = [&]() { ++errors; };
+
+    uint8_t buffer[65536];
+    size_t  length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        decoder.feed(buffer, length);
+    }
+    decoder.finish();
+    for (size_t id = FIXED_COLUMNS; id < columns.size(); id++) {
+        if (columns[id].name.empty()) {
+            columns[id].name = "metric_" + std::to_string(id - FIXED_COLUMNS);  // the descriptor never came
+        }
+    }
+    return true;
+}
+
+static size_t alignUp(size_t offset) {
+    return (offset + ALIGNMENT - 1U) / ALIGNMENT * ALIGNMENT;
+}
+
+static bool writeColumns(const char* path, const std::vector<Column>& columns) {
+    size_t rows = columns[0].values.size();
+    size_t blocks = (rows + BLOCK_ROWS - 1U) / BLOCK_ROWS;
+
+    ColumnFileHeader header = {};
+    memcpy(header.magic, COLUMN_MAGIC, sizeof(header.magic));
+    header.columns = (uint32_t)columns.size();
+    header.block_rows = BLOCK_ROWS;
+    header.rows = rows;
+
+    std::vector<ColumnEntry> entries(columns.size());
+    size_t                   offset = alignUp(sizeof(header) + entries.size() * sizeof(ColumnEntry));
+    for (size_t c = 0; c < columns.size(); c++) {
+        snprintf(entries[c].name, sizeof(entries[c].name), "%s", columns[c].name.c_str());
+        entries[c].type = columns[c].type;
+        entries[c].data_offset = offset;
+        offset = alignUp(offset + rows * typeSize(columns[c].type));
+    }
+    for (size_t c = 0; c < columns.size(); c++) {
+        entries[c].stats_offset = offset;
+        offset = alignUp(offset + blocks * sizeof(BlockStats));
+    }
+
+    std::vector<uint8_t> file(offset, 0U);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), entries.data(), entries.size() * sizeof(ColumnEntry));
+    for (size_t c = 0; c < columns.size(); c++) {
+        const Column& column = columns[c];
+        uint8_t*      data = file.data() + entries[c].data_offset;
+        BlockStats*   stats = (BlockStats*)(file.data() + entries[c].stats_offset);
+        for (size_t row = 0; row < rows; row++) {
+            if (column.type == COLUMN_U64) {
+                memcpy(data + row * 8U, &column.values[row], 8U);
+            } else {
+                uint32_t value = (uint32_t)column.values[row];
+                memcpy(data + row * 4U, &value, 4U);
+            }
+            BlockStats& block = stats[row / BLOCK_ROWS];
+            uint64_t    value = column.type == COLUMN_I32 ? (uint64_t)column.signedAt(row) : column.values[row];
+            bool        first = row % BLOCK_ROWS == 0U;
+            if (column.type == COLUMN_I32) {
+                block.min = first || (int64_t)value < (int64_t)block.min ? value : block.min;
+                block.max = first || (int64_t)value > (int64_t)block.max ? value : block.max;
+            } else {
+                block.min = first || value < block.min ? value : block.min;
+                block.max = first || value > block.max ? value : block.max;
+            }
+        }
+    }
+
+    FILE* out = fopen(path, "wb");
+    bool  ok = out && fwrite(file.data(), 1, file.size(), out) == file.size();
+    ok = out && fclose(out) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "cannot write %s\n", path);
+    }
+    return ok;
+}
+
+static bool writeCsv(const char* path, const std::vector<Column>& columns) {
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "cannot write %s\n", path);
+        return false;
+    }
+    for (size_t c = 0; c < columns.size(); c++) {
+        fprintf(out, "%s%s", c ? "," : "", columns[c].name.c_str());
+    }
+    fputc('\n', out);
+    for (size_t row = 0; row < columns[0].values.size(); row++) {
+        for (size_t c = 0; c < columns.size(); c++) {
+            if (columns[c].type == COLUMN_I32) {
+                fprintf(out, "%s%lld", c ? "," : "", (long long)columns[c].signedAt(row));
+            } else {
+                fprintf(out, "%s%llu", c ? "," : "", (unsigned long long)columns[c].values[row]);
+            }
+        }
+        fputc('\n', out);
+    }
+    return fclose(out) == 0;
+}
+
+/**
+ * @brief A columnar file mapped read-only
+ */
+class ColumnFile {
+
+   public:
+    bool open(const char* path) {
+        int         fd = ::open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(ColumnFileHeader)) {
+            fprintf(stderr, "cannot open %s\n", path);
+            return false;
+        }
+        m_size = (size_t)st.st_size;
+        void* map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "cannot map %s\n", path);
+            return false;
+        }
+        m_data = (const uint8_t*)map;
+        m_header = (const ColumnFileHeader*)m_data;
+        m_entries = (const ColumnEntry*)(m_data + sizeof(ColumnFileHeader));
+        if (memcmp(m_header->magic, COLUMN_MAGIC, sizeof(COLUMN_MAGIC)) ||
+            sizeof(ColumnFileHeader) + m_header->columns * sizeof(ColumnEntry) > m_size) {
+            fprintf(stderr, "%s is not a column file\n", path);
+            return false;
+        }
+        return true;
+    }
+
+    const ColumnFileHeader& header() const {
+        return *m_header;
+    }
+    const ColumnEntry& entry(size_t column) const {
+        return m_entries[column];
+    }
+    size_t blocks() const {
+        return (m_header->rows + m_header->block_rows - 1U) / m_header->block_rows;
+    }
+    template <typename T>
+    const T* values(size_t column) const {
+        return (const T*)(m_data + m_entries[column].data_offset);
+    }
+    const BlockStats* stats(size_t column) const {
+        return (const BlockStats*)(m_data + m_entries[column].stats_offset);
+    }
+
+    /**
+     * @brief Find a column by name
+     * @return the number of columns if there is none
+     */
+    size_t find(const char* name) const {
+        size_t column = 0;
+        while (column < m_header->columns && strncmp(m_entries[column].name, name, sizeof(ColumnEntry::name))) {
+            column++;
+        }
+        return column;
+    }
+
+   private:
+    const uint8_t*          m_data = nullptr;
+    size_t                  m_size = 0U;
+    const ColumnFileHeader* m_header = nullptr;
+    const ColumnEntry*      m_entries = nullptr;
+};
+
+static int dump(const char* path) {
+    ColumnFile file;
+    if (!file.open(path)) {
+        return 1;
+    }
+    static const char* const types[] = {"u64", "i32", "u32"};
+    printf("%llu rows, %u columns, blocks of %u rows\n", (unsigned long long)file.header().rows,
+           file.header().columns, file.header().block_rows);
+    for (size_t c = 0; c < file.header().columns; c++) {
+        const ColumnEntry& entry = file.entry(c);
+        const BlockStats*  stats = file.stats(c);
+        bool               is_signed = entry.type == COLUMN_I32;
+        long double        min = 0, max = 0;
+        for (size_t b = 0; b < file.blocks(); b++) {
+            long double lo = is_signed ? (long double)(int64_t)stats[b].min : (long double)stats[b].min;
+            long double hi = is_signed ? (long double)(int64_t)stats[b].max : (long double)stats[b].max;
+            min = b == 0U || lo < min ? lo : min;
+            max = b == 0U || hi > max ? hi : max;
+        }
+        printf("%-32.48s %s  min %.0Lf  max %.0Lf\n", entry.name, types[entry.type < 3U ? entry.type : 0U], min,
+               max);
+    }
+    return 0;
+}
+
+static double nowMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief The column as signed 64-bit values, whatever its type
+ */
+static int64_t valueAt(const ColumnFile& file, size_t column, size_t row) {
+    switch (file.entry(column).type) {
+        case COLUMN_U64:
+            return (int64_t)file.values<uint64_t>(column)[row];
+        case COLUMN_I32:
+            return file.values<int32_t>(column)[row];
+        default:
+            return file.values<uint32_t>(column)[row];
+    }
+}
+
+static int bench(const char* column_path, const char* csv_path, const char* column_name) {
+    // columnar: map the file, the column is there
+    double     start = nowMs();
+    ColumnFile file;
+    if (!file.open(column_path)) {
+        return 1;
+    }
+    size_t column = column_name ? file.find(column_name) : file.header().columns - 1U;
+    if (column >= file.header().columns) {
+        fprintf(stderr, "no column %s\n", column_name);
+        return 1;
+    }
+    size_t rows = file.header().rows;
+    double map_ms = nowMs() - start;
+    start = nowMs();
+    int64_t sum = 0, min = INT64_MAX, max = INT64_MIN;
+    for (size_t row = 0; row < rows; row++) {
+        int64_t value = valueAt(file, column, row);
+        sum += value;
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+    }
+    double sum_ms = nowMs() - start;
+    int64_t threshold = min + (max - min) / 2;
+
+    // rows above the threshold, reading only the blocks that can have some
+    start = nowMs();
+    const BlockStats* stats = file.stats(column);
+    size_t            above = 0U, blocks_read = 0U;
+    for (size_t b = 0; b < file.blocks(); b++) {
+        if ((int64_t)stats[b].max <= threshold) {  // the i32 statistics are sign-extended already
+            continue;
+        }
+        blocks_read++;
+        size_t end = (b + 1U) * file.header().block_rows < rows ? (b + 1U) * file.header().block_rows : rows;
+        for (size_t row = b * file.header().block_rows; row < end; row++) {
+            above += valueAt(file, column, row) > threshold;
+        }
+    }
+    double filter_ms = nowMs() - start;
+
+    // CSV: parse every field into typed arrays, as a dataframe loader does
+    start = nowMs();
+    int         fd = open(csv_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "cannot open %s\n", csv_path);
+        return 1;
+    }
+    std::vector<char> text((size_t)st.st_size + 1U);
+    if (read(fd, text.data(), (size_t)st.st_size) != st.st_size) {
+        fprintf(stderr, "cannot read %s\n", csv_path);
+        return 1;
+    }
+    close(fd);
+    text[(size_t)st.st_size] = '\0';
+    size_t                            columns = file.header().columns;
+    std::vector<std::vector<int64_t>> parsed(columns);
+    for (auto& values : parsed) {
+        values.reserve(rows);
+    }
+    const char* pos = strchr(text.data(), '\n');
+    while (pos && *++pos) {
+        for (size_t c = 0; c < columns; c++) {
+            char* end;
+            parsed[c].push_back(strtoll(pos, &end, 10));
+            pos = end + 1;  // the ',' or the '\n'
+        }
+    }
+    double  csv_ms = nowMs() - start;
+    int64_t csv_sum = 0;
+    size_t  csv_above = 0U;
+    start = nowMs();
+    for (int64_t value : parsed[column]) {
+        csv_sum += value;
+        csv_above += value > threshold;
+    }
+    double csv_scan_ms = nowMs() - start;
+
+    printf("%zu rows, %zu columns, column \"%.48s\"\n", rows, columns, file.entry(column).name);
+    printf("load:   columnar %8.3f ms (map)       csv %8.1f ms (parse, %zu MB)\n", map_ms, csv_ms,
+           (size_t)st.st_size >> 20);
+    printf("sum:    columnar %8.3f ms             csv %8.3f ms\n", sum_ms, csv_scan_ms);
+    printf("filter: columnar %8.3f ms, %zu of %zu blocks read, %zu rows above %lld\n", filter_ms, blocks_read,
+           file.blocks(), above, (long long)threshold);
+    if (sum != csv_sum || above != csv_above || parsed[column].size() != rows) {
+        printf("the csv disagrees: sum %lld, %zu rows above\n", (long long)csv_sum, csv_above);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* csv = nullptr;
+    const char* paths[3] = {nullptr, nullptr, nullptr};
+    char        mode = 'e';
+    size_t      count = 0U;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            csv = argv[++i];
+        } else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "-b")) {
+            mode = argv[i][1];
+        } else if (count < 3U) {
+            paths[count++] = argv[i];
+        }
+    }
+    if (mode == 'd' && count == 1U) {
+        return dump(paths[0]);
+    }
+    if (mode == 'b' && count >= 2U) {
+        return bench(paths[0], paths[1], paths[2]);
+    }
+    if (mode != 'e' || count != 2U) {
+        fprintf(stderr, "usage: %s [-c csv] capture columns | -d columns | -b columns csv [column]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Column> columns;
+    size_t              errors = 0U;
+    if (!readCapture(paths[0], columns, errors) || !writeColumns(paths[1], columns) ||
+        (csv && !writeCsv(csv, columns))) {
+        return 1;
+    }
+    fprintf(stderr, "%zu rows, %zu columns, %zu malformed frames\n", columns[0].values.size(), columns.size(),
+            errors);
+    return 0;
+}
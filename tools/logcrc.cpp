@@ -0,0 +1,126 @@
+/**
+ * @file logcrc.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Check the CRC of every region of a CrcSink capture and output the logger stream
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logcrc tools/logcrc.cpp
+Usage:  logcrc [-k] [capture|-] | logdecode > log.txt
+
+A CrcSink capture is a sequence of LOG_FRAME_CRC headers, each followed by the raw bytes of one region of the send
+buffer, see log_protocol.h. The regions with a matching CRC are written to stdout, which is the logger stream again.
+A corrupted region is dropped, or kept with -k, and the decoder resynchronizes on the next header. A report of the
+good, corrupted and lost regions goes to stderr.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "logstream.h"
+
+int main(int argc, char** argv) {
+    bool        keep_bad = false;
+    const char* input = "-";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-k")) {
+            keep_bad = true;
+        } else {
+            input = argv[i];
+        }
+    }
+    FILE* in = strcmp(input, "-") ? fopen(input, "rb") : stdin;
+    if (!in) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return 1;
+    }
+
+    std::vector<uint8_t> header, payload, region;
+    size_t               body_remaining = 0U, good = 0U, bad = 0U, lost = 0U, skipped = 0U, bytes = 0U;
+    uint32_t             expected_crc = 0U;
+    uint16_t             next_seq = 0U;
+    bool                 in_header = false, first = true;
+
+    uint8_t buffer[65536];
+    size_t  length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        for (size_t i = 0; i < length; i++) {
+            uint8_t byte = buffer[i];
+            if (body_remaining) {
+                size_t count = length - i < body_remaining ? length - i : body_remaining;
+                region.insert(region.end(), &buffer[i], &buffer[i] + count);
+                body_remaining -= count;
+                i += count - 1U;
+                if (body_remaining == 0U) {
+                    bool ok = logCrc32(region.data(), region.size()) == expected_crc;
+                    ok ? ++good : ++bad;
+                    if (ok || keep_bad) {
+                        fwrite(region.data(), 1, region.size(), stdout);
+                        bytes += region.size();
+                    }
+                }
+                continue;
+            }
+            if (!in_header) {
+                if (byte == LOG_FRAME_DELIMITER) {
+                    in_header = true;
+                    header.clear();
+                } else {
+                    ++skipped;  // not a region boundary, resynchronize on the next delimiter
+                }
+                continue;
+            }
+            if (byte != LOG_FRAME_DELIMITER) {
+                header.push_back(byte);
+                continue;
+            }
+            if (header.empty()) {
+                continue;  // two delimiters in a row, the second one opens the header
+            }
+            in_header = false;
+
+            FrameReader reader(nullptr, 0U);
+            if (cobsDecode(header.data(), header.size(), payload)) {
+                reader = FrameReader(payload.data(), payload.size());
+            }
+            bool     valid = reader.u8() == LOG_FRAME_CRC;
+            uint16_t seq = reader.u16();
+            uint16_t region_length = reader.u16();
+            expected_crc = reader.u32();
+            if (!valid || !reader.ok() || reader.remaining()) {
+                skipped += header.size() + 2U;
+                in_header = true;  // the closing delimiter may open the real header
+                header.clear();
+                continue;
+            }
+            if (!first) {
+                lost += (uint16_t)(seq - next_seq);
+            }
+            first = false;
+            next_seq = seq + 1U;
+            region.clear();
+            body_remaining = region_length;
+        }
+    }
+
+    fprintf(stderr, "%zu regions good, %zu corrupted%s, %zu lost, %zu bytes out, %zu bytes skipped\n", good, bad,
+            keep_bad ? " (kept)" : " (dropped)", lost, bytes, skipped);
+    return bad || lost ? 2 : 0;
+}
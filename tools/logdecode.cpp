@@ -0,0 +1,110 @@
+/**
+ * @file logdecode.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Decode a logger capture, converting the record timestamps to UTC
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logdecode tools/logdecode.cpp
+Usage:  logdecode [capture|-] > log.txt
+
+Prints the text records of a capture with the "[timestamp] " prefix replaced by UTC time. The time sync responses of
+the whole capture are read first, so records before the first sync are converted too. Without any sync response the
+prefix is kept as it is.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "logtime.h"
+
+/**
+ * @brief A text line with its unwrapped device timestamp
+ */
+struct Line {
+    std::string text;
+    uint64_t    device_time;
+    bool        has_time;
+};
+
+int main(int argc, char** argv) {
+    const char* input = argc > 1 ? argv[1] : "-";
+    FILE*       in = strcmp(input, "-") ? fopen(input, "rb") : stdin;
+    if (!in) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return 1;
+    }
+
+    TimestampUnwrapper unwrapper;
+    ClockMapper        mapper;
+    std::vector<Line>  lines;
+    std::string        pending;  // text of the line being received
+    size_t             errors = 0;
+
+    LogStreamDecoder decoder;
+    decoder.onText = [&](const char* text, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            pending.push_back(text[i]);
+            if (text[i] != '\n') {
+                continue;
+            }
+            uint32_t timestamp;
+            size_t   prefix = parseTimestampPrefix(pending.data(), pending.size(), timestamp);
+            if (prefix) {
+                lines.push_back({pending.substr(prefix), unwrapper.unwrap(timestamp), true});
+            } else {
+                lines.push_back({pending, 0U, false});
+            }
+            pending.clear();
+        }
+    };
+    decoder.onFrame = [&](const uint8_t* payload, size_t length) {
+        int64_t  host_us;
+        uint32_t device_time, device_hz;
+        if (parseSyncResponse(payload, length, host_us, device_time, device_hz)) {
+            mapper.addPoint(unwrapper.unwrap(device_time), host_us, device_hz);
+        }
+    };
+    decoder.onError = [&]() { ++errors; };
+
+    uint8_t buffer[65536];
+    size_t  length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        decoder.feed(buffer, length);
+    }
+    decoder.finish();
+
+    for (const Line& line : lines) {
+        if (line.has_time && mapper.ready()) {
+            printf("%s %s", ClockMapper::formatUtc(mapper.toHostUs(line.device_time)).c_str(), line.text.c_str());
+        } else if (line.has_time) {
+            printf("[%u] %s", (uint32_t)line.device_time, line.text.c_str());
+        } else {
+            fputs(line.text.c_str(), stdout);
+        }
+    }
+    if (!pending.empty()) {
+        fputs(pending.c_str(), stdout);
+    }
+    if (errors) {
+        fprintf(stderr, "%zu malformed frames\n", errors);
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file logdemux.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Split the capture of a ChannelMux into one stream per virtual channel
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logdemux tools/logdemux.cpp
+Usage:  logdemux [-p prefix] [-c channel=path ...] [capture|-]
+
+A ChannelMux capture is a sequence of LOG_FRAME_CHANNEL headers, each followed by the raw bytes of one chunk of a
+virtual channel, see log_protocol.h. Every channel is written to [prefix]<channel>.log (prefix "channel" by default)
+or to the path given with -c, which can be a named pipe feeding another tool, e.g. -c 1=/tmp/telemetry.fifo. The
+capture is processed as it's read, so it works on a live serial stream too. A report of the bytes per channel, their
+share of the link and the lost chunks goes to stderr.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "logstream.h"
+
+/**
+ * @brief Output and statistics of one channel
+ */
+struct Channel {
+    FILE*   out = nullptr;
+    size_t  chunks = 0U;
+    size_t  bytes = 0U;
+    size_t  lost_chunks = 0U;  // gaps in seq
+    uint8_t next_seq = 0U;
+};
+
+int main(int argc, char** argv) {
+    std::string                   prefix = "channel";
+    std::map<uint8_t, std::string> paths;
+    const char*                   input = "-";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            prefix = argv[++i];
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            const char* spec = argv[++i];
+            const char* eq = strchr(spec, '=');
+            if (!eq) {
+                fprintf(stderr, "bad channel spec %s, expected channel=path\n", spec);
+                return 1;
+            }
+            paths[(uint8_t)atoi(spec)] = eq + 1;
+        } else {
+            input = argv[i];
+        }
+    }
+    FILE* in = strcmp(input, "-") ? fopen(input, "rb") : stdin;
+    if (!in) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return 1;
+    }
+
+    std::map<uint8_t, Channel> channels;
+    std::vector<uint8_t>       header, payload;
+    size_t                     body_remaining = 0U, skipped = 0U, header_bytes = 0U, total = 0U;
+    Channel*                   current = nullptr;
+    bool                       in_header = false;
+
+    uint8_t buffer[65536];
+    size_t  length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        for (size_t i = 0; i < length; i++) {
+            uint8_t byte = buffer[i];
+            if (body_remaining) {
+                // copy the rest of the body, or the part of it in this read
+                size_t count = length - i < body_remaining ? length - i : body_remaining;
+                fwrite(&buffer[i], 1, count, current->out);
+                current->bytes += count;
+                body_remaining -= count;
+                i += count - 1U;
+                continue;
+            }
+            if (!in_header) {
+                if (byte == LOG_FRAME_DELIMITER) {
+                    in_header = true;
+                    header.clear();
+                } else {
+                    ++skipped;  // not a chunk boundary, resynchronize on the next delimiter
+                }
+                continue;
+            }
+            if (byte != LOG_FRAME_DELIMITER) {
+                header.push_back(byte);
+                continue;
+            }
+            if (header.empty()) {
+                continue;  // two delimiters in a row, the second one opens the header
+            }
+            in_header = false;
+            header_bytes += header.size() + 2U;
+
+            FrameReader reader(nullptr, 0U);
+            if (cobsDecode(header.data(), header.size(), payload)) {
+                reader = FrameReader(payload.data(), payload.size());
+            }
+            bool     valid = reader.u8() == LOG_FRAME_CHANNEL;
+            uint8_t  id = reader.u8();
+            uint8_t  seq = reader.u8();
+            uint16_t chunk = reader.u16();
+            if (!valid || !reader.ok()) {
+                skipped += header.size() + 2U;
+                in_header = true;  // the closing delimiter may open the real header
+                header.clear();
+                continue;
+            }
+
+            Channel& channel = channels[id];
+            if (!channel.out) {
+                std::string path = paths.count(id) ? paths[id] : prefix + std::to_string(id) + ".log";
+                channel.out = fopen(path.c_str(), "wb");
+                if (!channel.out) {
+                    fprintf(stderr, "cannot open %s\n", path.c_str());
+                    return 1;
+                }
+                channel.next_seq = seq;
+            }
+            channel.lost_chunks += (uint8_t)(seq - channel.next_seq);
+            channel.next_seq = seq + 1U;
+            channel.chunks++;
+            current = &channel;
+            body_remaining = chunk;
+        }
+    }
+
+    for (auto& entry : channels) {
+        total += entry.second.bytes;
+    }
+    for (auto& entry : channels) {
+        fclose(entry.second.out);
+        fprintf(stderr, "channel %u: %zu chunks, %zu bytes (%.1f%%), %zu lost chunks\n", entry.first,
+                entry.second.chunks, entry.second.bytes, total ? 100.0 * entry.second.bytes / total : 0.0,
+                entry.second.lost_chunks);
+    }
+    fprintf(stderr, "%zu header bytes, %zu skipped bytes\n", header_bytes, skipped);
+    return 0;
+}
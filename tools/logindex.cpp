@@ -0,0 +1,570 @@
+/**
+ * @file logindex.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Store captures in an append-only log with a sparse index, and query it by time, level and tag
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logindex tools/logindex.cpp
+Usage:  logindex ingest store [capture|-]
+        logindex query store [-f from] [-t to] [-l levels] [-g tag] [-s]
+        logindex bench store [queries]
+
+ingest appends the text records of a capture to store.log, exactly as they were received, and one entry per block of
+about BLOCK_SIZE bytes to store.idx: the offset of the block, its unwrapped device time range, the levels it holds
+and a 64-bit Bloom filter of its tags, see logrecord.h for the levels and the tags. The time sync points of the
+capture (LOG_FRAME_SYNC_RESPONSE, see timesync.h) go to store.sync with their unwrapped device time, written with the
+block they fall in. Several captures can be ingested one after the other, the device time continues across them, and
+a block or sync points written without their index entry by an interrupted ingest are dropped by the next one.
+
+query prints the records between [from] and [to], of the [levels] (e for Error, w for Warning, i for Info, o for
+records without a level) and the [tag]. The bounds are unwrapped device times (ticks of the cycle counter), or UTC as
+printed by logdecode (2023-03-31T12:00:00.250000Z) converted to device time with the ClockMapper of logtime.h fitted
+on the sync points of the store. The files are memory-mapped, the index is binary-searched for [from] and only the
+blocks whose range, levels and tags can match are read. -s reads every block instead, a linear scan with the same line
+parser, for comparison.
+
+bench times [queries] random "errors in 1% of the time span" queries with the index and with the linear scan.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "logrecord.h"
+#include "logtime.h"
+
+static constexpr char     INDEX_MAGIC[8] = {'L', 'O', 'G', 'I', 'D', 'X', '1', '\0'};
+static constexpr char     SYNC_MAGIC[8] = {'L', 'O', 'G', 'S', 'Y', 'N', '1', '\0'};
+static constexpr uint32_t BLOCK_SIZE = 16384U;  // bytes of records per index entry
+
+/**
+ * @brief An entry of store.idx, describing one block of store.log
+ */
+struct IndexEntry {
+    uint64_t offset;      // of the block in store.log
+    uint64_t start_time;  // unwrapped time before the first record of the block
+    uint64_t end_time;    // after its last record
+    uint64_t min_time;    // range of its records, a record without timestamp has the time of the one before
+    uint64_t max_time;
+    uint64_t tags;        // Bloom filter of the tags, one bit per tag
+    uint32_t length;
+    uint32_t records;
+    uint8_t  levels;
+    uint8_t  started;     // if a timestamp was seen before the block, start_time is valid
+    uint8_t  reserved[6];
+};
+static_assert(sizeof(IndexEntry) == 64U, "the index entries are read as they are");
+
+/**
+ * @brief An entry of store.sync, a time sync point
+ */
+struct SyncEntry {
+    uint64_t device_time;  // unwrapped, on the time line of the index
+    int64_t  host_us;      // UTC microseconds
+    uint32_t device_hz;
+    uint32_t reserved;
+};
+static_assert(sizeof(SyncEntry) == 24U, "the sync entries are read as they are");
+
+/**
+ * @brief The Bloom bit of a tag, FNV-1a
+ */
+static uint64_t tagBit(const char* tag, size_t length) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)tag[i]) * 16777619U;
+    }
+    return 1ULL << (hash & 63U);
+}
+
+/**
+ * @brief A read-only memory-mapped file
+ */
+class MappedFile {
+
+   public:
+    ~MappedFile() {
+        if (m_size) {
+            munmap((void*)m_data, m_size);
+        }
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        bool        ok = !fstat(fd, &st);
+        m_size = ok ? (size_t)st.st_size : 0U;
+        if (m_size) {
+            void* map = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = map != MAP_FAILED;
+            m_data = ok ? (const char*)map : nullptr;
+            m_size = ok ? m_size : 0U;
+        }
+        close(fd);
+        return ok;
+    }
+
+    const char* data() const {
+        return m_data;
+    }
+    size_t size() const {
+        return m_size;
+    }
+
+   private:
+    const char* m_data = nullptr;
+    size_t      m_size = 0U;
+};
+
+/**
+ * @brief Appends records to store.log and the entries of the full blocks to store.idx
+ */
+class Ingester {
+
+   public:
+    bool open(const std::string& store) {
+        std::string log_path = store + ".log", index_path = store + ".idx", sync_path = store + ".sync";
+        int         index_fd = ::open(index_path.c_str(), O_RDWR | O_CREAT, 0644);
+        int         log_fd = ::open(log_path.c_str(), O_RDWR | O_CREAT, 0644);
+        int         sync_fd = ::open(sync_path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (index_fd < 0 || log_fd < 0 || sync_fd < 0) {
+            fprintf(stderr, "cannot open %s\n", store.c_str());
+            return false;
+        }
+
+        // resume after the last complete entry, an entry or a block cut short by an interrupted ingest is dropped
+        struct stat st;
+        fstat(index_fd, &st);
+        size_t entries = st.st_size >= (off_t)sizeof(INDEX_MAGIC) ? (st.st_size - sizeof(INDEX_MAGIC)) /
+                                                                         sizeof(IndexEntry)
+                                                                   : 0U;
+        char magic[sizeof(INDEX_MAGIC)];
+        if (st.st_size >= (off_t)sizeof(INDEX_MAGIC) &&
+            (pread(index_fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) ||
+             memcmp(magic, INDEX_MAGIC, sizeof(magic)))) {
+            fprintf(stderr, "%s is not an index\n", index_path.c_str());
+            return false;
+        }
+        IndexEntry last;
+        if (entries) {
+            pread(index_fd, &last, sizeof(last), (off_t)(sizeof(INDEX_MAGIC) + (entries - 1U) * sizeof(last)));
+            m_offset = last.offset + last.length;
+            if (last.started) {
+                m_unwrapper = TimestampUnwrapper(last.end_time);
+            }
+        }
+
+        // the sync points are written before the entry of their block, the ones after the last entry are dropped
+        fstat(sync_fd, &st);
+        size_t syncs = st.st_size >= (off_t)sizeof(SYNC_MAGIC) ? (st.st_size - sizeof(SYNC_MAGIC)) / sizeof(SyncEntry)
+                                                               : 0U;
+        if (st.st_size >= (off_t)sizeof(SYNC_MAGIC) &&
+            (pread(sync_fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic) ||
+             memcmp(magic, SYNC_MAGIC, sizeof(magic)))) {
+            fprintf(stderr, "%s is not a sync file\n", sync_path.c_str());
+            return false;
+        }
+        SyncEntry point;
+        while (syncs && (!entries ||
+                         pread(sync_fd, &point, sizeof(point),
+                               (off_t)(sizeof(SYNC_MAGIC) + (syncs - 1U) * sizeof(point))) != (ssize_t)sizeof(point) ||
+                         point.device_time > last.end_time)) {
+            syncs--;
+        }
+
+        if (ftruncate(index_fd, (off_t)(sizeof(INDEX_MAGIC) + entries * sizeof(IndexEntry))) ||
+            ftruncate(log_fd, (off_t)m_offset) ||
+            ftruncate(sync_fd, (off_t)(sizeof(SYNC_MAGIC) + syncs * sizeof(SyncEntry))) ||
+            (!entries && pwrite(index_fd, INDEX_MAGIC, sizeof(INDEX_MAGIC), 0) != (ssize_t)sizeof(INDEX_MAGIC)) ||
+            pwrite(sync_fd, SYNC_MAGIC, sizeof(SYNC_MAGIC), 0) != (ssize_t)sizeof(SYNC_MAGIC)) {
+            fprintf(stderr, "cannot resume %s\n", store.c_str());
+            return false;
+        }
+        lseek(index_fd, 0, SEEK_END);
+        lseek(log_fd, 0, SEEK_END);
+        lseek(sync_fd, 0, SEEK_END);
+        m_index = fdopen(index_fd, "ab");
+        m_log = fdopen(log_fd, "ab");
+        m_sync = fdopen(sync_fd, "ab");
+        m_entries = entries;
+        m_syncs = syncs;
+        startBlock();
+        return m_index && m_log && m_sync;
+    }
+
+    /**
+     * @brief Append a complete record, with its '\n'
+     */
+    void add(const char* line, size_t length) {
+        uint32_t timestamp;
+        size_t   prefix = parseTimestampPrefix(line, length, timestamp);
+        uint64_t time = prefix ? m_unwrapper.unwrap(timestamp) : m_unwrapper.last();
+        Record   record = classifyRecord(line + prefix, length - prefix);
+
+        if (m_block.records == 0U || time < m_block.min_time) {
+            m_block.min_time = time;
+        }
+        m_block.max_time = std::max(m_block.max_time, time);
+        m_block.levels |= record.level;
+        m_block.tags |= record.tag ? tagBit(record.tag, record.tag_length) : 0U;
+        m_block.length += (uint32_t)length;
+        m_block.records++;
+        fwrite(line, 1, length, m_log);
+        if (m_block.length >= BLOCK_SIZE) {
+            finishBlock();
+        }
+    }
+
+    /**
+     * @brief Add a time sync point, on the time line of the records
+     */
+    void addSync(uint32_t device_time, int64_t host_us, uint32_t device_hz) {
+        m_pending_syncs.push_back({m_unwrapper.unwrap(device_time), host_us, device_hz, 0U});
+    }
+
+    /**
+     * @brief Write the last block, the log before its entry so that an interrupted ingest never indexes missing data
+     * @note The sync points after the last record are left out, like an unfinished record
+     */
+    void close() {
+        finishBlock();
+        fclose(m_log);
+        fclose(m_index);
+        fclose(m_sync);
+        fprintf(stderr, "%zu blocks, %zu sync points, %llu bytes\n", m_entries, m_syncs,
+                (unsigned long long)m_offset);
+    }
+
+   private:
+    void startBlock() {
+        memset(&m_block, 0, sizeof(m_block));
+        m_block.offset = m_offset;
+        m_block.started = m_unwrapper.started();
+        m_block.start_time = m_unwrapper.last();
+    }
+
+    void finishBlock() {
+        if (!m_block.records) {
+            return;
+        }
+        m_block.end_time = m_unwrapper.last();
+        fflush(m_log);
+        fwrite(m_pending_syncs.data(), sizeof(SyncEntry), m_pending_syncs.size(), m_sync);
+        fflush(m_sync);
+        m_syncs += m_pending_syncs.size();
+        m_pending_syncs.clear();
+        fwrite(&m_block, sizeof(m_block), 1, m_index);
+        fflush(m_index);
+        m_offset += m_block.length;
+        m_entries++;
+        startBlock();
+    }
+
+    FILE*                  m_log = nullptr;
+    FILE*                  m_index = nullptr;
+    FILE*                  m_sync = nullptr;
+    uint64_t               m_offset = 0U;  // end of the indexed records
+    size_t                 m_entries = 0U;
+    size_t                 m_syncs = 0U;
+    std::vector<SyncEntry> m_pending_syncs;  // in the block being written
+    TimestampUnwrapper     m_unwrapper;
+    IndexEntry             m_block;
+};
+
+/**
+ * @brief What to look for
+ */
+struct Query {
+    uint64_t    from = 0U;
+    uint64_t    to = UINT64_MAX;
+    uint8_t     levels = LEVEL_ALL;
+    std::string tag;
+};
+
+/**
+ * @brief The memory-mapped store
+ */
+class Store {
+
+   public:
+    bool open(const std::string& store) {
+        if (!m_log.open(store + ".log") || !m_index.open(store + ".idx") || m_index.size() < sizeof(INDEX_MAGIC) ||
+            memcmp(m_index.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC))) {
+            fprintf(stderr, "cannot open %s\n", store.c_str());
+            return false;
+        }
+        m_entries = (const IndexEntry*)(m_index.data() + sizeof(INDEX_MAGIC));
+        m_count = (m_index.size() - sizeof(INDEX_MAGIC)) / sizeof(IndexEntry);
+
+        // a store written before the sync points has no store.sync, its bounds are device times only
+        MappedFile sync;
+        if (sync.open(store + ".sync") && sync.size() >= sizeof(SYNC_MAGIC) &&
+            !memcmp(sync.data(), SYNC_MAGIC, sizeof(SYNC_MAGIC))) {
+            const SyncEntry* points = (const SyncEntry*)(sync.data() + sizeof(SYNC_MAGIC));
+            for (size_t i = 0; i < (sync.size() - sizeof(SYNC_MAGIC)) / sizeof(SyncEntry); i++) {
+                m_mapper.addPoint(points[i].device_time, points[i].host_us, points[i].device_hz);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Convert a bound given as UTC to device time, the microsecond of [host_us] is included either way
+     * @param end the upper bound: the last device time before the next microsecond
+     * @return false if the store has no sync point
+     */
+    bool toDeviceTime(int64_t host_us, bool end, uint64_t& device_time) {
+        if (!m_mapper.ready()) {
+            return false;
+        }
+        device_time = end ? m_mapper.toDeviceTime(host_us + 1) - 1U : m_mapper.toDeviceTime(host_us);
+        return true;
+    }
+
+    /**
+     * @brief Call found(line, length) for every matching record
+     * @param scan read every block instead of using the index
+     * @return the number of blocks read
+     */
+    template <typename F>
+    size_t run(const Query& query, bool scan, F found) const {
+        uint64_t tag_bit = query.tag.empty() ? 0U : tagBit(query.tag.data(), query.tag.size());
+        size_t   first = 0U, read = 0U;
+        if (!scan) {
+            // the block ranges only step back by the few ticks of a preempted record, max_time is sorted
+            first = (size_t)(std::lower_bound(m_entries, m_entries + m_count, query.from,
+                                              [](const IndexEntry& entry, uint64_t from) {
+                                                  return entry.max_time < from;
+                                              }) -
+                             m_entries);
+        }
+        for (size_t i = first; i < m_count; i++) {
+            const IndexEntry& entry = m_entries[i];
+            if (!scan) {
+                if (entry.min_time > query.to) {
+                    break;
+                }
+                if (entry.max_time < query.from || !(entry.levels & query.levels) ||
+                    (tag_bit && !(entry.tags & tag_bit))) {
+                    continue;
+                }
+            }
+            if (entry.offset + entry.length > m_log.size()) {
+                break;  // ingest is still writing this block
+            }
+            read++;
+            scanBlock(entry, query, found);
+        }
+        return read;
+    }
+
+    size_t blocks() const {
+        return m_count;
+    }
+
+    /**
+     * @brief The device time span of the store
+     */
+    uint64_t firstTime() const {
+        return m_count ? m_entries[0].min_time : 0U;
+    }
+    uint64_t lastTime() const {
+        return m_count ? m_entries[m_count - 1U].max_time : 0U;
+    }
+
+   private:
+    template <typename F>
+    void scanBlock(const IndexEntry& entry, const Query& query, F found) const {
+        TimestampUnwrapper unwrapper = entry.started ? TimestampUnwrapper(entry.start_time) : TimestampUnwrapper();
+        const char*        line = m_log.data() + entry.offset;
+        const char*        end = line + entry.length;
+        while (line < end) {
+            const char* newline = (const char*)memchr(line, '\n', (size_t)(end - line));
+            size_t      length = newline ? (size_t)(newline - line) + 1U : (size_t)(end - line);
+            uint32_t    timestamp;
+            size_t      prefix = parseTimestampPrefix(line, length, timestamp);
+            uint64_t    time = prefix ? unwrapper.unwrap(timestamp) : unwrapper.last();
+            if (time >= query.from && time <= query.to) {
+                Record record = classifyRecord(line + prefix, length - prefix);
+                if ((record.level & query.levels) &&
+                    (query.tag.empty() || record.hasTag(query.tag))) {
+                    found(line, length);
+                }
+            }
+            line += length;
+        }
+    }
+
+    MappedFile        m_log;
+    MappedFile        m_index;
+    const IndexEntry* m_entries = nullptr;
+    size_t            m_count = 0U;
+    ClockMapper       m_mapper;
+};
+
+static int ingest(const std::string& store, const char* input) {
+    FILE* in = strcmp(input, "-") ? fopen(input, "rb") : stdin;
+    if (!in) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return 1;
+    }
+    Ingester ingester;
+    if (!ingester.open(store)) {
+        return 1;
+    }
+
+    std::string      pending;  // text of the record being received
+    LogStreamDecoder decoder;
+    decoder.onText = [&](const char* text, size_t length) {
+        while (length) {
+            const char* newline = (const char*)memchr(text, '\n', length);
+            size_t      part = newline ? (size_t)(newline - text) + 1U : length;
+            if (newline && pending.empty()) {
+                ingester.add(text, part);  // a record in one piece, no copy
+            } else {
+                pending.append(text, part);
+                if (newline) {
+                    ingester.add(pending.data(), pending.size());
+                    pending.clear();
+                }
+            }
+            text += part;
+            length -= part;
+        }
+    };
+    decoder.onFrame = [&](const uint8_t* payload, size_t length) {
+        int64_t  host_us;
+        uint32_t device_time, device_hz;
+        if (parseSyncResponse(payload, length, host_us, device_time, device_hz)) {
+            ingester.addSync(device_time, host_us, device_hz);
+        }
+    };
+
+    uint8_t buffer[65536];
+    size_t  length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        decoder.feed(buffer, length);
+    }
+    decoder.finish();
+    ingester.close();  // an unfinished last record is left out
+    return 0;
+}
+
+static double nowUs() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int bench(const Store& store, size_t queries) {
+    uint64_t first = store.firstTime(), span = store.lastTime() - first;
+    Query    query;
+    query.levels = LEVEL_ERROR;
+
+    std::mt19937_64     random(1);
+    std::vector<double> indexed_us, scan_us;
+    size_t              matches = 0U, blocks = 0U;
+    for (size_t i = 0; i < queries; i++) {
+        query.from = first + random() % (span - span / 100U + 1U);
+        query.to = query.from + span / 100U;
+        size_t found[2] = {0U, 0U};
+        for (int scan = 0; scan < 2; scan++) {
+            double start = nowUs();
+            size_t read = store.run(query, scan, [&](const char*, size_t) { found[scan]++; });
+            (scan ? scan_us : indexed_us).push_back(nowUs() - start);
+            blocks += scan ? 0U : read;
+        }
+        if (found[0] != found[1]) {
+            fprintf(stderr, "query %zu: %zu records with the index, %zu with the scan\n", i, found[0], found[1]);
+            return 1;
+        }
+        matches += found[0];
+    }
+    std::sort(indexed_us.begin(), indexed_us.end());
+    std::sort(scan_us.begin(), scan_us.end());
+    printf("%zu blocks, %zu queries, %.1f records and %.1f blocks read per query\n", store.blocks(), queries,
+           (double)matches / queries, (double)blocks / queries);
+    printf("index:  median %10.1f us, max %10.1f us\n", indexed_us[queries / 2U], indexed_us.back());
+    printf("scan:   median %10.1f us, max %10.1f us\n", scan_us[queries / 2U], scan_us.back());
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s ingest|query|bench store [...]\n", argv[0]);
+        return 1;
+    }
+    std::string command = argv[1], path = argv[2];
+    if (command == "ingest") {
+        return ingest(path, argc > 3 ? argv[3] : "-");
+    }
+
+    Store store;
+    if (!store.open(path)) {
+        return 1;
+    }
+    if (command == "bench") {
+        size_t queries = argc > 3 ? strtoul(argv[3], nullptr, 0) : 100U;
+        return queries && store.blocks() ? bench(store, queries) : 1;
+    }
+
+    Query query;
+    bool  scan = false;
+    for (int i = 3; i < argc; i++) {
+        if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "-t")) && i + 1 < argc) {
+            uint64_t& bound = argv[i][1] == 'f' ? query.from : query.to;
+            int64_t   host_us;
+            if (!ClockMapper::parseUtc(argv[++i], host_us)) {
+                bound = strtoull(argv[i], nullptr, 0);
+            } else if (!store.toDeviceTime(host_us, &bound == &query.to, bound)) {
+                fprintf(stderr, "no time sync point in %s for %s\n", path.c_str(), argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            if (!parseLevels(argv[++i], query.levels)) {
+                fprintf(stderr, "bad levels %s, expected letters of iweo\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+            query.tag = argv[++i];
+        } else if (!strcmp(argv[i], "-s")) {
+            scan = true;
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (command != "query") {
+        fprintf(stderr, "unknown command %s\n", command.c_str());
+        return 1;
+    }
+    store.run(query, scan, [](const char* line, size_t length) { fwrite(line, 1, length, stdout); });
+    return 0;
+}
@@ -0,0 +1,223 @@
+/**
+ * @file logmerge.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Merge the captures of bonded uarts back into a single logger stream
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logmerge tools/logmerge.cpp
+Usage:  logmerge [-o merged.log] link0.bin link1.bin [...]
+
+Every link capture of a bonded logger is a sequence of LOG_FRAME_BOND headers, each followed by the raw bytes of one
+part, see log_protocol.h. The parts of all links are put back in (span_seq, part) order and written to the output
+(stdout by default), which is then the same stream a single uart would have carried and can be fed to the other tools.
+
+The captures are given in link order. A report goes to stderr: the parts and bytes carried by each link, the parts
+lost (gaps in link_seq, incomplete spans) and the throughput scaling, i.e. the payload of all links divided by the
+bytes of the busiest link, which is the speed-up over sending the same payload on one uart of the same baud rate.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "logstream.h"
+
+/**
+ * @brief One part received on a link
+ */
+struct Part {
+    uint16_t             link_seq;
+    uint16_t             span_seq;
+    uint8_t              index;
+    uint8_t              parts;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Statistics of one link
+ */
+struct LinkStats {
+    size_t parts = 0U;
+    size_t payload_bytes = 0U;   // raw bytes of the parts
+    size_t header_bytes = 0U;    // encoded bond headers
+    size_t lost_parts = 0U;      // gaps in link_seq
+    size_t skipped_bytes = 0U;   // bytes dropped while resynchronizing
+};
+
+/**
+ * @brief Split a link capture into parts. A malformed header is skipped up to the next delimiter
+ */
+static void parseLink(const std::vector<uint8_t>& capture, std::vector<Part>& parts, LinkStats& stats) {
+    std::vector<uint8_t> payload;
+    size_t               pos = 0;
+    while (pos < capture.size()) {
+        if (capture[pos] != LOG_FRAME_DELIMITER) {
+            ++stats.skipped_bytes;
+            ++pos;
+            continue;
+        }
+        size_t end = pos + 1;
+        while (end < capture.size() && capture[end] != LOG_FRAME_DELIMITER) {
+            ++end;
+        }
+        if (end == capture.size()) {
+            stats.skipped_bytes += end - pos;  // truncated header at the end of the capture
+            break;
+        }
+
+        bool        decoded = end > pos + 1 && cobsDecode(&capture[pos + 1], end - pos - 1, payload);
+        FrameReader reader(payload.data(), decoded ? payload.size() : 0U);
+        Part part;
+        bool valid = reader.u8() == LOG_FRAME_BOND;
+        part.link_seq = reader.u16();
+        part.span_seq = reader.u16();
+        part.index = reader.u8();
+        part.parts = reader.u8();
+        uint16_t length = reader.u16();
+        valid = valid && reader.ok() && part.index < part.parts && end + 1 + length <= capture.size();
+        if (!valid) {
+            // Not a header (e.g. the closing delimiter of a frame inside the last part), continue from the delimiter
+            stats.skipped_bytes += end - pos;
+            pos = end;
+            continue;
+        }
+
+        if (!parts.empty()) {
+            stats.lost_parts += (uint16_t)(part.link_seq - parts.back().link_seq - 1U);
+        }
+        part.data.assign(capture.begin() + end + 1, capture.begin() + end + 1 + length);
+        stats.parts++;
+        stats.payload_bytes += length;
+        stats.header_bytes += end + 1 - pos;
+        parts.push_back(std::move(part));
+        pos = end + 1 + length;
+    }
+}
+
+/**
+ * @brief Unwrap a 16-bit sequence number to the value closest to [reference]
+ */
+static int64_t unwrapNear(uint16_t seq, int64_t reference) {
+    return reference + (int16_t)(seq - (uint16_t)reference);
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data) {
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        return false;
+    }
+    uint8_t buffer[65536];
+    size_t  length;
+    while ((length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        data.insert(data.end(), buffer, buffer + length);
+    }
+    fclose(in);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char*              output = nullptr;
+    std::vector<const char*> inputs;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty()) {
+        fprintf(stderr, "usage: %s [-o merged.log] link0.bin link1.bin [...]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<std::vector<Part>> links(inputs.size());
+    std::vector<LinkStats>         stats(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::vector<uint8_t> capture;
+        if (!readFile(inputs[i], capture)) {
+            fprintf(stderr, "cannot open %s\n", inputs[i]);
+            return 1;
+        }
+        parseLink(capture, links[i], stats[i]);
+    }
+
+    // All links count the same spans, so the first span of the first non-empty link is the common reference
+    int64_t reference = -1;
+    for (const std::vector<Part>& parts : links) {
+        if (!parts.empty()) {
+            reference = parts.front().span_seq;
+            break;
+        }
+    }
+
+    struct Span {
+        uint8_t                                        parts = 0U;
+        std::map<uint8_t, const std::vector<uint8_t>*> data;  // the parts received, by index
+    };
+    std::map<int64_t, Span> spans;
+    for (const std::vector<Part>& parts : links) {
+        int64_t seq = reference;
+        for (const Part& part : parts) {
+            seq = unwrapNear(part.span_seq, seq);
+            Span& span = spans[seq];
+            span.parts = part.parts;
+            span.data[part.index] = &part.data;
+        }
+    }
+
+    FILE* out = output ? fopen(output, "wb") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot open %s\n", output);
+        return 1;
+    }
+    size_t  total_payload = 0U, incomplete = 0U, missing_spans = 0U;
+    int64_t previous = spans.empty() ? 0 : spans.begin()->first - 1;
+    for (const auto& entry : spans) {
+        missing_spans += entry.first - previous - 1;
+        previous = entry.first;
+        if (entry.second.data.size() != entry.second.parts) {
+            ++incomplete;
+        }
+        for (const auto& part : entry.second.data) {
+            fwrite(part.second->data(), 1, part.second->size(), out);
+            total_payload += part.second->size();
+        }
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    size_t busiest = 0U;
+    for (size_t i = 0; i < stats.size(); i++) {
+        size_t bytes = stats[i].payload_bytes + stats[i].header_bytes;
+        busiest = bytes > busiest ? bytes : busiest;
+        fprintf(stderr, "link %zu: %zu parts, %zu payload bytes, %zu header bytes, %zu lost parts, %zu skipped bytes\n",
+                i, stats[i].parts, stats[i].payload_bytes, stats[i].header_bytes, stats[i].lost_parts,
+                stats[i].skipped_bytes);
+    }
+    fprintf(stderr, "%zu spans, %zu incomplete, %zu missing, %zu payload bytes\n", spans.size(), incomplete,
+            missing_spans, total_payload);
+    if (busiest) {
+        fprintf(stderr, "throughput scaling: %.2fx over a single link (%zu links)\n", (double)total_payload / busiest,
+                stats.size());
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file logmetrics.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Host-side state of the metrics frames
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "logstream.h"
+
+/**
+ * @brief The values of the metrics, following the key frames and the deltas of LOG_FRAME_METRICS
+ */
+class MetricsState {
+
+   public:
+    /**
+     * @brief Apply a metrics or descriptor frame
+     * @return true if the values have been updated
+     */
+    bool apply(const uint8_t* payload, size_t length) {
+        FrameReader reader(payload, length);
+        uint8_t     type = reader.u8();
+
+        if (type == LOG_FRAME_METRICS_DESC) {
+            uint8_t id = reader.u8();
+            uint8_t kind = reader.u8();
+            if (!reader.ok()) {
+                return false;
+            }
+            resize(id + 1U);
+            m_metrics[id].kind = (LogMetricKind)kind;
+            m_metrics[id].name.assign((const char*)reader.rest(), reader.remaining());
+            return false;
+        }
+        if (type != LOG_FRAME_METRICS) {
+            return false;
+        }
+
+        uint16_t seq = reader.u16();
+        uint8_t  flags = reader.u8();
+        uint8_t  count = reader.u8();
+        std::vector<uint32_t> values(count);
+        for (uint8_t i = 0; i < count; i++) {
+            values[i] = reader.varint();
+        }
+        if (!reader.ok()) {
+            return false;
+        }
+
+        bool key_frame = flags & LOG_FRAME_FLAG_KEY;
+        if (!key_frame && (!m_synced || seq != (uint16_t)(m_seq + 1U))) {
+            m_synced = false;  // a frame is lost, wait for the next key frame
+            return false;
+        }
+        resize(count);
+        for (uint8_t i = 0; i < count; i++) {
+            int32_t value = logUnzigzag(values[i]);
+            m_metrics[i].value = key_frame ? (uint32_t)value : m_metrics[i].value + (uint32_t)value;
+        }
+        m_seq = seq;
+        m_synced = true;
+        return true;
+    }
+
+    /**
+     * @brief The metrics seen so far, a metric is named once its descriptor has been received
+     */
+    size_t size() const {
+        return m_metrics.size();
+    }
+    const std::string& name(size_t id) const {
+        return m_metrics[id].name;
+    }
+    LogMetricKind kind(size_t id) const {
+        return m_metrics[id].kind;
+    }
+    uint32_t value(size_t id) const {
+        return m_metrics[id].value;
+    }
+
+    /**
+     * @brief The sequence number of the last applied frame
+     */
+    uint16_t seq() const {
+        return m_seq;
+    }
+
+   private:
+    struct Metric {
+        std::string   name;
+        LogMetricKind kind = LOG_METRIC_GAUGE;
+        uint32_t      value = 0U;
+    };
+
+    void resize(size_t count) {
+        if (m_metrics.size() < count) {
+            m_metrics.resize(count);
+        }
+    }
+
+    std::vector<Metric> m_metrics;
+    uint16_t            m_seq = 0U;
+    bool                m_synced = false;  // if a key frame has been received and no frame has been lost since
+};
@@ -0,0 +1,386 @@
+/**
+ * @file logpdecode.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Decode a large logger capture on all cores, with the same output as logdecode
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -pthread -o logpdecode tools/logpdecode.cpp
+Usage:  logpdecode [-j threads] capture > log.txt
+        logpdecode -b capture           benchmark 1, 2, 4, 8 and 16 threads, nothing is printed
+
+The capture is memory-mapped and cut into chunks of about CHUNK_SIZE bytes, at least one per thread, which the threads
+take in order. Every 0x00 toggles the stream between text and frame, so after counting the delimiters of each chunk in
+parallel, the state at any offset is known without decoding what's before it. Each chunk start is then moved forward to
+the next line start in text, so no line or frame straddles two chunks and every chunk decodes on its own with a fresh
+LogStreamDecoder.
+
+The UTC of a line depends on the sync responses of the whole capture, so the chunks are decoded twice. The first pass
+only keeps their sync responses and their first and last timestamps, unwrapped relative to the chunk. Once these are
+chained in order, every chunk knows the unwrapped time before it and one ClockMapper is fitted on all the sync
+responses. The second pass formats the chunks with them and writes each one as soon as it and all the chunks before it
+are done, then frees it: at most WINDOW chunks per thread are held, whatever the size of the capture. The output is
+byte for byte the one of logdecode, which reads a pipe when the capture isn't a file.
+
+The delimiter count is only right while the stream is in phase. After a malformed frame the decoder resynchronizes
+(see log_protocol.h), so a chunk can end out of the text or in the middle of a line: the first pass then decodes the
+next chunk again from the state the previous one ended in, in order, and the second pass starts it from that state.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logtime.h"
+
+static constexpr size_t CHUNK_SIZE = 4U << 20;  // bytes of capture per chunk
+static constexpr size_t WINDOW = 2U;            // chunks in flight per thread in the second pass
+
+/**
+ * @brief A sync response of a chunk
+ */
+struct Sync {
+    uint64_t device_time;
+    int64_t  host_us;
+    uint32_t device_hz;
+};
+
+/**
+ * @brief One chunk of the capture, what the first pass learnt about it and the output of the second one
+ */
+struct Chunk {
+    size_t            begin = 0U;
+    size_t            end = 0U;
+    size_t            delimiters = 0U;  // 0x00 bytes between the nominal start and the next nominal start
+    std::vector<Sync> syncs;
+    std::string       pending;          // an unfinished last line
+    LogStreamDecoder  state;            // the decoder at the end of the chunk, without its callbacks
+    bool              continued = false;  // decoded from the state and the pending line of the previous chunk
+    size_t            errors = 0U;
+    bool              has_time = false;   // if any timestamp was unwrapped
+    uint32_t          first_time = 0U;    // the raw first timestamp
+    uint64_t          last_time = 0U;     // the last timestamp, unwrapped relative to the first one
+    bool              started = false;    // if a timestamp was unwrapped before the chunk
+    uint64_t          start_time = 0U;    // the last unwrapped timestamp before the chunk
+    std::string       output;
+    bool              done = false;
+};
+
+/**
+ * @brief Run fn(i) for every i below [count], on [threads] threads taking the indices in order
+ */
+template <typename F>
+static void parallel(size_t threads, size_t count, F fn) {
+    std::atomic<size_t>      next(0U);
+    auto                     run = [&] {
+        for (size_t i; (i = next++) < count;) {
+            fn(i);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads && i < count; i++) {
+        pool.emplace_back(run);
+    }
+    run();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Move the start of a chunk to the first line start in text at or after it
+ * @param in_frame the stream state at data[begin]
+ */
+static size_t findLineStart(const uint8_t* data, size_t begin, size_t size, bool in_frame) {
+    for (size_t i = begin; i < size; i++) {
+        if (data[i] == LOG_FRAME_DELIMITER) {
+            in_frame = !in_frame;
+        } else if (!in_frame && data[i] == '\n') {
+            return i + 1U;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Decode a chunk like logdecode, from a line start in text or from the state the previous chunk ended in
+ *
+ * @param unwrapper continues from the timestamps before the chunk, or starts with the chunk in the first pass
+ * @param emit called with every complete line, its text without the timestamp prefix
+ */
+template <typename F>
+static void decodeChunk(const uint8_t* data, Chunk& chunk, bool last, const Chunk* previous,
+                        TimestampUnwrapper& unwrapper, F emit) {
+    std::string line;
+    auto        unwrap = [&](uint32_t timestamp) {
+        if (!chunk.has_time) {
+            chunk.has_time = true;
+            chunk.first_time = timestamp;
+        }
+        chunk.last_time = unwrapper.unwrap(timestamp);
+        return chunk.last_time;
+    };
+
+    LogStreamDecoder decoder;
+    if (previous) {
+        decoder = previous->state;
+        line = previous->pending;
+    }
+    decoder.onText = [&](const char* text, size_t length) {
+        while (length) {
+            const char* newline = (const char*)memchr(text, '\n', length);
+            size_t      part = newline ? (size_t)(newline - text) + 1U : length;
+            line.append(text, part);
+            text += part;
+            length -= part;
+            if (!newline) {
+                break;
+            }
+            uint32_t timestamp;
+            size_t   prefix = parseTimestampPrefix(line.data(), line.size(), timestamp);
+            emit(line.data() + prefix, line.size() - prefix, prefix != 0U, prefix ? unwrap(timestamp) : 0U);
+            line.clear();
+        }
+    };
+    decoder.onFrame = [&](const uint8_t* payload, size_t length) {
+        int64_t  host_us;
+        uint32_t device_time, device_hz;
+        if (parseSyncResponse(payload, length, host_us, device_time, device_hz)) {
+            chunk.syncs.push_back({unwrap(device_time), host_us, device_hz});
+        }
+    };
+    decoder.onError = [&]() { ++chunk.errors; };
+    decoder.feed(data + chunk.begin, chunk.end - chunk.begin);
+    if (last) {
+        decoder.finish();
+    }
+
+    chunk.pending = line;
+    chunk.state = decoder;
+    chunk.state.onText = nullptr;
+    chunk.state.onFrame = nullptr;
+    chunk.state.onError = nullptr;
+}
+
+/**
+ * @brief The first pass: the sync responses and the timestamp range of a chunk, relative to its first timestamp
+ */
+static void scanChunk(const uint8_t* data, Chunk& chunk, bool last, const Chunk* previous = nullptr) {
+    TimestampUnwrapper unwrapper;
+    chunk.syncs.clear();
+    chunk.errors = 0U;
+    chunk.has_time = false;
+    chunk.continued = previous != nullptr;
+    decodeChunk(data, chunk, last, previous, unwrapper, [](const char*, size_t, bool, uint64_t) {});
+}
+
+/**
+ * @brief The second pass: format the lines of a chunk the way logdecode prints them
+ * @note The mapper must have been fitted already, toHostUs() is then read-only and safe to share. What the first pass
+ * left in the chunks is only read, the decoding state goes to a copy
+ */
+static void formatChunk(const uint8_t* data, std::vector<Chunk>& chunks, size_t i, ClockMapper& mapper) {
+    const Chunk&       chunk = chunks[i];
+    Chunk              work;
+    std::string&       out = chunks[i].output;
+    TimestampUnwrapper unwrapper = chunk.started ? TimestampUnwrapper(chunk.start_time) : TimestampUnwrapper();
+    char               timestamp[16];
+    bool               last = i + 1U == chunks.size();
+    work.begin = chunk.begin;
+    work.end = chunk.end;
+    out.reserve((chunk.end - chunk.begin) * 5U / 4U);
+    decodeChunk(data, work, last, chunk.continued ? &chunks[i - 1U] : nullptr, unwrapper,
+                [&](const char* text, size_t length, bool has_time, uint64_t device_time) {
+                    if (has_time && mapper.ready()) {
+                        out += ClockMapper::formatUtc(mapper.toHostUs(device_time));
+                        out += ' ';
+                    } else if (has_time) {
+                        snprintf(timestamp, sizeof(timestamp), "[%u] ", (uint32_t)device_time);
+                        out += timestamp;
+                    }
+                    out.append(text, length);
+                });
+    if (last || !chunks[i + 1U].continued) {
+        out += work.pending;  // otherwise the next chunk finishes the line
+    }
+}
+
+/**
+ * @brief Decode the whole capture with the given number of threads
+ *
+ * @param out written in order as the chunks are formatted, nullptr to discard the output
+ * @return the number of malformed frames
+ */
+static size_t decode(const uint8_t* data, size_t size, size_t threads, FILE* out) {
+    size_t             count = std::max(threads, (size + CHUNK_SIZE - 1U) / CHUNK_SIZE);
+    std::vector<Chunk> chunks(count);
+
+    // count the delimiters of the nominal chunks, the prefix sums give the state at each nominal start
+    parallel(threads, count, [&](size_t i) {
+        size_t begin = size * i / count, end = size * (i + 1U) / count;
+        size_t delimiters = 0U;
+        for (const uint8_t* p = data + begin; (p = (const uint8_t*)memchr(p, LOG_FRAME_DELIMITER, data + end - p));
+             p++) {
+            ++delimiters;
+        }
+        chunks[i].delimiters = delimiters;
+    });
+    std::vector<bool> in_frame(count, false);
+    size_t            delimiters = 0U;
+    for (size_t i = 0; i < count; i++) {
+        in_frame[i] = delimiters & 1U;
+        delimiters += chunks[i].delimiters;
+    }
+
+    parallel(threads, count, [&](size_t i) {
+        chunks[i].begin = i ? findLineStart(data, size * i / count, size, in_frame[i]) : 0U;
+    });
+    for (size_t i = 0; i < count; i++) {
+        chunks[i].end = i + 1U < count ? chunks[i + 1U].begin : size;  // the starts only move forward, in order
+    }
+
+    parallel(threads, count, [&](size_t i) { scanChunk(data, chunks[i], i + 1U == count); });
+    for (size_t i = 1; i < count; i++) {
+        Chunk& previous = chunks[i - 1U];
+        if (!previous.state.inText() || !previous.pending.empty()) {
+            scanChunk(data, chunks[i], i + 1U == count, &previous);  // out of phase at the start
+        }
+    }
+
+    // chain the chunks on the unwrapped time of the whole capture, in order: the first timestamp of a chunk is
+    // unwrapped against the last one before it, exactly as a single TimestampUnwrapper would do
+    ClockMapper mapper;
+    uint64_t    last = 0U;
+    bool        started = false;
+    size_t      errors = 0U;
+    for (Chunk& chunk : chunks) {
+        errors += chunk.errors;
+        chunk.started = started;
+        chunk.start_time = last;
+        if (!chunk.has_time) {
+            continue;
+        }
+        uint64_t first = started ? last + (int32_t)(chunk.first_time - (uint32_t)last) : chunk.first_time;
+        uint64_t shift = first - chunk.first_time;
+        for (const Sync& sync : chunk.syncs) {
+            mapper.addPoint(sync.device_time + shift, sync.host_us, sync.device_hz);
+        }
+        chunk.syncs.clear();
+        last = chunk.last_time + shift;
+        started = true;
+    }
+    if (mapper.ready()) {
+        mapper.toHostUs(0U);  // fit before the threads share it
+    }
+
+    std::mutex              mutex;
+    std::condition_variable written_more;
+    size_t                  written = 0U;
+    parallel(threads, count, [&](size_t i) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            written_more.wait(lock, [&] { return i < written + WINDOW * threads; });
+        }
+        formatChunk(data, chunks, i, mapper);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        chunks[i].done = true;
+        for (; written < count && chunks[written].done; written++) {
+            if (out) {
+                fwrite(chunks[written].output.data(), 1, chunks[written].output.size(), out);
+            }
+            std::string().swap(chunks[written].output);  // free it
+        }
+        written_more.notify_all();
+    });
+    return errors;
+}
+
+static double nowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+    size_t      threads = std::thread::hardware_concurrency();
+    bool        bench = false;
+    const char* input = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "-b")) {
+            bench = true;
+        } else {
+            input = argv[i];
+        }
+    }
+    if (!input) {
+        fprintf(stderr, "usage: %s [-j threads] [-b] capture\n", argv[0]);
+        return 1;
+    }
+    threads = threads ? threads : 1U;
+
+    int         fd = open(input, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return 1;
+    }
+    size_t         size = (size_t)st.st_size;
+    const uint8_t* data = nullptr;
+    if (size) {
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "cannot map %s\n", input);
+            return 1;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = (const uint8_t*)map;
+    }
+
+    if (bench) {
+        printf("%zu MB, %u hardware threads\nthreads  seconds  MB/s   speedup\n", size >> 20,
+               std::thread::hardware_concurrency());
+        double single = 0.0;
+        for (size_t n : {1U, 2U, 4U, 8U, 16U}) {
+            double start = nowSeconds();
+            decode(data, size, n, nullptr);
+            double seconds = nowSeconds() - start;
+            single = n == 1U ? seconds : single;
+            printf("%7zu  %7.3f  %5.0f  %6.2fx\n", n, seconds, size / seconds / 1e6, single / seconds);
+        }
+        return 0;
+    }
+
+    size_t errors = decode(data, size, threads, stdout);
+    if (errors) {
+        fprintf(stderr, "%zu malformed frames\n", errors);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file logrecord.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Host-side level and tag of a text record, for the tools filtering records
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+enum : uint8_t {
+    LEVEL_INFO = 1U << 0,
+    LEVEL_WARNING = 1U << 1,
+    LEVEL_ERROR = 1U << 2,
+    LEVEL_OTHER = 1U << 3,  // a record without a level
+    LEVEL_ALL = 0x0FU,
+};
+
+static constexpr const char* LEVEL_NAMES[4] = {"info", "warning", "error", "other"};  // by bit of the level
+
+/**
+ * @brief info_str, warning_str and error_str of logger.h, padded to 16 bytes for the register compares of logscan
+ */
+struct LevelPrefix {
+    char    text[16];
+    size_t  length;
+    uint8_t level;
+};
+static constexpr LevelPrefix LEVEL_PREFIXES[3] = {
+    {"Info: ", 6U, LEVEL_INFO}, {"Warning: ", 9U, LEVEL_WARNING}, {"Error: ", 7U, LEVEL_ERROR}};
+
+/**
+ * @brief The level and the tag of a record
+ *
+ * The levels are info_str, warning_str and error_str of logger.h. The tag is the word before a ':' right after the
+ * level, e.g. "imu" in "Error: imu: timeout".
+ */
+struct Record {
+    uint8_t     level;
+    const char* tag;
+    size_t      tag_length;
+
+    bool hasTag(const std::string& name) const {
+        return tag_length == name.size() && !memcmp(tag, name.data(), tag_length);
+    }
+};
+
+/**
+ * @brief Classify a record, after its timestamp prefix
+ */
+inline Record classifyRecord(const char* text, size_t length) {
+    Record record = {LEVEL_OTHER, nullptr, 0U};
+    for (const auto& level : LEVEL_PREFIXES) {
+        if (length >= level.length && !memcmp(text, level.text, level.length)) {
+            record.level = level.level;
+            text += level.length;
+            length -= level.length;
+            break;
+        }
+    }
+    if (record.level == LEVEL_OTHER) {
+        return record;
+    }
+    size_t i = 0;
+    while (i < length && i < 32U && (isalnum((unsigned char)text[i]) || text[i] == '_' || text[i] == '.' ||
+                                      text[i] == '-')) {
+        i++;
+    }
+    if (i && i < length && text[i] == ':') {
+        record.tag = text;
+        record.tag_length = i;
+    }
+    return record;
+}
+
+/**
+ * @brief Parse a set of levels given as letters: i for Info, w for Warning, e for Error, o for the others
+ */
+inline bool parseLevels(const char* text, uint8_t& levels) {
+    levels = 0U;
+    for (; *text; text++) {
+        const char* letter = strchr("iweo", *text);
+        if (!letter) {
+            return false;
+        }
+        levels |= (uint8_t)(1U << (letter - "iweo"));
+    }
+    return levels != 0U;
+}
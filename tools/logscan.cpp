@@ -0,0 +1,376 @@
+/**
+ * @file logscan.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Split a text-mode capture into records and classify their levels with SSE2/AVX2
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logscan tools/logscan.cpp
+Usage:  logscan [-l levels] [-m scalar|sse2|avx2] capture > errors.txt
+        logscan -b capture            benchmark every scanner, nothing is printed
+
+For plain text captures, without frames: the records of the [levels] (e for Error, w for Warning, i for Info, o for
+records without a level, all by default) are printed and a count per level goes to stderr. A "[timestamp] " prefix is
+skipped before the level, which is matched against the prefixes of logrecord.h (info_str, warning_str and error_str
+of logger.h), the levels and the letters being the ones of logtail and logindex.
+
+The newlines are found 32 bytes at a time with AVX2 (64 per iteration) or 16 at a time with SSE2, comparing a whole
+register against '\n' and walking the bits of the movemask; the timestamp and the level of every record are matched
+with two 16-byte loads instead of byte by byte. The scanner is picked at run time from the CPU features, -m forces
+one, and the scalar one is used on other architectures. The benchmark checks that all scanners agree and compares
+them with a plain read of the file, the bandwidth bound.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "logrecord.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LOGSCAN_X86 1
+#else
+#define LOGSCAN_X86 0
+#endif
+
+/**
+ * @brief Length of the "[timestamp] " prefix of a record, 0 if it has none
+ */
+static inline size_t timestampLength(const char* line, size_t length) {
+    if (length < 4U || line[0] != '[') {
+        return 0U;
+    }
+    size_t i = 1;
+    while (i < length && i < 12U && line[i] >= '0' && line[i] <= '9') {
+        i++;
+    }
+    return i > 1U && i + 1U < length && line[i] == ']' && line[i + 1U] == ' ' ? i + 2U : 0U;
+}
+
+/**
+ * @brief Byte by byte, the reference
+ */
+struct ScalarScanner {
+    static constexpr const char* NAME = "scalar";
+
+    static uint8_t classify(const char* line, size_t length, const char*) {
+        size_t skip = timestampLength(line, length);
+        line += skip;
+        length -= skip;
+        for (const auto& prefix : LEVEL_PREFIXES) {
+            if (length >= prefix.length && !memcmp(line, prefix.text, prefix.length)) {
+                return prefix.level;
+            }
+        }
+        return LEVEL_OTHER;
+    }
+
+    template <typename F>
+    static void scan(const char* data, size_t size, F record) {
+        size_t start = 0U;
+        for (size_t i = 0; i < size; i++) {
+            if (data[i] == '\n') {
+                record(data + start, i + 1U - start, classify(data + start, i + 1U - start, data + size));
+                start = i + 1U;
+            }
+        }
+        if (start < size) {
+            record(data + start, size - start, classify(data + start, size - start, data + size));
+        }
+    }
+};
+
+#if LOGSCAN_X86
+
+/**
+ * @brief Skip the timestamp and compare the start of a record with the three prefixes, a few loads per record
+ * @param end the end of the mapping, the loads must not cross it
+ */
+__attribute__((target("sse2"))) static inline uint8_t classifySse2(const char* line, size_t length, const char* end) {
+    if (end - line < 32) {
+        return ScalarScanner::classify(line, length, end);
+    }
+    size_t  skip = 0U;
+    __m128i head = _mm_loadu_si128((const __m128i*)line);
+    if (line[0] == '[') {
+        // the first ']' and the digits before it, as timestampLength() checks them byte by byte
+        uint32_t close = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(head, _mm_set1_epi8(']'))) & ~1U;
+        __m128i  value = _mm_sub_epi8(head, _mm_set1_epi8('0'));
+        uint32_t digits = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(value, _mm_set1_epi8(9)), value));
+        size_t   pos = close ? (size_t)__builtin_ctz(close) : 0U;
+        uint32_t need = (1U << pos) - 2U;  // bits 1 to pos - 1
+        if (pos >= 2U && pos <= 12U && (digits & need) == need && pos + 1U < length && line[pos + 1U] == ' ') {
+            skip = pos + 2U;
+            head = _mm_loadu_si128((const __m128i*)(line + skip));
+        }
+    }
+    for (const auto& prefix : LEVEL_PREFIXES) {
+        uint32_t need = (1U << prefix.length) - 1U;
+        uint32_t equal =
+            (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(head, _mm_loadu_si128((const __m128i*)prefix.text)));
+        if ((equal & need) == need && length >= skip + prefix.length) {
+            return prefix.level;
+        }
+    }
+    return LEVEL_OTHER;
+}
+
+/**
+ * @brief Call record() for every bit of a newline mask, the bits are the newlines of data[base...]
+ */
+template <typename M, typename F>
+static inline void walkMask(M mask, const char* data, size_t size, size_t base, size_t& start, F record) {
+    while (mask) {
+        size_t pos = base + (size_t)__builtin_ctzll((unsigned long long)mask);
+        mask &= mask - 1U;
+        record(data + start, pos + 1U - start, classifySse2(data + start, pos + 1U - start, data + size));
+        start = pos + 1U;
+    }
+}
+
+/**
+ * @brief 16 bytes per compare
+ */
+struct Sse2Scanner {
+    static constexpr const char* NAME = "sse2";
+
+    template <typename F>
+    __attribute__((target("sse2"))) static void scan(const char* data, size_t size, F record) {
+        const __m128i newline = _mm_set1_epi8('\n');
+        size_t        start = 0U, i = 0U;
+        for (; i + 16U <= size; i += 16U) {
+            __m128i  block = _mm_loadu_si128((const __m128i*)(data + i));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+            walkMask(mask, data, size, i, start, record);
+        }
+        finish(data, size, i, start, record);
+    }
+
+    /**
+     * @brief The bytes after the last full register, and an unfinished last record
+     */
+    template <typename F>
+    static void finish(const char* data, size_t size, size_t i, size_t start, F record) {
+        for (; i < size; i++) {
+            if (data[i] == '\n') {
+                record(data + start, i + 1U - start, classifySse2(data + start, i + 1U - start, data + size));
+                start = i + 1U;
+            }
+        }
+        if (start < size) {
+            record(data + start, size - start, classifySse2(data + start, size - start, data + size));
+        }
+    }
+};
+
+/**
+ * @brief 32 bytes per compare, two compares per iteration
+ */
+struct Avx2Scanner {
+    static constexpr const char* NAME = "avx2";
+
+    template <typename F>
+    __attribute__((target("avx2"))) static void scan(const char* data, size_t size, F record) {
+        const __m256i newline = _mm256_set1_epi8('\n');
+        size_t        start = 0U, i = 0U;
+        for (; i + 64U <= size; i += 64U) {
+            __m256i  lo = _mm256_loadu_si256((const __m256i*)(data + i));
+            __m256i  hi = _mm256_loadu_si256((const __m256i*)(data + i + 32U));
+            uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline)) |
+                            (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline)) << 32;
+            walkMask(mask, data, size, i, start, record);
+        }
+        Sse2Scanner::finish(data, size, i, start, record);
+    }
+};
+
+#endif
+
+/**
+ * @brief What a scan found, by bit of the level
+ */
+struct Counts {
+    size_t records[4] = {0U, 0U, 0U, 0U};
+    size_t bytes[4] = {0U, 0U, 0U, 0U};
+
+    void add(uint8_t level, size_t length) {
+        records[__builtin_ctz(level)]++;
+        bytes[__builtin_ctz(level)] += length;
+    }
+
+    bool operator==(const Counts& other) const {
+        return !memcmp(records, other.records, sizeof(records)) && !memcmp(bytes, other.bytes, sizeof(bytes));
+    }
+};
+
+template <typename S>
+static Counts countLevels(const char* data, size_t size) {
+    Counts counts;
+    S::scan(data, size, [&](const char*, size_t length, uint8_t level) { counts.add(level, length); });
+    return counts;
+}
+
+template <typename S>
+static Counts printLevels(const char* data, size_t size, uint8_t levels) {
+    Counts counts;
+    S::scan(data, size, [&](const char* line, size_t length, uint8_t level) {
+        counts.add(level, length);
+        if (levels & level) {
+            fwrite(line, 1, length, stdout);
+        }
+    });
+    return counts;
+}
+
+static double nowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Time the best of a few runs
+ */
+template <typename F>
+static double bestOf(F run) {
+    double best = 1e30;
+    for (int i = 0; i < 5; i++) {
+        double start = nowSeconds();
+        run();
+        double seconds = nowSeconds() - start;
+        best = seconds < best ? seconds : best;
+    }
+    return best;
+}
+
+template <typename S>
+static bool benchScanner(const char* data, size_t size, const Counts& reference) {
+    Counts counts;
+    double seconds = bestOf([&]() { counts = countLevels<S>(data, size); });
+    printf("%-8s %7.2f GB/s\n", S::NAME, size / seconds / 1e9);
+    if (!(counts == reference)) {
+        printf("%-8s disagrees with the scalar scanner\n", S::NAME);
+        return false;
+    }
+    return true;
+}
+
+static int bench(const char* data, size_t size) {
+    // the bandwidth bound, every byte read once
+    volatile uint64_t sink;
+    double            seconds = bestOf([&]() {
+        uint64_t sum = 0U, word;
+        for (size_t i = 0; i + 8U <= size; i += 8U) {
+            memcpy(&word, data + i, 8U);
+            sum += word;
+        }
+        sink = sum;
+    });
+    (void)sink;
+    printf("%zu MB\nread     %7.2f GB/s\n", size >> 20, size / seconds / 1e9);
+
+    Counts reference = countLevels<ScalarScanner>(data, size);
+    bool   ok = benchScanner<ScalarScanner>(data, size, reference);
+#if LOGSCAN_X86
+    ok = benchScanner<Sse2Scanner>(data, size, reference) && ok;
+    if (__builtin_cpu_supports("avx2")) {
+        ok = benchScanner<Avx2Scanner>(data, size, reference) && ok;
+    }
+#endif
+    printf("records: %zu info, %zu warning, %zu error, %zu other\n", reference.records[0], reference.records[1],
+           reference.records[2], reference.records[3]);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    const char* input = nullptr;
+    const char* mode = nullptr;
+    uint8_t     levels = LEVEL_ALL;
+    bool        benchmark = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            if (!parseLevels(argv[++i], levels)) {
+                fprintf(stderr, "bad levels %s, expected letters of iweo\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            mode = argv[++i];
+        } else if (!strcmp(argv[i], "-b")) {
+            benchmark = true;
+        } else {
+            input = argv[i];
+        }
+    }
+    if (!input) {
+        fprintf(stderr, "usage: %s [-l levels] [-m scalar|sse2|avx2] [-b] capture\n", argv[0]);
+        return 1;
+    }
+
+    int         fd = open(input, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return 1;
+    }
+    size_t      size = (size_t)st.st_size;
+    const char* data = "";
+    if (size) {
+        void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "cannot map %s\n", input);
+            return 1;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+        data = (const char*)map;
+    }
+    if (benchmark) {
+        return bench(data, size);
+    }
+
+#if LOGSCAN_X86
+    if (!mode) {
+        mode = __builtin_cpu_supports("avx2") ? "avx2" : "sse2";
+    }
+#else
+    mode = "scalar";
+#endif
+    Counts counts;
+    if (!strcmp(mode, "scalar")) {
+        counts = printLevels<ScalarScanner>(data, size, levels);
+#if LOGSCAN_X86
+    } else if (!strcmp(mode, "sse2")) {
+        counts = printLevels<Sse2Scanner>(data, size, levels);
+    } else if (!strcmp(mode, "avx2") && __builtin_cpu_supports("avx2")) {
+        counts = printLevels<Avx2Scanner>(data, size, levels);
+#endif
+    } else {
+        fprintf(stderr, "scanner %s not available\n", mode);
+        return 1;
+    }
+    for (uint8_t level = 0; level < 4U; level++) {
+        fprintf(stderr, "%-8s %zu records, %zu bytes\n", LEVEL_NAMES[level], counts.records[level],
+                counts.bytes[level]);
+    }
+    return 0;
+}
@@ -0,0 +1,319 @@
+/**
+ * @file logstream.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Host-side splitter of the logger output into text and binary frames, see log_protocol.h
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "../log_protocol.h"
+
+/**
+ * @brief Decode a COBS frame body (without delimiters)
+ * @return false if the body is malformed
+ */
+inline bool cobsDecode(const uint8_t* in, size_t length, std::vector<uint8_t>& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos < length) {
+        uint8_t code = in[pos++];
+        if (code == 0U || pos + code - 1U > length) {
+            return false;
+        }
+        out.insert(out.end(), in + pos, in + pos + code - 1U);
+        pos += code - 1U;
+        if (code != 0xFFU && pos < length) {
+            out.push_back(0U);  // the zero replaced by this block's code
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Encode a frame payload between two delimiters, the same way as Logger::encodeFrame()
+ */
+inline std::vector<uint8_t> cobsEncode(const uint8_t* payload, size_t length) {
+    std::vector<uint8_t> out;
+    out.push_back(LOG_FRAME_DELIMITER);
+    size_t  code_pos = out.size();
+    uint8_t code = 1;
+    out.push_back(0U);
+    for (size_t i = 0; i < length; i++) {
+        if (payload[i] == 0U) {
+            out[code_pos] = code;
+            code_pos = out.size();
+            out.push_back(0U);
+            code = 1;
+        } else {
+            out.push_back(payload[i]);
+            if (++code == 0xFFU) {
+                out[code_pos] = code;
+                code_pos = out.size();
+                out.push_back(0U);
+                code = 1;
+            }
+        }
+    }
+    out[code_pos] = code;
+    out.push_back(LOG_FRAME_DELIMITER);
+    return out;
+}
+
+/**
+ * @brief The CRC-32 of LOG_FRAME_CRC, bit by bit like the STM32 CRC unit: zero-padded little-endian words, MSB first
+ */
+inline uint32_t logCrc32(const uint8_t* data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFU;
+    for (size_t i = 0; i < length; i += 4U) {
+        uint32_t word = 0U;
+        for (size_t k = 0; k < 4U && i + k < length; k++) {
+            word |= (uint32_t)data[i + k] << (8U * k);
+        }
+        crc ^= word;
+        for (int bit = 0; bit < 32; bit++) {
+            crc = crc & 0x80000000U ? (crc << 1) ^ 0x04C11DB7U : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Bounds-checked little-endian reader of a frame payload
+ */
+class FrameReader {
+
+   public:
+    FrameReader(const uint8_t* data, size_t length) : m_data(data), m_length(length) {}
+
+    uint8_t u8() {
+        if (m_pos + 1U > m_length) {
+            m_ok = false;
+            return 0U;
+        }
+        return m_data[m_pos++];
+    }
+
+    uint16_t u16() {
+        uint16_t lo = u8();
+        return (uint16_t)(lo | (u8() << 8));
+    }
+
+    uint32_t u32() {
+        uint32_t lo = u16();
+        return lo | ((uint32_t)u16() << 16);
+    }
+
+    uint64_t u64() {
+        uint64_t lo = u32();
+        return lo | ((uint64_t)u32() << 32);
+    }
+
+    uint32_t varint() {
+        uint32_t value = 0U;
+        for (uint8_t shift = 0; shift < 35U; shift += 7U) {
+            uint8_t byte = u8();
+            value |= (uint32_t)(byte & 0x7FU) << shift;
+            if (!(byte & 0x80U)) {
+                return value;
+            }
+        }
+        m_ok = false;
+        return value;
+    }
+
+    /**
+     * @brief The unread bytes
+     */
+    const uint8_t* rest() const {
+        return m_data + m_pos;
+    }
+    size_t remaining() const {
+        return m_length - m_pos;
+    }
+
+    /**
+     * @brief If no read has run past the end
+     */
+    bool ok() const {
+        return m_ok;
+    }
+
+   private:
+    const uint8_t* m_data;
+    size_t         m_length;
+    size_t         m_pos = 0U;
+    bool           m_ok = true;
+};
+
+/**
+ * @brief If a decoded payload can be a frame: a known type, and the length of that type
+ */
+inline bool logFrameValid(const uint8_t* payload, size_t length) {
+    if (length == 0U) {
+        return false;
+    }
+    switch (payload[0]) {
+        case LOG_FRAME_METRICS_DESC:
+            return length >= 3U;
+        case LOG_FRAME_METRICS:
+            return length >= 5U;
+        case LOG_FRAME_SYNC_REQUEST:
+            return length == 11U;
+        case LOG_FRAME_SYNC_RESPONSE:
+            return length == 19U;
+        case LOG_FRAME_BOND:
+        case LOG_FRAME_CRC:
+            return length == 9U;
+        case LOG_FRAME_CHANNEL:
+            return length == 5U;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief If a byte can be in the text, see the framing Note of log_protocol.h
+ */
+inline bool logTextByte(uint8_t byte) {
+    return byte >= 0x20U || byte == '\t' || byte == '\n' || byte == '\r' || byte == 0x1BU;
+}
+
+/**
+ * @brief Incremental splitter of the logger output, feed() can be called with chunks of any size
+ * @note It resynchronizes when it starts in the middle of a frame or misses a delimiter, see log_protocol.h: a control
+ * byte in the text means it's inside a frame, the rest of it is skipped. What fails as a frame is the text before a
+ * frame when it's text, a malformed frame otherwise, and the delimiter ending it starts a frame
+ */
+class LogStreamDecoder {
+
+   public:
+    std::function<void(const char* text, size_t length)>    onText;   // text between frames
+    std::function<void(const uint8_t* payload, size_t length)> onFrame;  // decoded frame payload
+    std::function<void()>                                   onError;  // malformed frame, dropped
+
+    void feed(const uint8_t* data, size_t length) {
+        size_t text_start = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (m_in_frame) {
+                if (data[i] == LOG_FRAME_DELIMITER) {
+                    endFrame();
+                    text_start = i + 1U;
+                } else if (!m_skipping) {
+                    m_encoded.push_back(data[i]);
+                    if (m_encoded.size() > LOG_FRAME_MAX_PAYLOAD + 1U) {
+                        tooLong();  // no frame is that long
+                        text_start = i + 1U;
+                    }
+                }
+            } else if (data[i] == LOG_FRAME_DELIMITER) {
+                if (i > text_start && onText) {
+                    onText((const char*)&data[text_start], i - text_start);
+                }
+                m_in_frame = true;
+                m_encoded.clear();
+            } else if (!logTextByte(data[i])) {
+                // inside a frame after all, the bytes since the last delimiter belong to it
+                if (onError) {
+                    onError();
+                }
+                m_in_frame = m_skipping = true;
+            }
+        }
+        if (!m_in_frame && length > text_start && onText) {
+            onText((const char*)&data[text_start], length - text_start);
+        }
+    }
+
+    /**
+     * @brief The end of the input: the frame left open was text if it looks like text
+     */
+    void finish() {
+        if (m_in_frame && !m_skipping && isText(m_encoded) && onText) {
+            onText((const char*)m_encoded.data(), m_encoded.size());
+        }
+        m_in_frame = m_skipping = false;
+        m_encoded.clear();
+    }
+
+    /**
+     * @brief If the decoder is in the text with nothing pending, as a fresh one
+     */
+    bool inText() const {
+        return !m_in_frame;
+    }
+
+   private:
+    void endFrame() {
+        if (m_skipping) {
+            m_in_frame = m_skipping = false;  // the end of the frame joined in the middle
+            m_encoded.clear();
+            return;
+        }
+        if (m_encoded.empty()) {
+            return;  // consecutive delimiters, the last one opens the frame
+        }
+        if (cobsDecode(m_encoded.data(), m_encoded.size(), m_payload) &&
+            logFrameValid(m_payload.data(), m_payload.size())) {
+            m_in_frame = false;
+            if (onFrame) {
+                onFrame(m_payload.data(), m_payload.size());
+            }
+        } else if (isText(m_encoded)) {
+            if (onText) {
+                onText((const char*)m_encoded.data(), m_encoded.size());  // out of phase, this delimiter opens a frame
+            }
+        } else if (onError) {
+            onError();  // a malformed frame, the text after it is recovered at the next delimiter
+        }
+        m_encoded.clear();
+    }
+
+    void tooLong() {
+        if (isText(m_encoded)) {
+            if (onText) {
+                onText((const char*)m_encoded.data(), m_encoded.size());
+            }
+            m_in_frame = false;
+        } else {
+            if (onError) {
+                onError();
+            }
+            m_skipping = true;
+        }
+        m_encoded.clear();
+    }
+
+    static bool isText(const std::vector<uint8_t>& bytes) {
+        for (uint8_t byte : bytes) {
+            if (!logTextByte(byte)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool                 m_in_frame = false;
+    bool                 m_skipping = false;  // joined in the middle of a frame, skip to its end
+    std::vector<uint8_t> m_encoded;           // the frame being received
+    std::vector<uint8_t> m_payload;
+};
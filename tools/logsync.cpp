@@ -0,0 +1,118 @@
+/**
+ * @file logsync.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Capture the logger output from a serial device while sending time sync requests
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logsync tools/logsync.cpp
+Usage:  logsync -d /dev/ttyUSB0 [-b 115200] [-i 2000] [-o capture.bin]
+
+Every [-i] milliseconds a LOG_FRAME_SYNC_REQUEST is written to the device with the UTC time at which its last byte is
+expected to arrive, and all received bytes are appended to the capture file untouched. Decode the capture with
+tools/logdecode.cpp.
+*/
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "logstream.h"
+#include "serial_port.h"
+
+/**
+ * @brief UTC time in microseconds
+ */
+static int64_t utcNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+int main(int argc, char** argv) {
+    const char* device = nullptr;
+    const char* output = "capture.bin";
+    uint32_t    baud = 115200U;
+    int         interval_ms = 2000;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-d")) {
+            device = argv[i + 1];
+        } else if (!strcmp(argv[i], "-b")) {
+            baud = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+        } else if (!strcmp(argv[i], "-i")) {
+            interval_ms = atoi(argv[i + 1]);
+        } else if (!strcmp(argv[i], "-o")) {
+            output = argv[i + 1];
+        }
+    }
+    if (!device) {
+        fprintf(stderr, "usage: logsync -d device [-b baud] [-i interval_ms] [-o capture]\n");
+        return 1;
+    }
+
+    int fd = openSerialPort(device, baud);
+    if (fd < 0) {
+        return 1;
+    }
+    FILE* out = fopen(output, "ab");
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+
+    uint16_t seq = 0U;
+    int64_t  next_sync = 0;
+    uint8_t  buffer[4096];
+    while (true) {
+        int64_t now = utcNowUs();
+        if (now >= next_sync) {
+            // [type][seq u16][host_time u64], stamped with the arrival time of the closing delimiter: 10 bits per byte
+            uint8_t request[11];
+            request[0] = LOG_FRAME_SYNC_REQUEST;
+            request[1] = (uint8_t)seq;
+            request[2] = (uint8_t)(seq >> 8);
+            std::vector<uint8_t> frame = cobsEncode(request, sizeof(request));
+            int64_t              arrival = utcNowUs() + (int64_t)frame.size() * 10 * 1000000 / baud;
+            for (int i = 0; i < 8; i++) {
+                request[3 + i] = (uint8_t)(arrival >> (8 * i));
+            }
+            frame = cobsEncode(request, sizeof(request));
+            if (write(fd, frame.data(), frame.size()) != (ssize_t)frame.size()) {
+                perror("write");
+            }
+            ++seq;
+            next_sync = now + (int64_t)interval_ms * 1000;
+        }
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, (int)((next_sync - now) / 1000) + 1) > 0) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            fwrite(buffer, 1, (size_t)length, out);
+            fflush(out);
+        }
+    }
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,361 @@
+/**
+ * @file logtail.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Follow a device live, filtering its records to the terminal and to a rotating file
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o logtail tools/logtail.cpp
+Usage:  logtail -d /dev/ttyUSB0 [-b 4000000] [-l levels] [-g tag] [-o log.txt] [-r max_bytes] [-k files] [-q]
+
+The device (a serial port, or the pty of bench/pty_device.cpp) is decoded as the bytes arrive, the frames are dropped
+and the records of the [levels] (letters of iweo, see logrecord.h) and the [tag] are written to the terminal and to
+the file [-o]. Each read is handled at once, so a record is out as soon as its '\n' is received. The file is
+written with one write() per read and rotated when it reaches [max_bytes] (16 MB by default): log.txt becomes
+log.txt.1 and so on, [files] old files are kept. -q writes to the file only.
+
+The device is never left waiting for the outputs: the terminal is written without blocking from a queue of at most
+TERMINAL_QUEUE bytes, and records that don't fit are counted instead of shown, while the file still gets them. A
+summary goes to stderr when the device closes or on Ctrl-C.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "logrecord.h"
+#include "logstream.h"
+#include "logtime.h"
+#include "serial_port.h"
+
+static constexpr size_t TERMINAL_QUEUE = 1U << 20;  // bytes waiting for a slow terminal before records are skipped
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/**
+ * @brief An append-only file, renamed to path.1, path.2, ... when it's full
+ */
+class RotatingFile {
+
+   public:
+    bool open(const std::string& path, size_t max_bytes, unsigned keep) {
+        m_path = path;
+        m_max_bytes = max_bytes;
+        m_keep = keep;
+        return reopen();
+    }
+
+    /**
+     * @brief Append whole records, the file is rotated between two writes only
+     */
+    bool write(const std::string& data) {
+        if (m_fd < 0 || data.empty()) {
+            return true;
+        }
+        const char* pos = data.data();
+        size_t      length = data.size();
+        while (length) {
+            ssize_t written = ::write(m_fd, pos, length);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                perror(m_path.c_str());
+                return false;
+            }
+            pos += written;
+            length -= (size_t)written;
+        }
+        m_size += data.size();
+        return m_size < m_max_bytes || rotate();
+    }
+
+    void close() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    unsigned getRotations() const {
+        return m_rotations;
+    }
+
+   private:
+    bool reopen() {
+        m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (m_fd < 0) {
+            perror(m_path.c_str());
+            return false;
+        }
+        m_size = (size_t)lseek(m_fd, 0, SEEK_END);
+        return true;
+    }
+
+    bool rotate() {
+        close();
+        for (unsigned i = m_keep; i > 0; i--) {
+            std::string from = i > 1U ? m_path + "." + std::to_string(i - 1U) : m_path;
+            rename(from.c_str(), (m_path + "." + std::to_string(i)).c_str());
+        }
+        if (!m_keep) {
+            unlink(m_path.c_str());
+        }
+        m_rotations++;
+        return reopen();
+    }
+
+    std::string m_path;
+    int         m_fd = -1;
+    size_t      m_size = 0U;
+    size_t      m_max_bytes = 0U;
+    unsigned    m_keep = 0U;
+    unsigned    m_rotations = 0U;
+};
+
+/**
+ * @brief The terminal, written without blocking from a bounded queue
+ */
+class Terminal {
+
+   public:
+    void init(int fd) {
+        m_fd = fd;
+        m_flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, m_flags | O_NONBLOCK);
+    }
+
+    /**
+     * @brief Put the terminal back as it was, it's shared with the shell
+     */
+    void restore() {
+        fcntl(m_fd, F_SETFL, m_flags & ~O_NONBLOCK);
+        if (pending()) {
+            ssize_t written = ::write(m_fd, m_queue.data() + m_sent, m_queue.size() - m_sent);
+            (void)written;  // best effort, the summary follows
+        }
+        fcntl(m_fd, F_SETFL, m_flags);
+    }
+
+    /**
+     * @brief Queue a record, or count it as skipped when the terminal is too far behind
+     */
+    void add(const char* line, size_t length) {
+        if (m_queue.size() - m_sent + length > TERMINAL_QUEUE) {
+            m_skipped++;
+            return;
+        }
+        m_queue.append(line, length);
+    }
+
+    /**
+     * @brief Write as much of the queue as the terminal takes now
+     */
+    void flush() {
+        while (m_sent < m_queue.size()) {
+            ssize_t written = ::write(m_fd, m_queue.data() + m_sent, m_queue.size() - m_sent);
+            if (written <= 0) {
+                break;  // EAGAIN, poll() tells when to go on
+            }
+            m_sent += (size_t)written;
+        }
+        if (m_sent == m_queue.size()) {
+            m_queue.clear();
+            m_sent = 0U;
+        } else if (m_sent > TERMINAL_QUEUE / 2U) {
+            m_queue.erase(0, m_sent);
+            m_sent = 0U;
+        }
+    }
+
+    bool pending() const {
+        return m_sent < m_queue.size();
+    }
+    int fd() const {
+        return m_fd;
+    }
+    size_t getSkipped() const {
+        return m_skipped;
+    }
+
+   private:
+    int         m_fd = -1;
+    int         m_flags = 0;
+    std::string m_queue;
+    size_t      m_sent = 0U;  // bytes of the queue already written
+    size_t      m_skipped = 0U;
+};
+
+static void onSignal(int) {
+    stop_requested = 1;
+}
+
+int main(int argc, char** argv) {
+    const char* device = nullptr;
+    const char* output = nullptr;
+    uint32_t    baud = 0U;
+    uint8_t     levels = LEVEL_ALL;
+    std::string tag;
+    size_t      max_bytes = 16U << 20;
+    unsigned    keep = 5U;
+    bool        quiet = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-q")) {
+            quiet = true;
+        } else if (i + 1 >= argc) {
+            break;
+        } else if (!strcmp(argv[i], "-d")) {
+            device = argv[++i];
+        } else if (!strcmp(argv[i], "-b")) {
+            baud = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "-l")) {
+            if (!parseLevels(argv[++i], levels)) {
+                fprintf(stderr, "bad levels %s, expected letters of iweo\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-g")) {
+            tag = argv[++i];
+        } else if (!strcmp(argv[i], "-o")) {
+            output = argv[++i];
+        } else if (!strcmp(argv[i], "-r")) {
+            max_bytes = strtoul(argv[++i], nullptr, 0);
+        } else if (!strcmp(argv[i], "-k")) {
+            keep = (unsigned)atoi(argv[++i]);
+        }
+    }
+    if (!device) {
+        fprintf(stderr, "usage: logtail -d device [-b baud] [-l levels] [-g tag] [-o file] [-r max_bytes] [-k files] "
+                        "[-q]\n");
+        return 1;
+    }
+
+    int fd = openSerialPort(device, baud);  // baud 0 keeps the setting, for a pty
+    if (fd < 0) {
+        return 1;
+    }
+    RotatingFile file;
+    if (output && !file.open(output, max_bytes ? max_bytes : SIZE_MAX, keep)) {
+        return 1;
+    }
+    Terminal terminal;
+    if (!quiet) {
+        terminal.init(STDOUT_FILENO);
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string batch;    // the records of one read for the file
+    std::string pending;  // text of the record being received
+    size_t      counts[4] = {0U, 0U, 0U, 0U}, shown = 0U, errors = 0U, bytes = 0U, reads = 0U;
+    double      slowest_ms = 0.0;
+
+    auto record = [&](const char* line, size_t length) {
+        uint32_t timestamp;
+        size_t   prefix = parseTimestampPrefix(line, length, timestamp);
+        Record   info = classifyRecord(line + prefix, length - prefix);
+        counts[__builtin_ctz(info.level)]++;
+        if (!(info.level & levels) || (!tag.empty() && !info.hasTag(tag))) {
+            return;
+        }
+        shown++;
+        if (!quiet) {
+            terminal.add(line, length);
+        }
+        batch.append(line, length);
+    };
+
+    LogStreamDecoder decoder;
+    decoder.onText = [&](const char* text, size_t length) {
+        while (length) {
+            const char* newline = (const char*)memchr(text, '\n', length);
+            size_t      part = newline ? (size_t)(newline - text) + 1U : length;
+            if (newline && pending.empty()) {
+                record(text, part);
+            } else {
+                pending.append(text, part);
+                if (newline) {
+                    record(pending.data(), pending.size());
+                    pending.clear();
+                }
+            }
+            text += part;
+            length -= part;
+        }
+    };
+    decoder.onError = [&]() { ++errors; };
+
+    uint8_t buffer[65536];
+    auto    start = std::chrono::steady_clock::now();
+    while (!stop_requested) {
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {terminal.fd(), POLLOUT, 0}};
+        int           ready = poll(fds, terminal.pending() ? 2 : 1, 200);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            if (length <= 0) {
+                break;  // the device is gone (EIO when the other end of a pty closes)
+            }
+            auto received = std::chrono::steady_clock::now();
+            bytes += (size_t)length;
+            reads++;
+            decoder.feed(buffer, (size_t)length);
+            if (!file.write(batch)) {
+                break;
+            }
+            batch.clear();
+            double ms =
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - received).count();
+            slowest_ms = ms > slowest_ms ? ms : slowest_ms;
+        }
+        if (!quiet) {
+            terminal.flush();
+        }
+    }
+    decoder.finish();
+    file.write(batch);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    file.close();
+    if (!quiet) {
+        terminal.restore();
+    }
+    fprintf(stderr,
+            "%zu bytes in %.1f s (%.0f kB/s) in %zu reads, slowest %.2f ms\n"
+            "%zu info, %zu warning, %zu error, %zu other, %zu shown, %zu not shown by the terminal\n"
+            "%zu malformed frames, %u rotations\n",
+            bytes, seconds, bytes / seconds / 1e3, reads, slowest_ms, counts[0], counts[1], counts[2], counts[3],
+            shown, terminal.getSkipped(), errors, file.getRotations());
+    return 0;
+}
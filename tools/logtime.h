@@ -0,0 +1,252 @@
+/**
+ * @file logtime.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Host-side conversion of device timestamps to UTC with the time sync frames
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "logstream.h"
+
+/**
+ * @brief Extend the 32-bit device timestamps to 64 bits, in stream order
+ * @note Needs a timestamp (record or sync response) at least every 2^31 cycles, ~25s at 84MHz. Small steps backward
+ *       (a record formatted by a preempting ISR) are kept as they are.
+ */
+class TimestampUnwrapper {
+
+   public:
+    TimestampUnwrapper() = default;
+
+    /**
+     * @brief Continue after a known unwrapped timestamp, e.g. where an earlier run or an index block stopped
+     */
+    explicit TimestampUnwrapper(uint64_t last) : m_last(last), m_started(true) {}
+
+    uint64_t unwrap(uint32_t timestamp) {
+        if (!m_started) {
+            m_started = true;
+            m_last = timestamp;
+            return m_last;
+        }
+        m_last += (int32_t)(timestamp - (uint32_t)m_last);
+        return m_last;
+    }
+
+    /**
+     * @brief The last unwrapped timestamp, if any
+     */
+    uint64_t last() const {
+        return m_last;
+    }
+    bool started() const {
+        return m_started;
+    }
+
+   private:
+    uint64_t m_last = 0U;
+    bool     m_started = false;
+};
+
+/**
+ * @brief Map device time to UTC from pairs of (device time, host time)
+ *
+ * Every sync point gets a local least-squares line fitted over its neighbours, which follows slow drift of the device
+ * clock (temperature) while averaging out the latency jitter of single requests. A device timestamp is converted with
+ * the line of the nearest sync point, before the first or after the last one it's extrapolated.
+ */
+class ClockMapper {
+
+   public:
+    /**
+     * @brief Add a sync point, device times must be unwrapped and increasing
+     */
+    void addPoint(uint64_t device_time, int64_t host_us, uint32_t device_hz) {
+        if (!m_points.empty() && device_time <= m_points.back().device_time) {
+            return;
+        }
+        m_points.push_back({device_time, host_us, device_hz ? 1e6 / device_hz : 0.0, 0.0});
+        m_dirty = true;
+    }
+
+    /**
+     * @brief If at least one sync point is known
+     */
+    bool ready() const {
+        return !m_points.empty();
+    }
+
+    /**
+     * @brief Convert an unwrapped device timestamp to UTC microseconds
+     */
+    int64_t toHostUs(uint64_t device_time) {
+        fit();
+        auto it = std::lower_bound(m_points.begin(), m_points.end(), device_time,
+                                   [](const Point& point, uint64_t time) { return point.device_time < time; });
+        if (it == m_points.end() || (it != m_points.begin() && device_time - (it - 1)->device_time <
+                                                                   it->device_time - device_time)) {
+            --it;
+        }
+        double offset = (double)(int64_t)(device_time - it->device_time);
+        return it->host_us + (int64_t)(it->intercept + it->slope * offset);
+    }
+
+    /**
+     * @brief Convert UTC microseconds to an unwrapped device timestamp, the inverse of toHostUs()
+     * @return the first device time that toHostUs() maps at or after [host_us]
+     * @note A binary search over toHostUs(), so the bound agrees with the times logdecode prints even where the
+     *       lines of two neighbouring sync points meet
+     */
+    uint64_t toDeviceTime(int64_t host_us) {
+        uint64_t low = 0U, high = 1ULL << 62;
+        while (low < high) {
+            uint64_t middle = low + (high - low) / 2U;
+            if (toHostUs(middle) < host_us) {
+                low = middle + 1U;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    /**
+     * @brief Format UTC microseconds as ISO 8601
+     */
+    static std::string formatUtc(int64_t host_us) {
+        time_t    seconds = (time_t)(host_us / 1000000);
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        char buffer[40];
+        size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+        snprintf(buffer + length, sizeof(buffer) - length, ".%06dZ", (int)(host_us % 1000000));
+        return buffer;
+    }
+
+    /**
+     * @brief Parse ISO 8601 UTC as written by formatUtc(), the fraction of second and the Z are optional
+     */
+    static bool parseUtc(const char* text, int64_t& host_us) {
+        struct tm utc = {};
+        int       consumed = 0;
+        if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d%n", &utc.tm_year, &utc.tm_mon, &utc.tm_mday, &utc.tm_hour,
+                   &utc.tm_min, &utc.tm_sec, &consumed) != 6) {
+            return false;
+        }
+        utc.tm_year -= 1900;
+        utc.tm_mon -= 1;
+        int64_t     fraction = 0;
+        const char* end = text + consumed;
+        if (*end == '.') {
+            for (int64_t scale = 100000; *++end >= '0' && *end <= '9'; scale /= 10) {
+                fraction += (*end - '0') * scale;
+            }
+        }
+        if (*end == 'Z') {
+            end++;
+        }
+        host_us = (int64_t)timegm(&utc) * 1000000 + fraction;
+        return *end == '\0';
+    }
+
+    static constexpr size_t FIT_NEIGHBOURS = 8U;  // points on each side used for the local fit
+
+   private:
+    struct Point {
+        uint64_t device_time;
+        int64_t  host_us;
+        double   slope;      // microseconds per device tick, nominal until fitted
+        double   intercept;  // correction of host_us at device_time
+    };
+
+    void fit() {
+        if (!m_dirty) {
+            return;
+        }
+        m_dirty = false;
+        for (size_t i = 0; i < m_points.size(); i++) {
+            size_t first = i > FIT_NEIGHBOURS ? i - FIT_NEIGHBOURS : 0U;
+            size_t last = std::min(m_points.size() - 1U, i + FIT_NEIGHBOURS);
+            if (last == first) {
+                continue;  // keep the nominal rate
+            }
+            // Least squares relative to point i, x in ticks and y in microseconds
+            double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+            for (size_t j = first; j <= last; j++) {
+                double x = (double)(int64_t)(m_points[j].device_time - m_points[i].device_time);
+                double y = (double)(m_points[j].host_us - m_points[i].host_us);
+                n += 1;
+                sx += x;
+                sy += y;
+                sxx += x * x;
+                sxy += x * y;
+            }
+            double den = n * sxx - sx * sx;
+            if (den > 0) {
+                m_points[i].slope = (n * sxy - sx * sy) / den;
+                m_points[i].intercept = (sy - m_points[i].slope * sx) / n;
+            }
+        }
+    }
+
+    std::vector<Point> m_points;
+    bool               m_dirty = false;
+};
+
+/**
+ * @brief Parse the "[timestamp] " prefix of a text record
+ * @return size_t length of the prefix, 0 if the line has none
+ */
+inline size_t parseTimestampPrefix(const char* line, size_t length, uint32_t& timestamp) {
+    if (length < 4U || line[0] != '[') {
+        return 0U;
+    }
+    uint64_t value = 0U;
+    size_t   i = 1;
+    while (i < length && line[i] >= '0' && line[i] <= '9' && i < 12U) {
+        value = value * 10U + (uint64_t)(line[i++] - '0');
+    }
+    if (i == 1U || i + 1U >= length || line[i] != ']' || line[i + 1U] != ' ' || value > UINT32_MAX) {
+        return 0U;
+    }
+    timestamp = (uint32_t)value;
+    return i + 2U;
+}
+
+/**
+ * @brief Parse a LOG_FRAME_SYNC_RESPONSE payload
+ */
+inline bool parseSyncResponse(const uint8_t* payload, size_t length, int64_t& host_us, uint32_t& device_time,
+                              uint32_t& device_hz) {
+    FrameReader reader(payload, length);
+    if (reader.u8() != LOG_FRAME_SYNC_RESPONSE) {
+        return false;
+    }
+    reader.u16();
+    host_us = (int64_t)reader.u64();
+    device_time = reader.u32();
+    device_hz = reader.u32();
+    return reader.ok();
+}
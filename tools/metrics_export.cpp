@@ -0,0 +1,139 @@
+/**
+ * @file metrics_export.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Convert the metrics frames of a logger capture into OpenMetrics text files
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o metrics_export tools/metrics_export.cpp
+Usage:  metrics_export [-o metrics.prom] [-t] [-b baud] [capture|-]
+
+Reads a raw capture of the logger output (a file, a serial device or stdin) and rewrites the output file after every
+decoded metrics frame, atomically through a temporary file, so it can be served by the node_exporter textfile
+collector. With -t the text output of the logger is copied to stdout. A serial device is opened in raw mode, at [baud]
+if given, like logtail does: the echo and the CR/LF and XON/XOFF handling of a cooked tty would corrupt the frames.
+*/
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "logmetrics.h"
+#include "serial_port.h"
+
+/**
+ * @brief Render the metrics whose names are known
+ */
+static std::string render(const MetricsState& state) {
+    std::string out;
+    char        line[64];
+    for (size_t id = 0; id < state.size(); id++) {
+        if (state.name(id).empty()) {
+            continue;
+        }
+        if (state.kind(id) == LOG_METRIC_COUNTER) {
+            // OpenMetrics counters are families without the _total suffix, their samples have it
+            std::string family = state.name(id);
+            if (family.size() > 6U && family.compare(family.size() - 6U, 6U, "_total") == 0) {
+                family.resize(family.size() - 6U);
+            }
+            snprintf(line, sizeof(line), " %u\n", state.value(id));
+            out += "# TYPE " + family + " counter\n" + family + "_total" + line;
+        } else {
+            snprintf(line, sizeof(line), " %d\n", (int32_t)state.value(id));
+            out += "# TYPE " + state.name(id) + " gauge\n" + state.name(id) + line;
+        }
+    }
+    out += "# EOF\n";
+    return out;
+}
+
+/**
+ * @brief Replace the output file atomically
+ */
+static bool writeAtomically(const std::string& path, const std::string& content) {
+    std::string tmp = path + ".tmp";
+    FILE*       file = fopen(tmp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(content.data(), 1, content.size(), file) == content.size();
+    ok = fclose(file) == 0 && ok;
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+int main(int argc, char** argv) {
+    std::string output = "metrics.prom";
+    const char* input = "-";
+    bool        copy_text = false;
+    uint32_t    baud = 0U;  // keep the setting of the device
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!strcmp(argv[i], "-t")) {
+            copy_text = true;
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            baud = (uint32_t)strtoul(argv[++i], nullptr, 0);
+        } else {
+            input = argv[i];
+        }
+    }
+
+    int         fd = STDIN_FILENO;
+    struct stat info;
+    if (strcmp(input, "-")) {
+        bool is_device = stat(input, &info) == 0 && S_ISCHR(info.st_mode);
+        fd = is_device ? openSerialPort(input, baud) : open(input, O_RDONLY);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s\n", input);
+        return 1;
+    }
+
+    MetricsState     state;
+    LogStreamDecoder decoder;
+    size_t           exports = 0, errors = 0;
+    decoder.onFrame = [&](const uint8_t* payload, size_t length) {
+        if (state.apply(payload, length)) {
+            if (!writeAtomically(output, render(state))) {
+                fprintf(stderr, "cannot write %s\n", output.c_str());
+            }
+            ++exports;
+        }
+    };
+    decoder.onError = [&]() { ++errors; };
+    if (copy_text) {
+        decoder.onText = [](const char* text, size_t length) { fwrite(text, 1, length, stdout); };
+    }
+
+    uint8_t buffer[4096];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        decoder.feed(buffer, (size_t)length);
+        fflush(stdout);
+    }
+    decoder.finish();
+    fprintf(stderr, "%zu exports, %zu malformed frames\n", exports, errors);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file rtt_reader.cpp
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Read the output of an RttSink from a memory dump or a shared memory file
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Note
+Build:  g++ -std=c++17 -O2 -o rtt_reader tools/rtt_reader.cpp
+Usage:  rtt_reader [-f] [-i interval_ms] image > capture.bin
+
+[image] is a RAM dump of the device (e.g. taken by the debugger) or a shared memory file. The control block is found by
+its id, see LoggerRttControlBlock in logger_sinks.h, and the unread data are written to stdout. With -f the image is
+followed like a probe would do: the new data are read every [interval_ms] (1 by default) and read_off is written back,
+which lets the logger reuse the space. Without -f the image is not modified.
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static constexpr char     RTT_ID[] = "LOGGER RTT";
+static constexpr uint32_t RTT_VERSION = 1U;
+static constexpr size_t   RTT_BLOCK_SIZE = 36U;  // id[16], version, buffer_offset, size, write_off, read_off
+
+static constexpr size_t OFFSET_VERSION = 16U;
+static constexpr size_t OFFSET_BUFFER = 20U;
+static constexpr size_t OFFSET_SIZE = 24U;
+static constexpr size_t OFFSET_WRITE = 28U;
+static constexpr size_t OFFSET_READ = 32U;
+
+static uint32_t load32(const uint8_t* image, size_t offset) {
+    uint32_t value;
+    memcpy(&value, image + offset, sizeof(value));  // the device and the host are both little-endian
+    return value;
+}
+
+/**
+ * @brief Read a word the device may be writing
+ */
+static uint32_t loadShared32(uint8_t* image, size_t offset) {
+    return __atomic_load_n((uint32_t*)(image + offset), __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Find a valid control block in the image
+ * @return the offset of the block, or SIZE_MAX
+ */
+static size_t findControlBlock(const uint8_t* image, size_t length, size_t& buffer, uint32_t& size) {
+    for (size_t pos = 0; pos + RTT_BLOCK_SIZE <= length; pos += 4U) {  // the block is word aligned
+        if (memcmp(image + pos, RTT_ID, sizeof(RTT_ID)) || load32(image, pos + OFFSET_VERSION) != RTT_VERSION) {
+            continue;
+        }
+        int64_t offset = (int64_t)pos + (int32_t)load32(image, pos + OFFSET_BUFFER);
+        size = load32(image, pos + OFFSET_SIZE);
+        if (offset >= 0 && size > 0U && (uint64_t)offset + size <= length) {
+            buffer = (size_t)offset;
+            return pos;
+        }
+    }
+    return SIZE_MAX;
+}
+
+/**
+ * @brief Write the data between read_off and write_off to stdout
+ * @return the new read_off
+ */
+static uint32_t drain(const uint8_t* buffer, uint32_t size, uint32_t read_off, uint32_t write_off) {
+    if (write_off >= size || read_off >= size) {
+        return read_off;  // torn or corrupted offsets, try again
+    }
+    if (write_off < read_off) {
+        fwrite(buffer + read_off, 1, size - read_off, stdout);
+        read_off = 0U;
+    }
+    fwrite(buffer + read_off, 1, write_off - read_off, stdout);
+    return write_off;
+}
+
+int main(int argc, char** argv) {
+    bool        follow = false;
+    uint32_t    interval_ms = 1U;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f")) {
+            follow = true;
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            interval_ms = (uint32_t)strtoul(argv[++i], nullptr, 0);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s [-f] [-i interval_ms] image\n", argv[0]);
+        return 1;
+    }
+
+    int         fd = open(path, follow ? O_RDWR : O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) || info.st_size == 0) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    size_t   length = (size_t)info.st_size;
+    uint8_t* image = (uint8_t*)mmap(nullptr, length, follow ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (image == MAP_FAILED) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    size_t   buffer;
+    uint32_t size;
+    size_t   block = SIZE_MAX;
+    while ((block = findControlBlock(image, length, buffer, size)) == SIZE_MAX && follow) {
+        usleep(interval_ms * 1000U);  // the device has not initialized the block yet
+    }
+    if (block == SIZE_MAX) {
+        fprintf(stderr, "no control block in %s\n", path);
+        return 1;
+    }
+    fprintf(stderr, "control block at 0x%zx, buffer at 0x%zx, %u bytes\n", block, buffer, size);
+
+    uint32_t read_off = loadShared32(image, block + OFFSET_READ);
+    do {
+        uint32_t write_off = loadShared32(image, block + OFFSET_WRITE);
+        if (write_off == read_off) {
+            fflush(stdout);
+            usleep(interval_ms * 1000U);
+            continue;
+        }
+        read_off = drain(image + buffer, size, read_off, write_off);
+        if (follow) {
+            __atomic_store_n((uint32_t*)(image + block + OFFSET_READ), read_off, __ATOMIC_RELEASE);
+        }
+    } while (follow);
+    return 0;
+}
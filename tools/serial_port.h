@@ -0,0 +1,78 @@
+/**
+ * @file serial_port.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief Open a serial device in raw mode for the host tools
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @brief Open a serial device (or a pty) in raw 8N1 mode
+ *
+ * @param baud baud rate, 0 to keep the current setting (e.g. for a pty)
+ * @return int file descriptor, or -1 on error
+ */
+inline int openSerialPort(const char* path, uint32_t baud) {
+    static const struct {
+        uint32_t rate;
+        speed_t  speed;
+    } speeds[] = {
+        {9600U, B9600},       {19200U, B19200},     {38400U, B38400},     {57600U, B57600},
+        {115200U, B115200},   {230400U, B230400},   {460800U, B460800},   {921600U, B921600},
+        {1000000U, B1000000}, {1500000U, B1500000}, {2000000U, B2000000}, {2500000U, B2500000},
+        {3000000U, B3000000}, {4000000U, B4000000},
+    };
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct termios tty;
+    if (tcgetattr(fd, &tty) == 0) {
+        cfmakeraw(&tty);
+        tty.c_cflag |= CLOCAL | CREAD;
+        tty.c_cc[VMIN] = 1;
+        tty.c_cc[VTIME] = 0;
+        if (baud) {
+            bool found = false;
+            for (const auto& entry : speeds) {
+                if (entry.rate == baud) {
+                    cfsetispeed(&tty, entry.speed);
+                    cfsetospeed(&tty, entry.speed);
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "unsupported baud rate %u\n", baud);
+                close(fd);
+                return -1;
+            }
+        }
+        tcsetattr(fd, TCSANOW, &tty);
+    }
+    return fd;
+}
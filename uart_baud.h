@@ -0,0 +1,79 @@
+/**
+ * @file uart_baud.h
+ * @author Keanight (hzh0602@gmail.com)
+ * @brief The best oversampling and baud rate divisor of an STM32 USART for a requested rate
+ * @version 0.0.1
+ * @date 2023-03-31
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the “Software”), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/* Note
+The USART divides its APB clock by 16 or, with OVER8 set in CR1, by 8 times USARTDIV, which has 4 (3 with OVER8)
+fraction bits. Either way the rate is PCLK / div with an integer div, the same steps, but 16x oversampling needs div >= 16
+and stops at PCLK / 16: 2.625 Mbaud for USART2 on a 42 MHz APB1. 8x oversampling goes up to PCLK / 8, so uartBaud()
+only takes it above PCLK / 16, 16x tolerates more noise and clock mismatch. Above 1 Mbaud the steps are coarse, check
+error_ppm: the receiver of the other side usually needs it within +-2%, e.g. 4 Mbaud is -4.5% on APB1 at 42 MHz but
+exact on USART1 with APB2 at 84 MHz. The result is plain data, so the host tools and benchmarks use it too.
+
+uartBaud(42000000U, 3000000U);    // 8x, BRR 0x0016, 3 Mbaud, 0 ppm
+uartBaud(42000000U, 4000000U);    // 8x, BRR 0x0013, 3.818 Mbaud, -45454 ppm
+uartBaud(84000000U, 4000000U);    // 16x, BRR 0x0015, 4 Mbaud, 0 ppm
+*/
+
+#include <stdint.h>
+
+/**
+ * @brief A divisor setting of the USART and how far it is from the requested rate
+ */
+struct UartBaud {
+    bool     over8;      // CR1.OVER8, 8x oversampling
+    uint16_t brr;        // the value of the BRR register
+    uint32_t actual;     // the baud rate it gives, in bit/s
+    int32_t  error_ppm;  // (actual - requested) / requested, in parts per million
+    bool     valid;      // false when the rate is above PCLK / 8 or below the smallest rate of the divisor
+};
+
+/**
+ * @brief The divisor of one oversampling, in 1/16 or 1/8 of USARTDIV units it's simply PCLK / baud rounded
+ */
+static inline UartBaud uartBaudWith(uint32_t pclk, uint32_t baud, bool over8) {
+    UartBaud setting;
+    uint32_t div = baud ? (uint32_t)(((uint64_t)pclk + baud / 2U) / baud) : 0U;  // USARTDIV * 16 or USARTDIV * 8
+    uint32_t min_div = over8 ? 8U : 16U, max_div = over8 ? 0x7FFFU : 0xFFFFU;
+
+    setting.over8 = over8;
+    setting.valid = div >= min_div && div <= max_div;  // a rate of 0 gives div 0, never valid
+    if (!setting.valid) {
+        setting.brr = 0U;
+        setting.actual = 0U;
+        setting.error_ppm = 0;
+        return setting;
+    }
+    // with OVER8 the 3 fraction bits are BRR[2:0] and BRR[3] must be 0
+    setting.brr = (uint16_t)(over8 ? ((div & ~7U) << 1) | (div & 7U) : div);
+    setting.actual = pclk / div;
+    setting.error_ppm = (int32_t)(((int64_t)pclk * 1000000 / div - (int64_t)baud * 1000000) / baud);
+    return setting;
+}
+
+/**
+ * @brief The divisor for [baud] with the APB clock [pclk], 16x oversampling when it can reach the rate
+ */
+static inline UartBaud uartBaud(uint32_t pclk, uint32_t baud) {
+    UartBaud over16 = uartBaudWith(pclk, baud, false);
+    return over16.valid ? over16 : uartBaudWith(pclk, baud, true);
+}